@@ -0,0 +1,471 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <algorithm>      // for lower_bound, stable_sort
+#include <cstddef>        // for size_t, byte
+#include <cstdint>        // for uint32_t
+#include <cstring>        // for memcpy
+#include <map>            // for map
+#include <memory>         // for unique_ptr
+#include <mutex>          // for mutex, lock_guard
+#include <new>            // for align_val_t
+#include <stdexcept>      // for out_of_range, logic_error
+#include <tuple>          // for tuple
+#include <type_traits>    // for is_same_v
+#include <unordered_map>  // for unordered_map
+#include <utility>        // for exchange, forward
+#include <vector>         // for vector
+#include "heco_common.h"
+
+namespace heco
+{
+    //Immutable layout shared by all the containers holding the same set of types: offsets, operations and size of their buffer.
+    //Archetypes are created once by the archetype_registry and live as long as the process.
+    class archetype
+    {
+    public:
+        struct component
+        {
+            type_id_t id;
+            std::uint32_t offset;
+            const type_ops* ops;
+        };
+
+        static constexpr std::uint32_t npos = std::uint32_t(-1);
+        static constexpr std::size_t header_size = sizeof(const archetype*);//< each buffer starts with a pointer to its archetype
+
+        const std::vector<component>& components() const noexcept { return parts; }
+        std::size_t size() const noexcept { return parts.size(); }
+        std::size_t bytes() const noexcept { return block_size; }//< of a buffer, header included
+        std::size_t alignment() const noexcept { return block_alignment; }
+        bool trivially_copyable() const noexcept { return trivial; }//< then also trivially destructible
+
+        std::uint32_t offset(type_id_t id) const noexcept { return id < offsets.size() ? offsets[id] : npos; }
+        bool contains(type_id_t id) const noexcept { return offset(id) != npos; }
+
+    private:
+        friend class archetype_registry;
+
+        std::vector<component> parts;//< sorted by id
+        std::vector<std::uint32_t> offsets;//< indexed by type id
+        std::size_t block_size = 0;
+        std::size_t block_alignment = alignof(const archetype*);
+        bool trivial = true;
+        mutable std::unordered_map<type_id_t, const archetype*> edges;//< archetype with the type toggled, guarded by the registry
+
+        //Components sorted by decreasing alignment after the header, which leaves padding only for over-aligned types
+        explicit archetype(std::vector<const type_ops*> types)
+        {
+            std::stable_sort(types.begin(), types.end(), [](const type_ops* a, const type_ops* b) { return a->alignment > b->alignment; });
+            std::size_t end = header_size;
+            for (const type_ops* ops : types) {
+                end = (end + ops->alignment - 1) / ops->alignment * ops->alignment;
+                parts.push_back({ ops->id, std::uint32_t(end), ops });
+                end += ops->size;
+                block_alignment = std::max(block_alignment, ops->alignment);
+                trivial = trivial && ops->trivially_copyable;
+            }
+            block_size = parts.empty() ? 0 : (end + block_alignment - 1) / block_alignment * block_alignment;
+            std::sort(parts.begin(), parts.end(), [](const component& a, const component& b) { return a.id < b.id; });
+            for (const component& c : parts) {
+                if (c.id >= offsets.size())
+                    offsets.resize(c.id + 1, npos);
+                offsets[c.id] = c.offset;
+            }
+        }
+    };
+
+    //Owner of the archetypes and of the cached transitions between them, adding or removing one type.
+    //Thread safe; transitions lock, lookups of a container in its archetype do not.
+    class archetype_registry
+    {
+    public:
+        static archetype_registry& global()
+        {
+            static archetype_registry registry;
+            return registry;
+        }
+
+        const archetype* root() const noexcept { return &empty; }
+
+        //Archetype of the types of from plus the type of ops
+        const archetype* with(const archetype* from, const type_ops& ops)
+        {
+            const std::lock_guard<std::mutex> lock(m);
+            if (const archetype* to = cached(from, ops.id))
+                return to;
+            std::vector<const type_ops*> types;
+            for (auto& c : from->components())
+                types.push_back(c.ops);
+            types.push_back(&ops);
+            return link(from, ops.id, std::move(types));
+        }
+
+        //Archetype of the types of from but the given one
+        const archetype* without(const archetype* from, type_id_t id)
+        {
+            const std::lock_guard<std::mutex> lock(m);
+            if (const archetype* to = cached(from, id))
+                return to;
+            std::vector<const type_ops*> types;
+            for (auto& c : from->components())
+                if (c.id != id)
+                    types.push_back(c.ops);
+            return link(from, id, std::move(types));
+        }
+
+        std::size_t size() const
+        {
+            const std::lock_guard<std::mutex> lock(m);
+            return archetypes.size() + 1;
+        }
+
+    private:
+        mutable std::mutex m;
+        archetype empty{ {} };
+        std::map<std::vector<type_id_t>, std::unique_ptr<archetype>> archetypes;
+
+        static const archetype* cached(const archetype* from, type_id_t id)
+        {
+            auto it = from->edges.find(id);
+            return it != from->edges.end() ? it->second : nullptr;
+        }
+
+        const archetype* link(const archetype* from, type_id_t id, std::vector<const type_ops*> types)
+        {
+            std::vector<type_id_t> key;
+            for (const type_ops* ops : types)
+                key.push_back(ops->id);
+            std::sort(key.begin(), key.end());
+            const archetype* to = &empty;
+            if (!key.empty()) {
+                auto& slot = archetypes[key];
+                if (!slot)
+                    slot.reset(new archetype(std::move(types)));
+                to = slot.get();
+            }
+            from->edges.emplace(id, to);
+            to->edges.emplace(id, from);
+            return to;
+        }
+    };
+
+    //HeterogeneousArray sharing its layout with every array of the same set of types.
+    //The array is a single pointer to a buffer starting with a pointer to its archetype: memory per array is the payload plus 8 bytes.
+    //Inserting or destructing a type moves the objects to the buffer of another archetype, found through the registry's cached transitions.
+    //Meant for many small arrays of a few type sets, e.g. one per entity; get is an indexed load in the archetype's offsets.
+    class ArchetypeArray
+    {
+    public:
+        ArchetypeArray() = default;
+        ArchetypeArray(const ArchetypeArray&) = delete;
+        ArchetypeArray& operator=(const ArchetypeArray&) = delete;
+        ArchetypeArray(ArchetypeArray&& other) noexcept : block(std::exchange(other.block, nullptr)) {}
+        ArchetypeArray& operator=(ArchetypeArray&& other) noexcept
+        {
+            if (this != &other) {
+                clear();
+                block = std::exchange(other.block, nullptr);
+            }
+            return *this;
+        }
+        ~ArchetypeArray() { clear(); }
+
+        const archetype& schema() const noexcept { return block ? **reinterpret_cast<const archetype* const*>(block) : *registry().root(); }
+
+        template<typename... Ts>
+        bool contains() const noexcept { return (schema().contains(type_id<Ts>()) && ...); }
+        std::size_t size() const noexcept { return schema().size(); }
+        bool empty() const noexcept { return block == nullptr; }
+
+        template<typename T, typename... Rest>
+        auto has() noexcept -> decltype(auto)
+        {
+            using U = std::remove_reference_t<T>;
+            if constexpr (sizeof...(Rest) == 0) {
+                const std::uint32_t off = schema().offset(type_id<U>());
+                return off != archetype::npos ? reinterpret_cast<U*>(block + off) : nullptr;
+            }
+            else
+                return std::forward_as_tuple(has<T>(), has<Rest>()...);
+        }
+
+        template<typename T, typename... Rest>
+        auto has() const noexcept -> decltype(auto)
+        {
+            using U = std::remove_reference_t<T>;
+            if constexpr (sizeof...(Rest) == 0) {
+                const std::uint32_t off = schema().offset(type_id<U>());
+                return off != archetype::npos ? reinterpret_cast<const U*>(block + off) : nullptr;
+            }
+            else
+                return std::forward_as_tuple(has<T>(), has<Rest>()...);
+        }
+
+        template<typename T, typename... Rest>
+        auto get() -> decltype(auto)
+        {
+            using U = std::remove_reference_t<T>;
+            if constexpr (sizeof...(Rest) == 0)
+                return *reinterpret_cast<U*>(block + checked_offset(type_id<U>()));
+            else
+                return std::forward_as_tuple(get<T>(), get<Rest>()...);
+        }
+
+        template<typename T, typename... Rest>
+        auto get() const -> decltype(auto)
+        {
+            using U = std::remove_reference_t<T>;
+            if constexpr (sizeof...(Rest) == 0)
+                return *reinterpret_cast<const U*>(block + checked_offset(type_id<U>()));
+            else
+                return std::forward_as_tuple(get<T>(), get<Rest>()...);
+        }
+
+        //Several types are inserted through a single transition. References are valid until the next change of archetype.
+        //Throws std::logic_error, inserting nothing, if a type is already stored: see insert_or_assign.
+        template<typename T = void, typename... Args>
+        decltype(auto) insert(Args&& ... args)
+        {
+            if constexpr (std::is_same_v<T, void>)
+                static_assert(((must_be_copyable_if_lvalue<Args> || must_be_moveable_if_rvalue<Args>) && ...), "Use in-place version insert<T>(Args...) instead");
+
+            if constexpr (!std::is_same_v<T, void>) {
+                using U = rm_cvref_t<T>;
+                if (contains<U>())
+                    throw std::logic_error("heco: type already stored");
+                migrate(registry().with(&schema(), *type_ops_of<U>()), [&](std::byte* to, const archetype& a) {
+                    ::new(to + a.offset(type_id<U>())) U{ std::forward<Args>(args)... };
+                });
+                return get<U>();
+            }
+            else if constexpr (sizeof...(Args) == 1)
+                return insert<Args...>(std::forward<Args>(args)...);
+            else {
+                if ((contains<Args>() || ...))
+                    throw std::logic_error("heco: type already stored");
+                const archetype* to = &schema();
+                ((to = registry().with(to, *type_ops_of<Args>())), ...);
+                migrate(to, [&](std::byte* fresh, const archetype& a) {
+                    construct_n<rm_cvref_t<Args>...>(fresh, a, std::forward<Args>(args)...);
+                });
+                return std::tuple<rm_cvref_t<Args>&...>{ get<rm_cvref_t<Args>>()... };
+            }
+        }
+
+        template<typename T = void, typename... Args>
+        decltype(auto) insert_or_assign(Args&& ... args)
+        {
+            if constexpr (!std::is_same_v<T, void>) {
+                using U = rm_cvref_t<T>;
+                if (U* p = has<U>())
+                    return *p = U{ std::forward<Args>(args)... };
+                return insert<U>(std::forward<Args>(args)...);
+            }
+            else if constexpr (sizeof...(Args) == 1)
+                return insert_or_assign<Args...>(std::forward<Args>(args)...);
+            else {
+                (insert_or_assign<Args>(std::forward<Args>(args)), ...);
+                return std::tuple<rm_cvref_t<Args>&...>{ get<rm_cvref_t<Args>>()... };
+            }
+        }
+
+        //Destroy the objects of the given types, moving the others to the archetype without them
+        template<typename... Ts>
+        void destruct()
+        {
+            const archetype* to = &schema();
+            ((to = to->contains(type_id<Ts>()) ? registry().without(to, type_id<Ts>()) : to), ...);
+            if (to != &schema())
+                migrate(to, [](std::byte*, const archetype&) {});
+        }
+
+        void clear() noexcept
+        {
+            if (!block)
+                return;
+            const archetype& a = schema();
+            if (!a.trivially_copyable())
+                for (auto& c : a.components())
+                    c.ops->destroy(block + c.offset);
+            ::operator delete(block, a.bytes(), std::align_val_t(a.alignment()));
+            block = nullptr;
+        }
+
+        //Call f(type_id, pointer) for each stored object, in increasing type id.
+        template<typename F>
+        void for_each(F&& f)
+        {
+            for (auto& c : schema().components())
+                f(c.id, static_cast<void*>(block + c.offset));
+        }
+
+        template<typename F>
+        void for_each(F&& f) const
+        {
+            for (auto& c : schema().components())
+                f(c.id, static_cast<const void*>(block + c.offset));
+        }
+
+        //Call visitor(T&) for each stored object whose type T is among the candidates.
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>)
+        {
+            using handler_t = void(*)(Visitor&, void*);
+            static const jump_table<handler_t> table{ { type_id<Cands>(), +[](Visitor& v, void* p) { v(*static_cast<Cands*>(p)); } }... };
+            for_each([&](type_id_t tid, void* p) { if (const auto handler = table[tid]) handler(visitor, p); });
+        }
+
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>) const
+        {
+            using handler_t = void(*)(Visitor&, const void*);
+            static const jump_table<handler_t> table{ { type_id<Cands>(), +[](Visitor& v, const void* p) { v(*static_cast<const Cands*>(p)); } }... };
+            for_each([&](type_id_t tid, const void* p) { if (const auto handler = table[tid]) handler(visitor, p); });
+        }
+
+        //Deep copy, sharing the archetype. When all objects are trivially copyable, it amounts to copying the buffer.
+        ArchetypeArray clone() const
+        {
+            ArchetypeArray copy;
+            if (!block)
+                return copy;
+            const archetype& a = schema();
+            copy.block = allocate(a);
+            if (a.trivially_copyable()) {
+                std::memcpy(copy.block + archetype::header_size, block + archetype::header_size, a.bytes() - archetype::header_size);
+                return copy;
+            }
+            std::size_t i = 0;
+            try {
+                for (; i < a.components().size(); ++i) {
+                    auto& c = a.components()[i];
+                    c.ops->copy_construct(copy.block + c.offset, block + c.offset);
+                }
+            }
+            catch (...) {
+                while (i--)
+                    a.components()[i].ops->destroy(copy.block + a.components()[i].offset);
+                ::operator delete(std::exchange(copy.block, nullptr), a.bytes(), std::align_val_t(a.alignment()));
+                throw;
+            }
+            return copy;
+        }
+
+        bool operator==(const ArchetypeArray& other) const
+        {
+            if (&schema() != &other.schema())
+                return false;
+            for (auto& c : schema().components())
+                if (!c.ops->equals(block + c.offset, other.block + c.offset))
+                    return false;
+            return true;
+        }
+        bool operator!=(const ArchetypeArray& other) const { return !(*this == other); }
+
+        std::size_t hash() const
+        {
+            return hash_objects([&](auto&& f) {
+                for (auto& c : schema().components())
+                    f(c.id, block + c.offset, *c.ops);
+            });
+        }
+
+        //Memory report of this array; the archetype it shares is not accounted for, its header is the index
+        container_stats stats() const
+        {
+            container_stats s;
+            s.container = "ArchetypeArray";
+            s.types.reserve(size());
+            for (auto& c : schema().components())
+                s.add_object(c.id, *c.ops);
+            if (block) {
+                s.index_bytes = archetype::header_size;
+                s.padding_bytes = schema().bytes() - archetype::header_size - s.object_bytes;
+            }
+            return s;
+        }
+
+    private:
+        std::byte* block = nullptr;
+
+        static archetype_registry& registry() { return archetype_registry::global(); }
+
+        static std::byte* allocate(const archetype& a)
+        {
+            auto* p = static_cast<std::byte*>(::operator new(a.bytes(), std::align_val_t(a.alignment())));
+            *reinterpret_cast<const archetype**>(p) = &a;
+            return p;
+        }
+
+        std::uint32_t checked_offset(type_id_t type) const
+        {
+            const std::uint32_t off = schema().offset(type);
+            if (off == archetype::npos)
+                throw std::out_of_range("heco: type not found");
+            return off;
+        }
+
+        template<typename... Ts, typename... Args>
+        static void construct_n(std::byte* to, const archetype& a, Args&&... args)
+        {
+            std::size_t n = 0;
+            try {
+                ((::new(to + a.offset(type_id<Ts>())) Ts{ std::forward<Args>(args) }, ++n), ...);
+            }
+            catch (...) {
+                const type_ops* ops[] = { type_ops_of<Ts>()... };
+                while (n--)
+                    ops[n]->destroy(to + a.offset(ops[n]->id));
+                throw;
+            }
+        }
+
+        //Move to the buffer of archetype to: construct(buffer, to) builds the objects new to it, then the others are relocated or destroyed
+        template<typename Construct>
+        void migrate(const archetype* to, Construct&& construct)
+        {
+            const archetype& from = schema();
+            std::byte* fresh = to->size() ? allocate(*to) : nullptr;
+            if (fresh) {
+                try {
+                    construct(fresh, *to);
+                }
+                catch (...) {
+                    ::operator delete(fresh, to->bytes(), std::align_val_t(to->alignment()));
+                    throw;
+                }
+            }
+            if (block) {
+                for (auto& c : from.components()) {
+                    const std::uint32_t off = to->offset(c.id);
+                    if (off != archetype::npos)
+                        c.ops->relocate(fresh + off, block + c.offset);
+                    else
+                        c.ops->destroy(block + c.offset);
+                }
+                ::operator delete(block, from.bytes(), std::align_val_t(from.alignment()));
+            }
+            block = fresh;
+        }
+    };
+}
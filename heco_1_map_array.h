@@ -19,15 +19,22 @@
 // LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
+#pragma once
 #include <cassert>
 #include <cstddef>
 #include <array>
 #include <vector>
 #include <algorithm>
 #include <numeric>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <tuple>
 #include <boost/align/aligned_allocator.hpp>
 #include <boost/container/static_vector.hpp>
 #include <unordered_map>
+#include "heco_common.h"
 
 namespace heco {
     template<typename T, size_t N>
@@ -39,55 +46,228 @@ namespace heco {
     template<typename K, typename V, typename... Args>
     using map = std::unordered_map<K, V, Args...>;
 
-    template<typename T>
-    using rm_cvref_t = std::remove_cv_t<std::remove_reference_t<T>>;//remove_cvref_t from C++20 only
-
     template<typename T = void, typename... Ts>
     constexpr bool all_types_different = !std::disjunction_v<std::is_same<T, Ts>...> && (sizeof...(Ts) > 0) ? all_types_different<Ts...> : true;
 
-    using type_id_t = std::uint32_t;
-
-    class TypeCounter {
-        static inline type_id_t i = 0;
-    public:
-        template<typename T>
-        static inline const auto id = i++;
-    };
-    template<typename T> inline auto type_id() { return TypeCounter::id<rm_cvref_t<T>>; }
-
     template<typename T, std::size_t N>
-    struct array : std::array<T, N> {
-        template<size_t M = N, typename = std::enable_if_t<M == 1>>//https://stackoverflow.com/questions/18100297/how-can-i-use-stdenable-if-in-a-conversion-operator | https://godbolt.org/z/PHVy-L
+    struct array : std::array<T, N> {};
+    template<typename T>
+    struct array<T, 1> : std::array<T, 1> {
+        //non-template conversions, so that built-in operators such as == consider them
         constexpr operator const T& () const { return (*this)[0]; }
-        template<size_t M = N, typename = std::enable_if_t<M == 1>>//https://stackoverflow.com/questions/18100297/how-can-i-use-stdenable-if-in-a-conversion-operator | https://godbolt.org/z/PHVy-L
         constexpr operator T& () { return (*this)[0]; }
     };
     template<typename T, typename... Ts, typename = std::enable_if_t<(std::is_same_v<T, Ts>&& ...)>>
     array(T t, Ts... ts)->array<T, 1 + sizeof...(Ts)>;//template deduction guide needed
 
     constexpr size_t default_alignment = 64;
+    constexpr size_t cache_line_size = 64;
+
+    //Layout of several types allocated at once, see do_allocate_n: offsets from the end of the buffer,
+    //bytes to allocate and padding among them
+    template<size_t N>
+    struct layout {
+        std::array<std::uint32_t, N> offsets;
+        std::uint32_t size;
+        std::uint32_t padding;
+    };
+
+    //Greedy placement of do_allocate_n when the end of the buffer is at the given residue modulo the largest alignment:
+    //repeatedly place the type needing the least padding, the largest one among ties, the first one among equals
+    template<size_t N>
+    constexpr layout<N> greedy_layout(const std::array<size_t, N>& sizes, const std::array<size_t, N>& alignments, size_t residue)
+    {
+        layout<N> output{};
+        std::array<bool, N> placed{};
+        size_t end = residue;
+        for (size_t k = 0; k < N; ++k) {
+            size_t chosen = N, min_padding = 0;
+            for (size_t i = 0; i < N; ++i) {
+                if (placed[i])
+                    continue;
+                const size_t padding = (~end + 1) & (alignments[i] - 1);
+                if (chosen == N || padding < min_padding || (padding == min_padding && sizes[i] > sizes[chosen])) {
+                    chosen = i;
+                    min_padding = padding;
+                }
+            }
+            output.offsets[chosen] = std::uint32_t(end - residue + min_padding);
+            output.padding += std::uint32_t(min_padding);
+            end += min_padding + sizes[chosen];
+            placed[chosen] = true;
+        }
+        output.size = std::uint32_t(end - residue);
+        return output;
+    }
+
+    //Tables are built at compile time up to this alignment, one layout per residue; beyond, the greedy search runs at runtime
+    constexpr size_t max_layout_table_alignment = 64;
+
+    template<size_t N, size_t MaxAlignment>
+    constexpr auto make_layout_table(const std::array<size_t, N>& sizes, const std::array<size_t, N>& alignments)
+    {
+        std::array<layout<N>, MaxAlignment> table{};
+        for (size_t residue = 0; residue < MaxAlignment; ++residue)
+            table[residue] = greedy_layout(sizes, alignments, residue);
+        return table;
+    }
 
-    class HeterogeneousArray
+    template<typename... Ts>
+    inline constexpr auto layout_table = make_layout_table<sizeof...(Ts), std::max({ alignof(Ts)... })>({ sizeof(Ts)... }, { alignof(Ts)... });
+
+    //Byte buffer whose start is aligned on a runtime alignment, which may exceed the one of its allocator.
+    //The storage is over-allocated by the difference, and the content is moved to the aligned start whenever
+    //growth or a copy places it elsewhere. Objects keep their offsets from the start; like the growth of a
+    //std::vector<std::byte>, moves are bytewise.
+    template<size_t Alignment>
+    class aligned_buffer
     {
+        std::vector<std::byte, aligned_allocator<std::byte, Alignment>> bytes;
+        size_t shift = 0;//< offset of the aligned start within bytes
+        size_t n = 0;
+        size_t align_to = Alignment;
+
+        size_t slack() const noexcept { return align_to - Alignment; }
+
+        void realign(size_t from)
+        {
+            const size_t to = bytes.empty() ? 0 : ((~std::uintptr_t(bytes.data()) + 1) & (align_to - 1));
+            if (to != from)
+                std::memmove(bytes.data() + to, bytes.data() + from, n);
+            shift = to;
+        }
+
     public:
-        using This = HeterogeneousArray;
-        using offset_t = std::uint32_t;
-        using destructor_t = void(*)(This&);
+        aligned_buffer() = default;
+        aligned_buffer(const aligned_buffer& other) : bytes(other.bytes), shift(other.shift), n(other.n), align_to(other.align_to) { realign(other.shift); }
+        aligned_buffer& operator=(const aligned_buffer& other) {
+            if (this != &other) {
+                bytes = other.bytes;
+                n = other.n;
+                align_to = other.align_to;
+                realign(other.shift);
+            }
+            return *this;
+        }
+        aligned_buffer(aligned_buffer&& other) noexcept
+            : bytes(std::move(other.bytes)), shift(std::exchange(other.shift, 0)), n(std::exchange(other.n, 0)), align_to(other.align_to) {}
+        aligned_buffer& operator=(aligned_buffer&& other) noexcept {
+            bytes = std::move(other.bytes);
+            shift = std::exchange(other.shift, 0);
+            n = std::exchange(other.n, 0);
+            align_to = other.align_to;
+            return *this;
+        }
+
+        std::byte* data() noexcept { return bytes.data() + shift; }
+        const std::byte* data() const noexcept { return bytes.data() + shift; }
+        std::byte& operator[](size_t i) noexcept { return data()[i]; }
+        const std::byte& operator[](size_t i) const noexcept { return data()[i]; }
+        size_t size() const noexcept { return n; }
+        bool empty() const noexcept { return n == 0; }
+        size_t capacity() const noexcept { return bytes.capacity() > slack() ? bytes.capacity() - slack() : 0; }
+        size_t alignment() const noexcept { return align_to; }
+        size_t overhead() const noexcept { return bytes.empty() ? 0 : slack(); }//< over-allocation to align the start
+
+        void resize(size_t count)
+        {
+            const std::byte* before = bytes.data();
+            bytes.resize(slack() + count);
+            if (bytes.data() != before) {
+                n = std::min(n, count);
+                realign(shift);
+            }
+            n = count;
+        }
 
-        HeterogeneousArray() = default;
-        HeterogeneousArray(const HeterogeneousArray&) = delete;
-        HeterogeneousArray& operator=(const HeterogeneousArray&) = delete;
-        HeterogeneousArray(HeterogeneousArray&&) = default;
-        HeterogeneousArray& operator=(HeterogeneousArray&&) = default;
-        ~HeterogeneousArray() {
-            for (auto [tid, destructor] : destructors)
-                destructor(*this);
+        void reserve(size_t count)
+        {
+            const std::byte* before = bytes.data();
+            bytes.reserve(slack() + count);
+            if (bytes.data() != before)
+                realign(shift);
         }
 
+        void clear() noexcept { bytes.clear(); shift = 0; n = 0; }
+
+        //Raise the alignment of the start, a power of two
+        void align(size_t alignment)
+        {
+            assert(alignment && (alignment & (alignment - 1)) == 0);
+            if (alignment <= align_to)
+                return;
+            const size_t from = shift;
+            align_to = alignment;
+            if (!bytes.empty()) {
+                bytes.resize(slack() + n);
+                realign(from);
+            }
+        }
+    };
+
+    //Cache lines given to an object against false sharing: its own line(s), or also the neighbour lines,
+    //against the adjacent-line prefetcher which fetches lines by aligned pairs
+    enum class isolation : std::uint8_t { none, cache_line, line_pair };
+
+    //File layout written by HeterogeneousArray::save: header, entries sorted by stable id, then the byte buffer
+    struct snapshot_header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t n_types;
+        std::uint64_t data_offset;//< multiple of snapshot_alignment, so that a mapping keeps objects aligned
+        std::uint64_t data_size;
+    };
+    struct snapshot_entry {
+        std::uint64_t stable_id;
+        std::uint32_t offset;
+        std::uint32_t size;
+        std::uint32_t alignment;
+        std::uint32_t reserved;
+    };
+    constexpr char snapshot_magic[8] = "heco1ma";
+    constexpr std::uint32_t snapshot_version = 1;
+    constexpr size_t snapshot_alignment = 4096;
+
+    //Parameters of HeterogeneousArray::relayout
+    struct relayout_policy {
+        size_t hot_types = 4;//< most accessed types placed first, in addition to the ones hinted hot
+        size_t cache_line = cache_line_size;//< the hot types are padded to a whole number of lines
+        bool reset_counts = true;//< start counting accesses anew after the relayout
+    };
+
+    //Observer is notified of the operations on the container, see null_observer in heco_common.h.
+    //Alignment is the one of the buffer's allocator; types aligned above it are stored too, the buffer being realigned.
+    template<typename Observer = null_observer, size_t Alignment = default_alignment>
+    class BasicHeterogeneousArray
+    {
+    public:
+        using This = BasicHeterogeneousArray;
+        using offset_t = std::uint32_t;
+        static constexpr offset_t empty_offset = offset_t(-1);//< empty types are recorded without storage
+
+        BasicHeterogeneousArray() = default;
+        BasicHeterogeneousArray(const BasicHeterogeneousArray&) = delete;
+        BasicHeterogeneousArray& operator=(const BasicHeterogeneousArray&) = delete;
+        BasicHeterogeneousArray(BasicHeterogeneousArray&&) = default;
+        BasicHeterogeneousArray& operator=(BasicHeterogeneousArray&&) = default;
+        ~BasicHeterogeneousArray() { destroy_all(); }
+
+        using observer_type = Observer;
+
     private:
         map<type_id_t, offset_t> offsets;
-        mutable std::vector<std::byte, aligned_allocator<std::byte, default_alignment>> data;
-        map<type_id_t, destructor_t> destructors;
+        mutable aligned_buffer<Alignment> data;
+        map<type_id_t, const type_ops*> destructors;//< operations of constructed objects, destruction included
+        std::vector<std::pair<offset_t, type_id_t>> in_memory_order;//< constructed objects with storage, sorted by offset, see for_each
+        std::size_t non_trivially_copyable = 0;//< number of constructed objects which cannot be copied bytewise
+        stat_counter padding_bytes;//< inserted by do_allocate_1/do_allocate_n to align objects
+        stat_counter rehashes;
+        stat_counter isolation_bytes;//< inserted around isolated objects
+        isolation default_isolation = isolation::none;
+        map<type_id_t, isolation> isolated;
+        mutable std::vector<std::uint64_t> access_counts;//< indexed by type id, empty when accesses are not counted
+        enum class temperature : std::uint8_t { hot, normal, cold };
+        map<type_id_t, temperature> hints;
 
     public:
         bool is_allocated(const type_id_t& type) const { return offsets.count(type); }
@@ -110,8 +290,8 @@ namespace heco {
             else {
                 if (contains(tid))
                     return &get<U>(offsets.at(tid));
-                else
-                    return (U*)nullptr;
+                Observer::on_get_miss(tid);
+                return (U*)nullptr;
             }
         }
 
@@ -128,10 +308,10 @@ namespace heco {
         }
 
         template<typename... Ts>
-        decltype(auto) get() const noexcept
+        decltype(auto) get() const
         {
             static_assert(sizeof...(Ts) > 0);
-            return get<Ts...>(offsets.at(type_id<Ts>()) ...);
+            return get<Ts...>(checked_offset(type_id<Ts>()) ...);
         }
 
         template<typename T, typename... Rest, typename Id, typename... Ids>
@@ -139,7 +319,9 @@ namespace heco {
         {
             static_assert(sizeof...(Rest) == sizeof...(Ids));
             static_assert(std::is_convertible_v<Id, offset_t> && (std::is_convertible_v<Ids, offset_t> && ...));
-            assert(offsets.at(type_id<T>()) == off && ((offsets.at(type_id<Rest>()) == offs) && ...));
+            assert(offsets.at(type_id<T>()) == offset_t(off) && ((offsets.at(type_id<Rest>()) == offset_t(offs)) && ...));
+            if (!access_counts.empty())
+                (++access_counts[type_id<T>()], (++access_counts[type_id<Rest>()], ...));
             auto*const p = data.data();
             if constexpr (sizeof...(Rest) == 0)
                 return do_get<T>(off);
@@ -151,6 +333,8 @@ namespace heco {
         decltype(auto) get(const array<offset_t,N>& offs) const noexcept
         {
             static_assert(sizeof...(Ts) == N);
+            if (!access_counts.empty())
+                (++access_counts[type_id<Ts>()], ...);
             if constexpr (sizeof...(Ts) == 1)
                 return (do_get<Ts>(offs[0]),...);
             else {
@@ -165,10 +349,14 @@ namespace heco {
             constexpr auto N = sizeof...(Ts);
             assert((!is_allocated<Ts>() && ...));
             const auto offsets_to_insert = do_allocate<Ts...>();
-            offsets.reserve(offsets.size() + N);
-            destructors.reserve(destructors.size() + N);
+            {
+                const auto watch_offsets = watch_rehash(offsets);
+                const auto watch_destructors = watch_rehash(destructors);
+                offsets.reserve(offsets.size() + N);
+                destructors.reserve(destructors.size() + N);
+            }
             unsigned i = 0;
-            (offsets.emplace(type_id<Ts>(), offsets_to_insert[i++]), ...);
+            (record_type(type_id<Ts>(), offsets_to_insert[i++]), ...);
             if constexpr (sizeof...(Ts) == 1)
                 return offsets_to_insert[0];
             else
@@ -177,7 +365,12 @@ namespace heco {
 
         void reserve(size_t n_bytes, size_t n_types = 0, size_t n_destructors = 0)
         {
+            const auto watch_offsets = watch_rehash(offsets);
+            const auto watch_destructors = watch_rehash(destructors);
+            const size_t capacity = data.capacity();
             data.reserve(n_bytes);
+            if (data.capacity() != capacity)
+                Observer::on_grow(type_id_t(-1), capacity, data.capacity());
             offsets.reserve(n_types);
             destructors.reserve(n_destructors);
         }
@@ -237,33 +430,452 @@ namespace heco {
             (do_destruct<Ts>(), ...);
         }
 
+        //Runtime counterpart of destruct, e.g. to undo emplace: the storage of the type is kept.
+        //Returns the number of objects destroyed, 0 if the type was not constructed.
+        std::size_t erase(const type_id_t& type)
+        {
+            const auto it = destructors.find(type);
+            if (it == destructors.cend())
+                return 0;
+            const type_ops* ops = it->second;
+            const offset_t off = offsets.at(type);
+            Observer::on_destruct(type, off != empty_offset ? &data[off] : nullptr);
+            if (off != empty_offset) {
+                ops->destroy(&data[off]);
+                const std::pair<offset_t, type_id_t> entry{ off, type };
+                in_memory_order.erase(std::lower_bound(in_memory_order.begin(), in_memory_order.end(), entry));
+                if (!ops->trivially_copyable)
+                    --non_trivially_copyable;
+            }
+            destructors.erase(it);
+            return 1;
+        }
+
         void clear()
         {
-            for (auto [tid, destructor] : destructors)
-                destructor(*this);
+            destroy_all();
             destructors.clear();
+            in_memory_order.clear();
             offsets.clear();
             data.clear();
+            non_trivially_copyable = 0;
+            padding_bytes = {};
+            isolation_bytes = {};
+            std::fill(access_counts.begin(), access_counts.end(), 0);
         }
 
-    private:
-        template<typename T>
-        static constexpr bool must_be_copyable_if_lvalue = std::is_lvalue_reference_v<T> && std::is_copy_constructible_v<T>;
+        //Deep copy. When all objects are trivially copyable, it amounts to copying the buffer and the tables.
+        BasicHeterogeneousArray clone() const
+        {
+            BasicHeterogeneousArray copy;
+            copy.offsets = offsets;
+            copy.data = data;
+            copy.padding_bytes = padding_bytes;
+            copy.isolation_bytes = isolation_bytes;
+            copy.default_isolation = default_isolation;
+            copy.isolated = isolated;
+            copy.access_counts = access_counts;
+            copy.hints = hints;
+            copy.in_memory_order = in_memory_order;
+            if (non_trivially_copyable == 0) {
+                copy.destructors = destructors;
+                return copy;
+            }
+            copy.destructors.reserve(destructors.size());
+            for (auto [tid, ops] : destructors) {
+                if (const offset_t off = offsets.at(tid); off != empty_offset && !ops->trivially_copyable) {
+                    ops->copy_construct(&copy.data[off], &data[off]);
+                    ++copy.non_trivially_copyable;
+                }
+                copy.destructors.emplace(tid, ops);
+            }
+            return copy;
+        }
+
+        bool operator==(const BasicHeterogeneousArray& other) const
+        {
+            if (destructors.size() != other.destructors.size())
+                return false;
+            for (auto [tid, ops] : destructors) {
+                if (!other.is_constructed(tid))
+                    return false;
+                if (const offset_t off = offsets.at(tid); off != empty_offset && !ops->equals(&data[off], &other.data[other.offsets.at(tid)]))
+                    return false;
+            }
+            return true;
+        }
+        bool operator!=(const BasicHeterogeneousArray& other) const { return !(*this == other); }
+
+        //Write the buffer and the table of constructed objects, for trivially copyable objects only.
+        //Bytes outside of the objects (padding, isolation, destructed objects) are written as zeros, so that equal arrays save equal files.
+        //The file can be mapped back in memory with MappedHeterogeneousArray, see heco_1_map_mapped.h
+        void save(const std::string& path) const
+        {
+            std::vector<snapshot_entry> entries;
+            entries.reserve(destructors.size());
+            for (auto [tid, ops] : destructors) {
+                if (!ops->trivially_copyable)
+                    throw std::logic_error("heco: only trivially copyable objects can be saved");
+                const offset_t off = offsets.at(tid);
+                const bool empty = off == empty_offset;
+                entries.push_back({ ops->stable_id, off, std::uint32_t(empty ? 0 : ops->size), std::uint32_t(ops->alignment), 0 });
+            }
+            std::sort(entries.begin(), entries.end(), [](auto& a, auto& b) { return a.stable_id < b.stable_id; });
+            if (std::adjacent_find(entries.begin(), entries.end(), [](auto& a, auto& b) { return a.stable_id == b.stable_id; }) != entries.end())
+                throw std::logic_error("heco: stable type id collision");
+
+            snapshot_header header{};
+            std::copy(std::begin(snapshot_magic), std::end(snapshot_magic), header.magic);
+            header.version = snapshot_version;
+            header.n_types = std::uint32_t(entries.size());
+            const size_t table_end = sizeof(snapshot_header) + entries.size() * sizeof(snapshot_entry);
+            header.data_offset = (table_end + snapshot_alignment - 1) / snapshot_alignment * snapshot_alignment;
+            header.data_size = data.size();
+
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            if (!file)
+                throw std::runtime_error("heco: cannot open " + path);
+            const std::vector<char> padding(header.data_offset - table_end, 0);
+            std::vector<std::byte> image(data.size());
+            for (const snapshot_entry& e : entries)
+                if (e.size)
+                    std::memcpy(image.data() + e.offset, &data[e.offset], e.size);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(snapshot_entry)));
+            file.write(padding.data(), std::streamsize(padding.size()));
+            file.write(reinterpret_cast<const char*>(image.data()), std::streamsize(image.size()));
+            if (!file)
+                throw std::runtime_error("heco: cannot write " + path);
+        }
+
+        //Over the constructed objects, whatever their offsets: arrays equal after a relayout hash alike
+        std::size_t hash() const
+        {
+            return hash_objects([&](auto&& f) {
+                for (auto [tid, ops] : destructors) {
+                    const offset_t off = offsets.at(tid);
+                    f(tid, off == empty_offset ? nullptr : &data[off], *ops);
+                }
+            });
+        }
+
+        //Count the accesses through get and has, per type, to drive relayout. Counting costs a branch per access
+        //when disabled; when enabled, const accesses modify the counters and are no longer thread-safe.
+        void count_accesses(bool enable = true)
+        {
+            if (!enable)
+                access_counts = {};
+            else if (access_counts.empty()) {
+                access_counts.resize(1, 0);//< non-empty marks counting as enabled
+                for (auto [tid, off] : offsets)
+                    track_accesses(tid);
+            }
+        }
+
+        std::uint64_t accesses(type_id_t type) const { return type < access_counts.size() ? access_counts[type] : 0; }
         template<typename T>
-        static constexpr bool must_be_moveable_if_rvalue = (std::is_object_v<T> || std::is_rvalue_reference_v<T>) && std::is_move_constructible_v<T>;
+        std::uint64_t accesses() const { return accesses(type_id<T>()); }
+
+        //Give the types their own cache line, or line pair, so that threads writing to different objects do not share lines.
+        //Applies to the allocations which follow, and to every object on relayout.
+        template<typename... Ts>
+        void isolate(isolation level = isolation::cache_line) { (isolated.insert_or_assign(type_id<Ts>(), level), ...); }
+        //Default for the types without their own setting
+        void isolate_all(isolation level = isolation::cache_line) { default_isolation = level; }
+
+        //Hints for relayout, overriding access counts: hot types are placed first, cold ones last
+        template<typename... Ts>
+        void hot() { (hints.insert_or_assign(type_id<Ts>(), temperature::hot), ...); }
+        template<typename... Ts>
+        void cold() { (hints.insert_or_assign(type_id<Ts>(), temperature::cold), ...); }
+
+        //Rebuild the buffer with the hot types packed at the front, padded to whole cache lines so that cold
+        //objects do not share their lines, then the other types by decreasing access count, the cold ones last.
+        //Storage of destructed or reserved types is released. Objects are relocated, invalidating pointers and offsets.
+        //Objects whose move may throw are copied, and the originals destroyed only once every object is in place:
+        //if a copy throws, the array is left as it was. Returns the size of the hot region.
+        size_t relayout(const relayout_policy& policy = {})
+        {
+            assert(policy.cache_line > 0 && (policy.cache_line & (policy.cache_line - 1)) == 0);
+            struct slot { type_id_t tid; const type_ops* ops; offset_t from; temperature t; std::uint64_t count; };
+            std::vector<slot> slots;
+            slots.reserve(destructors.size());
+            for (auto [tid, ops] : destructors) {
+                const offset_t off = offsets.at(tid);
+                if (off == empty_offset)
+                    continue;
+                if (!ops->move_constructible)
+                    unsupported_operation("move constructible");
+                const auto hint = hints.find(tid);
+                slots.push_back({ tid, ops, off, hint != hints.cend() ? hint->second : temperature::normal, accesses(tid) });
+            }
+            std::sort(slots.begin(), slots.end(), [](const slot& a, const slot& b) {
+                return std::tie(a.t, b.count, a.from) < std::tie(b.t, a.count, b.from);
+            });
+            size_t promoted = 0;
+            for (slot& s : slots)
+                if (s.t == temperature::normal && s.count > 0 && promoted++ < policy.hot_types)
+                    s.t = temperature::hot;
+            //within a group, decreasing alignment leaves no padding between objects
+            std::stable_sort(slots.begin(), slots.end(), [](const slot& a, const slot& b) {
+                return std::make_tuple(a.t, b.ops->alignment) < std::make_tuple(b.t, a.ops->alignment);
+            });
+
+            std::vector<offset_t> to(slots.size());
+            size_t end = 0, hot_end = 0, padding = 0, isolation_padding = 0;
+            bool in_hot = true;
+            for (size_t i = 0; i < slots.size(); ++i) {
+                if (in_hot && slots[i].t != temperature::hot) {
+                    in_hot = false;
+                    hot_end = (end + policy.cache_line - 1) / policy.cache_line * policy.cache_line;
+                    padding += hot_end - end;
+                    end = hot_end;
+                }
+                const placement p = place(end, slots[i].ops->size, slots[i].ops->alignment, isolation_of(slots[i].tid));
+                (p.isolation ? isolation_padding : padding) += p.end - end - slots[i].ops->size;
+                to[i] = offset_t(p.offset);
+                end = p.end;
+            }
+            if (in_hot)
+                hot_end = end;
+
+            decltype(data) relaid;
+            relaid.align(std::max({ data.alignment(), policy.cache_line, isolated.empty() && default_isolation == isolation::none ? size_t(1) : cache_line_size }));
+            relaid.resize(end);
+            size_t copied = 0;
+            try {
+                for (; copied < slots.size(); ++copied)
+                    if (!slots[copied].ops->nothrow_relocatable)
+                        slots[copied].ops->copy_construct(&relaid[to[copied]], &data[slots[copied].from]);
+            }
+            catch (...) {
+                for (size_t i = 0; i < copied; ++i)
+                    if (!slots[i].ops->nothrow_relocatable)
+                        slots[i].ops->destroy(&relaid[to[i]]);
+                throw;
+            }
+            for (size_t i = 0; i < slots.size(); ++i) {
+                if (slots[i].ops->nothrow_relocatable)
+                    slots[i].ops->relocate(&relaid[to[i]], &data[slots[i].from]);
+                else
+                    slots[i].ops->destroy(&data[slots[i].from]);
+            }
+            data = std::move(relaid);
+            for (auto it = offsets.begin(); it != offsets.end();)
+                if (it->second != empty_offset && !is_constructed(it->first))
+                    it = offsets.erase(it);
+                else
+                    ++it;
+            in_memory_order.clear();
+            for (size_t i = 0; i < slots.size(); ++i) {
+                offsets[slots[i].tid] = to[i];
+                in_memory_order.emplace_back(to[i], slots[i].tid);
+            }
+            std::sort(in_memory_order.begin(), in_memory_order.end());
+            padding_bytes = {};
+            padding_bytes += padding;
+            isolation_bytes = {};
+            isolation_bytes += isolation_padding;
+            if (policy.reset_counts)
+                std::fill(access_counts.begin(), access_counts.end(), 0);
+            return hot_end;
+        }
+
+        //Memory report. Dead bytes are the storage kept by destructed or reserved types, as the buffer never shrinks.
+        container_stats stats() const
+        {
+            container_stats s;
+            s.container = "HeterogeneousArray";
+            s.types.reserve(destructors.size());
+            for (auto [tid, ops] : destructors) {
+                const std::size_t bytes = offsets.at(tid) == empty_offset ? 0 : ops->size;
+                ++s.objects;
+                s.object_bytes += bytes;
+                s.types.push_back({ tid, ops->stable_id, ops->size, ops->alignment, 1, bytes });
+            }
+            s.padding_bytes = padding_bytes;
+            s.isolation_bytes = isolation_bytes;
+            s.dead_bytes = data.size() - padding_bytes - isolation_bytes - s.object_bytes;
+            s.padding_bytes += data.overhead();
+            s.spare_bytes = data.capacity() - data.size();
+            s.add_table(offsets);
+            s.add_table(destructors);
+            s.rehashes = rehashes;
+            return s;
+        }
+
+        //Default construct an object of the type described by ops, for producers which only know types at runtime.
+        //Returns nullptr, constructing nothing, if the type is already constructed; a reserved type is constructed in its storage.
+        void* emplace(const type_ops& ops)
+        {
+            assert(!ops.is_empty);
+            if (is_constructed(ops.id))
+                return nullptr;
+            offset_t off;
+            if (const auto it = offsets.find(ops.id); it != offsets.cend())
+                off = it->second;
+            else {
+                off = do_allocate_1(ops.size, ops.alignment, ops.id)[0];
+                record_type(ops.id, off);
+            }
+            ops.default_construct(&data[off]);
+            record_ops(ops.id, &ops);
+            Observer::on_construct(ops.id, &data[off]);
+            return &data[off];
+        }
+
+        //Call f(type_id, pointer) for each constructed object, in memory order. Empty types have no storage and are skipped.
+        template<typename F>
+        void for_each(F&& f)
+        {
+            for (auto [off, tid] : in_memory_order)
+                f(tid, static_cast<void*>(&data[off]));
+        }
+
+        template<typename F>
+        void for_each(F&& f) const
+        {
+            for (auto [off, tid] : in_memory_order)
+                f(tid, static_cast<const void*>(&data[off]));
+        }
+
+        //Call visitor(T&) for each constructed object whose type T is among the candidates, in memory order.
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>)
+        {
+            using handler_t = void(*)(Visitor&, void*);
+            static const jump_table<handler_t> table{ { type_id<Cands>(), +[](Visitor& v, void* p) { v(*static_cast<Cands*>(p)); } }... };
+            for_each([&](type_id_t tid, void* p) { if (const auto handler = table[tid]) handler(visitor, p); });
+        }
+
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>) const
+        {
+            using handler_t = void(*)(Visitor&, const void*);
+            static const jump_table<handler_t> table{ { type_id<Cands>(), +[](Visitor& v, const void* p) { v(*static_cast<const Cands*>(p)); } }... };
+            for_each([&](type_id_t tid, const void* p) { if (const auto handler = table[tid]) handler(visitor, p); });
+        }
+
+        //Call f(Base&) for each constructed object whose type is Base or records Base in bases_of, see heco_common.h, in memory order
+        template<typename Base, typename F>
+        void for_each(F&& f)
+        {
+            const type_id_t base = type_id<Base>();
+            for (auto [off, tid] : in_memory_order)
+                if (void* p = destructors.at(tid)->upcast(&data[off], base))
+                    f(*static_cast<Base*>(p));
+        }
+
+        //Like for_each<Base>(f), but the objects of the listed types are passed as Ds& to f, which calls their functions directly
+        template<typename Base, typename F, typename... Ds>
+        void for_each(F&& f, type_list<Ds...>)
+        {
+            static_assert((std::is_base_of_v<Base, Ds> && ...));
+            if constexpr (sizeof...(Ds) == 0)
+                for_each<Base>(f);
+            else {
+                using handler_t = void(*)(F&, void*);
+                static const jump_table<handler_t> table{ { type_id<Ds>(), +[](F& f, void* p) { f(*static_cast<Ds*>(p)); } }... };
+                const type_id_t base = type_id<Base>();
+                for (auto [off, tid] : in_memory_order) {
+                    if (const auto handler = table[tid])
+                        handler(f, &data[off]);
+                    else if (void* p = destructors.at(tid)->upcast(&data[off], base))
+                        f(*static_cast<Base*>(p));
+                }
+            }
+        }
+
+        template<typename Base, typename F>
+        void for_each(F&& f) const
+        {
+            const_cast<This*>(this)->template for_each<Base>([&](Base& x) { f(static_cast<const Base&>(x)); });
+        }
+
+        template<typename Base, typename F, typename... Ds>
+        void for_each(F&& f, type_list<Ds...> types) const
+        {
+            const_cast<This*>(this)->template for_each<Base>([&](auto& x) { f(std::as_const(x)); }, types);
+        }
+
+    private:
+        void destroy_all()
+        {
+            for (auto [tid, ops] : destructors) {
+                const offset_t off = offsets.at(tid);
+                Observer::on_destruct(tid, off != empty_offset ? &data[off] : nullptr);
+                if (off != empty_offset)
+                    ops->destroy(&data[off]);
+            }
+        }
+
+        isolation isolation_of(type_id_t type) const
+        {
+            if (isolated.empty())
+                return default_isolation;
+            const auto it = isolated.find(type);
+            return it != isolated.cend() ? it->second : default_isolation;
+        }
+
+        //Where an object goes at or after offset end: its offset, the end of its storage,
+        //and whether the bytes around it are spent on isolation rather than alignment
+        struct placement { size_t offset; size_t end; bool isolation; };
+        static placement place(size_t end, size_t size, size_t alignment, isolation level)
+        {
+            const auto align_up = [](size_t n, size_t a) { return (n + a - 1) / a * a; };
+            if (level == isolation::none) {
+                const size_t offset = align_up(end, alignment);
+                return { offset, offset + size, false };
+            }
+            //an over-aligned type keeps its own alignment, the guard only sets a minimum distance
+            const size_t guard = level == isolation::line_pair ? cache_line_size : 0;
+            const size_t offset = align_up(align_up(end, cache_line_size) + guard, std::max(alignment, cache_line_size));
+            return { offset, offset + align_up(size, cache_line_size) + guard, true };
+        }
+
+        void track_accesses(type_id_t type)
+        {
+            if (type >= access_counts.size())
+                access_counts.resize(type + 1, 0);
+        }
+
+        offset_t checked_offset(type_id_t type) const
+        {
+            const auto it = offsets.find(type);
+            if (it == offsets.cend()) {
+                Observer::on_get_miss(type);
+                throw std::out_of_range("heco: type not found");
+            }
+            return it->second;
+        }
+
+        template<typename Map>
+        auto watch_rehash(const Map& m) { return rehash_watch<Map, Observer>(m, rehashes); }
 
         template<typename T>
-        void record_type(offset_t to_add) { offsets.emplace(type_id<T>(), to_add); }
-        void record_type(const type_id_t& type, offset_t to_add) { offsets.emplace(type, to_add); }
+        void record_type(offset_t to_add) { record_type(type_id<T>(), to_add); }
+        void record_type(const type_id_t& type, offset_t to_add) {
+            const auto watch = watch_rehash(offsets);
+            offsets.emplace(type, to_add);
+            if (!access_counts.empty())
+                track_accesses(type);
+            Observer::on_insert(type);
+        }
 
-        template<typename T, typename U = rm_cvref_t<T>>
-        void record_dtor(const type_id_t& type) {
-            if constexpr (std::is_empty_v<U>)
-                destructors.emplace(type, +[](This& c) {});
-            else
-                destructors.emplace(type, +[](This& c) { std::destroy_at(&c.get<U>()); });
+        void record_ops(const type_id_t& type, const type_ops* ops) {
+            const auto watch = watch_rehash(destructors);
+            const bool added = destructors.emplace(type, ops).second;
+            if (!ops->is_empty && !ops->trivially_copyable)
+                non_trivially_copyable += added;
+            if (const offset_t off = offsets.at(type); added && off != empty_offset) {
+                //allocations go to the end of the buffer, so the new object is usually the last one
+                const std::pair<offset_t, type_id_t> entry{ off, type };
+                in_memory_order.insert(std::upper_bound(in_memory_order.begin(), in_memory_order.end(), entry), entry);
+            }
         }
         template<typename T, typename U = rm_cvref_t<T>>
+        void record_dtor(const type_id_t& type) { record_ops(type, type_ops_of<U>()); }
+        template<typename T, typename U = rm_cvref_t<T>>
         void record_dtor() { record_dtor<U>(type_id<U>()); }
 
         template<typename T, typename... Args>
@@ -271,7 +883,9 @@ namespace heco {
         {
             assert(!is_constructed<T>());
             record_dtor<T>();
-            return do_construct<T>(offset, std::forward<Args>(args)...);
+            auto& value = do_construct<T>(offset, std::forward<Args>(args)...);
+            Observer::on_construct(type_id<T>(), &value);
+            return value;
         }
 
         template<typename... Ts, std::size_t N = sizeof...(Ts)>
@@ -287,8 +901,9 @@ namespace heco {
         {
             if constexpr (std::is_empty_v<T>) {
                 const auto tid = type_id<T>();
-                record_type(tid, 0);
+                record_type(tid, empty_offset);
                 record_dtor<T>(tid);
+                Observer::on_construct(tid, nullptr);
                 return;
             }
             else {
@@ -309,9 +924,11 @@ namespace heco {
             const type_id_t type_index[N] = { type_id<Ts>()... };
             if constexpr (all_empty) {
                 for (auto ti : type_index)
-                    record_type(ti, 0);
+                    record_type(ti, empty_offset);
                 size_t i = 0;
                 (record_dtor<Ts>(type_index[i++]), ...);
+                for (auto ti : type_index)
+                    Observer::on_construct(ti, nullptr);
                 return;
             }
             else {
@@ -326,8 +943,11 @@ namespace heco {
         {
             if (!is_constructed<T>())
                 return construct_1<T>(offsets[type_id<T>()], std::forward<Args>(args)...);
-            else
-                return do_assign<T>(offsets[type_id<T>()], std::forward<Args>(args)...);
+            else {
+                auto& value = do_assign<T>(offsets[type_id<T>()], std::forward<Args>(args)...);
+                Observer::on_assign(type_id<T>(), &value);
+                return value;
+            }
         }
 
         template<typename... Ts>
@@ -357,10 +977,7 @@ namespace heco {
         void do_destruct()
         {
             assert(contains<T>());
-            const auto type_index = type_id<T>();
-            if constexpr (!std::is_trivially_destructible_v<T>)
-                std::invoke(destructors.at(type_index), *this);
-            destructors.erase(type_index);
+            erase(type_id<T>());
         }
 
         template<typename T, typename U = rm_cvref_t<T>>
@@ -398,29 +1015,66 @@ namespace heco {
         template<typename... Ts>
         auto do_allocate() 
         {
-            static_assert(((alignof(Ts) <= default_alignment) && ...));
             static_assert(all_types_different<rm_cvref_t<Ts>...>);
             if constexpr (sizeof...(Ts) == 1)
                 return do_allocate_1<Ts...>();
-            else
+            else {
+                if ((default_isolation != isolation::none || !isolated.empty()) && ((isolation_of(type_id<Ts>()) != isolation::none) || ...)) {
+                    std::array<offset_t, sizeof...(Ts)> output;
+                    size_t i = 0;
+                    ((output[i++] = do_allocate_1<Ts>()[0]), ...);
+                    return output;
+                }
                 return do_allocate_n<Ts...>();
+            }
         }
 
         template<typename T>
-        auto do_allocate_1() ->std::array<offset_t, 1>
+        auto do_allocate_1() ->std::array<offset_t, 1> { return do_allocate_1(sizeof(T), alignof(T), type_id<T>()); }
+
+        auto do_allocate_1(size_t size, size_t alignment, type_id_t trigger) ->std::array<offset_t, 1>
         {
             using namespace std;
-            constexpr size_t alignment = alignof(T);
-            constexpr size_t size = sizeof(T);
+            if (alignment > data.alignment())
+                data.align(alignment);
             const size_t n = data.size();
+            if (const isolation level = isolation_of(trigger); level != isolation::none) {
+                data.align(cache_line_size);
+                //the buffer is aligned on cache lines, so that offsets and addresses share line boundaries
+                const placement p = place(n, size, alignment, level);
+                resize(p.end, trigger);
+                isolation_bytes += p.end - n - size;
+                return array{ offset_t(p.offset) };
+            }
             const uintptr_t ptr_end = uintptr_t(data.data() + n);
             const size_t padding = ((~ptr_end + 1) & (alignment - 1));
-            data.resize(n + padding + size);
+            resize(n + padding + size, trigger);
+            padding_bytes += padding;
             return array{ offset_t(n + padding) };
         }
 
         template<typename... Ts>
         auto do_allocate_n() ->std::array<offset_t, sizeof...(Ts)>
+        {
+            constexpr size_t max_alignment = std::max({ alignof(Ts)... });
+            if constexpr (max_alignment > max_layout_table_alignment)
+                return do_allocate_n_greedy<Ts...>();
+            else {
+                if constexpr (max_alignment > Alignment)
+                    data.align(max_alignment);
+                const size_t size_before = data.size();
+                const auto& l = layout_table<rm_cvref_t<Ts>...>[std::uintptr_t(data.data() + size_before) & (max_alignment - 1)];
+                std::array<offset_t, sizeof...(Ts)> output;
+                for (size_t i = 0; i < sizeof...(Ts); ++i)
+                    output[i] = offset_t(size_before + l.offsets[i]);
+                padding_bytes += l.padding;
+                resize(size_before + l.size, id_of<Ts...>()[0]);
+                return output;
+            }
+        }
+
+        template<typename... Ts>
+        auto do_allocate_n_greedy() ->std::array<offset_t, sizeof...(Ts)>
         {
             using namespace std;
 
@@ -428,6 +1082,8 @@ namespace heco {
             array<offset_t, N> output;
             size_t to_allocate = 0;
 
+            if constexpr (std::max({ alignof(Ts)... }) > Alignment)
+                data.align(std::max({ alignof(Ts)... }));
             const size_t size_before = data.size();
             uintptr_t ptr_end = uintptr_t(data.data() + size_before);
 
@@ -443,7 +1099,7 @@ namespace heco {
             //^ Fill container with indices to visit [0,1,...,N-1]
             while (!indices.empty())
             {
-                for_each(begin(indices), end(indices), [&](auto i) { paddings[i] = ((~ptr_end + 1) & (alignments[i] - 1)); });
+                std::for_each(begin(indices), end(indices), [&](auto i) { paddings[i] = ((~ptr_end + 1) & (alignments[i] - 1)); });
                 //^ Fill current padding for all remaining types to allocate for
                 size_t min_padding = paddings[*min_element(begin(indices), end(indices), [&](auto i, auto j) {return paddings[i] < paddings[j]; })];
                 //^ Get value of minimum padding
@@ -456,12 +1112,26 @@ namespace heco {
                 //^ Get index of type to store that has maximum size for the minimum padding
                 output[id_element] = size_before + to_allocate + min_padding;
                 to_allocate += min_padding + sizes[id_element];
+                padding_bytes += min_padding;
                 ptr_end += min_padding + sizes[id_element];
                 indices.erase(find(begin(indices), end(indices), id_element));
             }
             size_t size_after = size_before + to_allocate;
-            data.resize(size_after);
+            resize(size_after, id_of<Ts...>()[0]);
             return output;
         }
+
+        //Observers learn which type made the buffer reallocate, the first one of a batch
+        void resize(size_t n, type_id_t trigger)
+        {
+            const size_t capacity = data.capacity();
+            data.resize(n);
+            if (data.capacity() != capacity)
+                Observer::on_grow(trigger, capacity, data.capacity());
+        }
     };
-}
\ No newline at end of file
+
+    using HeterogeneousArray = BasicHeterogeneousArray<>;
+    template<size_t Alignment>
+    using AlignedHeterogeneousArray = BasicHeterogeneousArray<null_observer, Alignment>;
+}
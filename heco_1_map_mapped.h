@@ -0,0 +1,174 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <algorithm>      // for lower_bound, equal
+#include <cstddef>        // for size_t
+#include <cstdint>        // for std::uint64_t
+#include <new>            // for launder
+#include <stdexcept>      // for runtime_error, out_of_range, logic_error
+#include <string>         // for string
+#include <tuple>          // for forward_as_tuple
+#include <utility>        // for exchange
+#include <fcntl.h>        // for open
+#include <sys/mman.h>     // for mmap
+#include <sys/stat.h>     // for fstat
+#include <unistd.h>       // for close
+#include "heco_1_map_array.h"
+
+namespace heco
+{
+    //Read a file written by HeterogeneousArray::save through a memory mapping.
+    //Objects are served in place from the mapping, nothing is deserialized. POSIX only.
+    class MappedHeterogeneousArray
+    {
+    public:
+        enum class mode { read_only, copy_on_write };
+        using offset_t = HeterogeneousArray::offset_t;
+
+        MappedHeterogeneousArray() = default;
+        MappedHeterogeneousArray(const std::string& path, mode m = mode::read_only) : m(m)
+        {
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("heco: cannot open " + path);
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(snapshot_header)) {
+                ::close(fd);
+                throw std::runtime_error("heco: invalid snapshot " + path);
+            }
+            length = size_t(st.st_size);
+            const int protection = m == mode::copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ;
+            void* p = ::mmap(nullptr, length, protection, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED)
+                throw std::runtime_error("heco: cannot map " + path);
+            base = static_cast<std::byte*>(p);
+            if (!is_valid()) {
+                unmap();
+                throw std::runtime_error("heco: invalid snapshot " + path);
+            }
+        }
+        MappedHeterogeneousArray(const MappedHeterogeneousArray&) = delete;
+        MappedHeterogeneousArray& operator=(const MappedHeterogeneousArray&) = delete;
+        MappedHeterogeneousArray(MappedHeterogeneousArray&& other) noexcept
+            : base(std::exchange(other.base, nullptr)), length(std::exchange(other.length, 0)), m(other.m) {}
+        MappedHeterogeneousArray& operator=(MappedHeterogeneousArray&& other) noexcept {
+            if (this != &other) {
+                unmap();
+                base = std::exchange(other.base, nullptr);
+                length = std::exchange(other.length, 0);
+                m = other.m;
+            }
+            return *this;
+        }
+        ~MappedHeterogeneousArray() { unmap(); }
+
+        static MappedHeterogeneousArray map(const std::string& path, mode m = mode::read_only) { return { path, m }; }
+
+        std::size_t size() const noexcept { return base ? header().n_types : 0; }
+
+        template<typename... Ts>
+        bool contains() const noexcept { return (find(stable_type_id<Ts>()) && ...); }
+
+        template<typename T, typename U = rm_cvref_t<T>>
+        auto has() const {
+            if constexpr (std::is_empty_v<U>)
+                return contains<U>();
+            else
+                return contains<U>() ? &get<U>() : (const U*)nullptr;
+        }
+
+        template<typename T, typename... Rest>
+        decltype(auto) get() const
+        {
+            if constexpr (sizeof...(Rest) == 0)
+                return do_get<const rm_cvref_t<T>>();
+            else
+                return std::forward_as_tuple(get<T>(), get<Rest>()...);
+        }
+
+        //Writable access, only for copy-on-write mappings. Modifications are private to the process and never reach the file.
+        template<typename T, typename... Rest>
+        decltype(auto) get_mutable()
+        {
+            if (m != mode::copy_on_write)
+                throw std::logic_error("heco: read-only mapping");
+            if constexpr (sizeof...(Rest) == 0)
+                return do_get<rm_cvref_t<T>>();
+            else
+                return std::forward_as_tuple(get_mutable<T>(), get_mutable<Rest>()...);
+        }
+
+    private:
+        std::byte* base = nullptr;
+        std::size_t length = 0;
+        mode m = mode::read_only;
+
+        const snapshot_header& header() const noexcept { return *reinterpret_cast<const snapshot_header*>(base); }
+        const snapshot_entry* entries() const noexcept { return reinterpret_cast<const snapshot_entry*>(base + sizeof(snapshot_header)); }
+
+        bool is_valid() const noexcept
+        {
+            const snapshot_header& h = header();
+            if (!std::equal(std::begin(snapshot_magic), std::end(snapshot_magic), h.magic) || h.version != snapshot_version)
+                return false;
+            if (sizeof(snapshot_header) + size_t(h.n_types) * sizeof(snapshot_entry) > h.data_offset
+                || h.data_offset % snapshot_alignment != 0 || h.data_offset > length || h.data_size > length - h.data_offset)
+                return false;
+            for (const snapshot_entry* e = entries(); e != entries() + h.n_types; ++e)
+                if (e->offset != HeterogeneousArray::empty_offset && std::uint64_t(e->offset) + e->size > h.data_size)
+                    return false;
+            return true;
+        }
+
+        //Entries are sorted by stable id
+        const snapshot_entry* find(std::uint64_t id) const noexcept
+        {
+            if (!base)
+                return nullptr;
+            const snapshot_entry* last = entries() + header().n_types;
+            const snapshot_entry* it = std::lower_bound(entries(), last, id, [](auto& e, auto id) { return e.stable_id < id; });
+            return (it != last && it->stable_id == id) ? it : nullptr;
+        }
+
+        template<typename T, typename U = rm_cvref_t<T>>
+        T& do_get() const
+        {
+            static_assert(!std::is_empty_v<U>);
+            static_assert(std::is_trivially_copyable_v<U>, "Only trivially copyable objects are saved");
+            const snapshot_entry* e = find(stable_type_id<U>());
+            if (!e)
+                throw std::out_of_range("heco: type not found in snapshot");
+            if (e->size != sizeof(U) || e->alignment != alignof(U))
+                throw std::runtime_error("heco: type layout differs from the snapshot");
+            return *std::launder(reinterpret_cast<U*>(base + header().data_offset + e->offset));
+        }
+
+        void unmap() noexcept
+        {
+            if (base)
+                ::munmap(base, length);
+            base = nullptr;
+            length = 0;
+        }
+    };
+}
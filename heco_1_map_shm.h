@@ -0,0 +1,283 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <algorithm>      // for copy, equal
+#include <atomic>         // for atomic
+#include <cstddef>        // for size_t
+#include <cstdint>        // for std::uint64_t
+#include <new>            // for launder, bad_alloc
+#include <stdexcept>      // for runtime_error, out_of_range, logic_error
+#include <string>         // for string
+#include <tuple>          // for forward_as_tuple
+#include <type_traits>    // for is_trivially_copyable_v
+#include <utility>        // for exchange
+#include <fcntl.h>        // for O_* constants
+#include <sys/mman.h>     // for shm_open, mmap
+#include <sys/stat.h>     // for fstat
+#include <unistd.h>       // for ftruncate, close
+#include "heco_common.h"
+
+namespace heco
+{
+    //A HeterogeneousArray whose buffer and table live in a POSIX shared memory segment, so that several
+    //processes read the same objects without copying them. Capacities are fixed at creation, types are
+    //identified by their stable id, and objects must be trivially copyable since they are shared as bytes.
+    //One process writes at a time; an object becomes visible to readers once fully constructed.
+    class SharedHeterogeneousArray
+    {
+    public:
+        enum class access { read_only, read_write };
+        using offset_t = std::uint32_t;
+
+        SharedHeterogeneousArray() = default;
+        SharedHeterogeneousArray(const SharedHeterogeneousArray&) = delete;
+        SharedHeterogeneousArray& operator=(const SharedHeterogeneousArray&) = delete;
+        SharedHeterogeneousArray(SharedHeterogeneousArray&& other) noexcept
+            : base(std::exchange(other.base, nullptr)), length(std::exchange(other.length, 0)), mode(other.mode) {}
+        SharedHeterogeneousArray& operator=(SharedHeterogeneousArray&& other) noexcept {
+            if (this != &other) {
+                unmap();
+                base = std::exchange(other.base, nullptr);
+                length = std::exchange(other.length, 0);
+                mode = other.mode;
+            }
+            return *this;
+        }
+        ~SharedHeterogeneousArray() { unmap(); }
+
+        //Create a new segment, fails if it already exists. name follows shm_open conventions, e.g. "/my_state"
+        static SharedHeterogeneousArray create(const std::string& name, std::size_t capacity, std::size_t max_types)
+        {
+            std::size_t n_slots = 1;
+            while (n_slots < 2 * max_types)
+                n_slots *= 2;
+            const std::size_t table_end = sizeof(header_t) + n_slots * sizeof(slot_t);
+            const std::size_t data_offset = (table_end + page_size - 1) / page_size * page_size;
+            if (capacity > offset_t(-1))
+                throw std::length_error("heco: capacity exceeds the range of offsets");
+
+            const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0)
+                throw std::runtime_error("heco: cannot create shared memory " + name);
+            SharedHeterogeneousArray shm;
+            shm.length = data_offset + capacity;
+            if (::ftruncate(fd, off_t(shm.length)) != 0) {
+                ::close(fd);
+                ::shm_unlink(name.c_str());
+                throw std::runtime_error("heco: cannot size shared memory " + name);
+            }
+            shm.map(fd, access::read_write);
+            if (!shm.base) {
+                ::shm_unlink(name.c_str());
+                throw std::runtime_error("heco: cannot map shared memory " + name);
+            }
+            //ftruncate zero-fills the segment, i.e. all slots are empty
+            header_t& h = *::new(shm.base) header_t{};
+            std::copy(std::begin(magic), std::end(magic), h.magic);
+            h.n_slots = std::uint32_t(n_slots);
+            h.max_types = std::uint32_t(max_types);
+            h.data_offset = data_offset;
+            h.capacity = capacity;
+            for (std::size_t i = 0; i < n_slots; ++i)
+                ::new(shm.slots() + i) slot_t{};
+            return shm;
+        }
+
+        //Open an existing segment
+        static SharedHeterogeneousArray open(const std::string& name, access mode = access::read_only)
+        {
+            const int fd = ::shm_open(name.c_str(), mode == access::read_write ? O_RDWR : O_RDONLY, 0);
+            if (fd < 0)
+                throw std::runtime_error("heco: cannot open shared memory " + name);
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || std::size_t(st.st_size) < sizeof(header_t)) {
+                ::close(fd);
+                throw std::runtime_error("heco: invalid shared memory " + name);
+            }
+            SharedHeterogeneousArray shm;
+            shm.length = std::size_t(st.st_size);
+            shm.map(fd, mode);
+            if (!shm.base)
+                throw std::runtime_error("heco: cannot map shared memory " + name);
+            //probe needs a power of two of slots, some of them empty
+            const header_t& h = shm.header();
+            if (!std::equal(std::begin(magic), std::end(magic), h.magic)
+                || h.n_slots == 0 || (h.n_slots & (h.n_slots - 1)) != 0 || h.max_types >= h.n_slots
+                || h.data_offset > shm.length || h.capacity > shm.length - h.data_offset
+                || sizeof(header_t) + std::size_t(h.n_slots) * sizeof(slot_t) > h.data_offset)
+                throw std::runtime_error("heco: invalid shared memory " + name);
+            return shm;
+        }
+
+        //The segment lives until removed and unmapped by every process
+        static void remove(const std::string& name) { ::shm_unlink(name.c_str()); }
+
+        std::size_t size() const noexcept { return base ? header().n_types.load(std::memory_order_acquire) : 0; }
+        std::size_t capacity() const noexcept { return base ? header().capacity : 0; }
+        std::size_t used() const noexcept { return base ? header().used.load(std::memory_order_acquire) : 0; }
+
+        template<typename... Ts>
+        bool contains() const noexcept { return (find(stable_type_id<Ts>()) && ...); }
+
+        //Throws std::runtime_error, like get, if the stored object has another layout than U
+        template<typename T, typename U = rm_cvref_t<T>>
+        const U* has() const {
+            const slot_t* s = find(stable_type_id<U>());
+            return s ? &checked_object<const U>(*s) : nullptr;
+        }
+
+        template<typename T, typename... Rest>
+        decltype(auto) get() const
+        {
+            if constexpr (sizeof...(Rest) == 0)
+                return do_get<const rm_cvref_t<T>>();
+            else
+                return std::forward_as_tuple(get<T>(), get<Rest>()...);
+        }
+
+        //Writable access, only with read_write access. Other processes see modifications as they happen.
+        template<typename T, typename... Rest>
+        decltype(auto) get_mutable()
+        {
+            if (mode != access::read_write)
+                throw std::logic_error("heco: read-only shared memory");
+            if constexpr (sizeof...(Rest) == 0)
+                return do_get<rm_cvref_t<T>>();
+            else
+                return std::forward_as_tuple(get_mutable<T>(), get_mutable<Rest>()...);
+        }
+
+        template<typename T, typename... Args>
+        T& insert(Args&&... args)
+        {
+            using U = rm_cvref_t<T>;
+            static_assert(std::is_trivially_copyable_v<U>, "Objects are shared as bytes");
+            static_assert(alignof(U) <= page_size);
+            if (mode != access::read_write)
+                throw std::logic_error("heco: read-only shared memory");
+            header_t& h = header();
+            const std::uint64_t id = stable_type_id<U>();
+            if (find(id))
+                throw std::logic_error("heco: type already in shared memory");
+            if (h.n_types.load(std::memory_order_relaxed) >= h.max_types)
+                throw std::length_error("heco: shared memory type table is full");
+            const std::size_t used = h.used.load(std::memory_order_relaxed);
+            const std::size_t off = (used + alignof(U) - 1) / alignof(U) * alignof(U);
+            if (off + sizeof(U) > h.capacity)
+                throw std::bad_alloc();
+            U* value = ::new(data() + off) U{ std::forward<Args>(args)... };
+            slot_t* s = slots() + probe(id);
+            s->offset = offset_t(off);
+            s->size = std::uint32_t(sizeof(U));
+            s->alignment = std::uint32_t(alignof(U));
+            h.used.store(off + sizeof(U), std::memory_order_relaxed);
+            h.n_types.fetch_add(1, std::memory_order_relaxed);
+            s->stable_id.store(id, std::memory_order_release);//< publish
+            return *value;
+        }
+
+    private:
+        struct header_t {
+            char magic[8];
+            std::uint32_t n_slots;//< power of two
+            std::uint32_t max_types;
+            std::uint64_t data_offset;
+            std::uint64_t capacity;
+            std::atomic<std::uint64_t> used;
+            std::atomic<std::uint32_t> n_types;
+        };
+        //Open addressing table keyed by stable id, 0 marking an empty slot
+        struct slot_t {
+            std::atomic<std::uint64_t> stable_id;
+            offset_t offset;
+            std::uint32_t size;
+            std::uint32_t alignment;
+        };
+        static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+            "Atomics in shared memory must be lock free");
+        static constexpr char magic[8] = "heco1ms";
+        static constexpr std::size_t page_size = 4096;
+
+        std::byte* base = nullptr;
+        std::size_t length = 0;
+        access mode = access::read_only;
+
+        header_t& header() const noexcept { return *std::launder(reinterpret_cast<header_t*>(base)); }
+        slot_t* slots() const noexcept { return reinterpret_cast<slot_t*>(base + sizeof(header_t)); }
+        std::byte* data() const noexcept { return base + header().data_offset; }
+
+        std::size_t probe(std::uint64_t id) const noexcept
+        {
+            const std::size_t mask = header().n_slots - 1;
+            std::size_t i = std::size_t(id) & mask;
+            for (;;) {
+                const std::uint64_t current = slots()[i].stable_id.load(std::memory_order_acquire);
+                if (current == 0 || current == id)
+                    return i;
+                i = (i + 1) & mask;
+            }
+        }
+
+        const slot_t* find(std::uint64_t id) const noexcept
+        {
+            if (!base)
+                return nullptr;
+            const slot_t* s = slots() + probe(id);
+            return s->stable_id.load(std::memory_order_acquire) == id ? s : nullptr;
+        }
+
+        template<typename T, typename U = rm_cvref_t<T>>
+        T& do_get() const
+        {
+            static_assert(std::is_trivially_copyable_v<U>, "Objects are shared as bytes");
+            const slot_t* s = find(stable_type_id<U>());
+            if (!s)
+                throw std::out_of_range("heco: type not found in shared memory");
+            return checked_object<T>(*s);
+        }
+
+        template<typename T, typename U = rm_cvref_t<T>>
+        T& checked_object(const slot_t& s) const
+        {
+            if (s.size != sizeof(U) || s.alignment != alignof(U))
+                throw std::runtime_error("heco: type layout differs from the shared memory");
+            return *std::launder(reinterpret_cast<U*>(data() + s.offset));
+        }
+
+        void map(int fd, access m)
+        {
+            const int protection = m == access::read_write ? PROT_READ | PROT_WRITE : PROT_READ;
+            void* p = ::mmap(nullptr, length, protection, MAP_SHARED, fd, 0);
+            ::close(fd);
+            base = p == MAP_FAILED ? nullptr : static_cast<std::byte*>(p);
+            mode = m;
+        }
+
+        void unmap() noexcept
+        {
+            if (base)
+                ::munmap(base, length);
+            base = nullptr;
+            length = 0;
+        }
+    };
+}
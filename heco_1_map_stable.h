@@ -19,78 +19,387 @@
 // LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
+#include <array>          // for array
+#include <atomic>         // for atomic
 #include <cstddef>        // for size_t
 #include <cstdint>        // for std::uint32_t
-#include <memory>         // for unique_ptr
+#include <functional>     // for function
+#include <future>         // for future, async
+#include <memory>         // for shared_ptr, make_shared, allocate_shared
+#include <mutex>          // for mutex, lock_guard
+#include <new>            // for operator new, align_val_t
+#include <stdexcept>      // for out_of_range
 #include <tuple>          // for forward_as_tuple
 #include <type_traits>    // for remove_reference_t, remove_cv_t
 #include <unordered_map>  // for unordered_map
-#include <utility>        // for forward
+#include <utility>        // for forward, in_place_t
+#include <vector>
+#include "heco_common.h"
+#include "heco_thread_pool.h"
 
 namespace heco
 {
-    struct HeterogeneousContainer
+    //Object allocated along the control block of its shared_ptr, braced initialized as insert does, or from the result of a factory
+    template<typename T>
+    struct shared_box
     {
+        struct from_factory {};
+        template<typename... Args>
+        explicit shared_box(std::in_place_t, Args&&... args) : value{ std::forward<Args>(args)... } {}
+        template<typename F>
+        shared_box(from_factory, F& factory) : value(factory()) {}
+        T value;
+    };
+
+    //Freed memory blocks of the objects of a container, control block included, reused by the next objects of the same size.
+    //Shared with the allocators of the blocks, which may free them after the container is gone and from any thread.
+    class block_pool
+    {
+    public:
+        static constexpr std::size_t capacity = 16;
+
+        block_pool() = default;
+        block_pool(const block_pool&) = delete;
+        block_pool& operator=(const block_pool&) = delete;
+        ~block_pool()
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                ::operator delete(blocks[i].p);
+        }
+
+        void* allocate(std::size_t size)
+        {
+            {
+                const std::lock_guard<std::mutex> lock(m);
+                for (std::size_t i = 0; i < count; ++i)
+                    if (blocks[i].size == size) {
+                        void* p = blocks[i].p;
+                        blocks[i] = blocks[--count];
+                        return p;
+                    }
+            }
+            return ::operator new(size);
+        }
+
+        void deallocate(void* p, std::size_t size) noexcept
+        {
+            {
+                const std::lock_guard<std::mutex> lock(m);
+                if (count < capacity) {
+                    blocks[count++] = { size, p };
+                    return;
+                }
+            }
+            ::operator delete(p);
+        }
+
+        std::size_t bytes() const
+        {
+            const std::lock_guard<std::mutex> lock(m);
+            std::size_t n = 0;
+            for (std::size_t i = 0; i < count; ++i)
+                n += blocks[i].size;
+            return n;
+        }
+
     private:
+        struct block { std::size_t size; void* p; };
+        mutable std::mutex m;
+        std::array<block, capacity> blocks{};
+        std::size_t count = 0;
+    };
+
+    //Allocator drawing from a block_pool, over-aligned types excepted
+    template<typename T>
+    struct pool_allocator
+    {
+        using value_type = T;
+
+        explicit pool_allocator(std::shared_ptr<block_pool> pool) noexcept : pool(std::move(pool)) {}
+        template<typename U>
+        pool_allocator(const pool_allocator<U>& other) noexcept : pool(other.pool) {}
+
+        T* allocate(std::size_t n)
+        {
+            if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+                return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+            else
+                return static_cast<T*>(pool->allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, std::size_t n) noexcept
+        {
+            if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+                ::operator delete(p, std::align_val_t(alignof(T)));
+            else
+                pool->deallocate(p, n * sizeof(T));
+        }
+
+        template<typename U>
+        bool operator==(const pool_allocator<U>& other) const noexcept { return pool == other.pool; }
+        template<typename U>
+        bool operator!=(const pool_allocator<U>& other) const noexcept { return pool != other.pool; }
+
+        std::shared_ptr<block_pool> pool;
+    };
+
+    //Object of a container, shared with the snapshots taken of it.
+    //Writes go to a copy while the object is shared, so that snapshots keep the value they were taken with.
+    struct shared_object
+    {
+        std::shared_ptr<void> ptr;
+        const type_ops* ops = nullptr;
+
+        template<typename T, typename... Args>
+        static shared_object make(Args&&... args)
+        {
+            auto box = std::make_shared<shared_box<T>>(std::in_place, std::forward<Args>(args)...);
+            return { std::shared_ptr<void>(box, &box->value), type_ops_of<T>() };
+        }
+
+        template<typename T, typename... Args>
+        static shared_object make_in(const std::shared_ptr<block_pool>& pool, Args&&... args)
+        {
+            auto box = std::allocate_shared<shared_box<T>>(pool_allocator<shared_box<T>>(pool), std::in_place, std::forward<Args>(args)...);
+            return { std::shared_ptr<void>(box, &box->value), type_ops_of<T>() };
+        }
+
+        template<typename T, typename F>
+        static shared_object make_with(F& factory)
+        {
+            auto box = std::make_shared<shared_box<T>>(typename shared_box<T>::from_factory{}, factory);
+            return { std::shared_ptr<void>(box, &box->value), type_ops_of<T>() };
+        }
+
+        //Object heap allocated by ops, e.g. by create or clone
+        static shared_object adopt(void* p, const type_ops* ops) { return { std::shared_ptr<void>(p, ops_deleter{ ops }), ops }; }
+
+        void* get() const noexcept { return ptr.get(); }
+
+        //True if no snapshot shares the object, which can then be written in place
+        bool exclusive() const noexcept
+        {
+            if (ptr.use_count() > 1)
+                return false;
+            std::atomic_thread_fence(std::memory_order_acquire);//< past the reads of the snapshots which released it
+            return true;
+        }
+
+        //Object to write, copied first if shared. Throws std::logic_error if it must be copied and is not copyable.
+        void* writable()
+        {
+            if (!exclusive())
+                *this = adopt(ops->clone(ptr.get()), ops);
+            return ptr.get();
+        }
+    };
+
+    //Objects of a container as they were when the snapshot was taken, immutable.
+    //Objects are shared with the container until it writes them, and with the copies of the snapshot, which are cheap.
+    //A snapshot can be read from several threads while the container is written.
+    class container_snapshot
+    {
+    public:
+        container_snapshot() = default;
+
+        template<typename... Ts>
+        bool contains() const noexcept { return objects && (objects->count(type_id<Ts>()) && ...); }
+
+        std::size_t size() const noexcept { return objects ? objects->size() : 0; }
+
+        template<typename T>
+        const T* has() const noexcept
+        {
+            if (!objects)
+                return nullptr;
+            const auto it = objects->find(type_id<T>());
+            return it != objects->cend() ? static_cast<const T*>(it->second.get()) : nullptr;
+        }
+
+        //Throws std::out_of_range if T is missing
         template<typename T>
-        using rm_cvref_t = std::remove_cv_t<std::remove_reference_t<T>>;//remove_cvref_t from C++20 only
+        const T& get() const
+        {
+            if (const T* p = has<T>())
+                return *p;
+            throw std::out_of_range("heco: type not found");
+        }
+
+        //Call f(type_id, const pointer) for each object
+        template<typename F>
+        void for_each(F&& f) const
+        {
+            if (objects)
+                for (auto& [tid, object] : *objects)
+                    f(tid, static_cast<const void*>(object.get()));
+        }
+
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>) const
+        {
+            using handler_t = void(*)(Visitor&, const void*);
+            static const jump_table<handler_t> table{ { type_id<Cands>(), +[](Visitor& v, const void* p) { v(*static_cast<const Cands*>(p)); } }... };
+            for_each([&](type_id_t tid, const void* p) { if (const auto handler = table[tid]) handler(visitor, p); });
+        }
+
+    private:
+        template<typename Observer>
+        friend struct BasicHeterogeneousContainer;
+        using map_type = std::unordered_map<type_id_t, shared_object>;
+
+        explicit container_snapshot(std::shared_ptr<const map_type> objects) : objects(std::move(objects)) {}
+
+        std::shared_ptr<const map_type> objects;
+    };
+
+    //Observer is notified of the operations on the container, see null_observer in heco_common.h
+    template<typename Observer = null_observer>
+    struct BasicHeterogeneousContainer
+    {
+    private:
+        //Object constructed by its factory on first access, once whatever the number of threads asking for it.
+        //Entries are shared with the tasks of warm, which may still hold them once they have left the container.
+        struct lazy_entry
+        {
+            lazy_entry(const type_ops* ops, std::function<shared_object()> factory) : ops(ops), factory(std::move(factory)) {}
+            lazy_entry(const lazy_entry&) = delete;
+            lazy_entry& operator=(const lazy_entry&) = delete;
+
+            //A factory which throws constructs nothing, the next access calls it again
+            void* get() const
+            {
+                if (void* p = object.load(std::memory_order_acquire))
+                    return p;
+                const std::lock_guard<std::mutex> lock(constructing);
+                return construct();
+            }
+
+            //Construct the object for warm, unless the entry has left the container meanwhile
+            void warm() const
+            {
+                if (object.load(std::memory_order_acquire))
+                    return;
+                const std::lock_guard<std::mutex> lock(constructing);
+                if (!detached)
+                    construct();
+            }
+
+            //The entry leaves the container: a construction under way ends first, none starts afterwards.
+            //Returns the object if it was constructed.
+            void* detach() const
+            {
+                const std::lock_guard<std::mutex> lock(constructing);
+                detached = true;
+                return object.load(std::memory_order_relaxed);
+            }
+
+            //Constructed if needed, then copied if a snapshot shares it
+            void* writable()
+            {
+                get();
+                void* p = owner.writable();
+                object.store(p, std::memory_order_release);
+                return p;
+            }
+
+            void* constructed() const noexcept { return object.load(std::memory_order_acquire); }
 
-        using type_id_t = std::uint32_t;
+            const type_ops* ops;
+            std::function<shared_object()> factory;
+            mutable std::mutex constructing;
+            mutable bool detached = false;//< guarded by constructing
+            mutable shared_object owner;//< set before object, read once object is seen
+            mutable std::atomic<void*> object{ nullptr };
 
-        class TypeCounter {
-            static inline type_id_t i = 0;
-        public:
-            template<typename T>
-            static inline const auto id = i++;
+        private:
+            void* construct() const
+            {
+                if (void* p = object.load(std::memory_order_relaxed))
+                    return p;
+                owner = factory();
+                Observer::on_construct(ops->id, owner.get());
+                object.store(owner.get(), std::memory_order_release);
+                return owner.get();
+            }
         };
-        template<typename T> static inline auto type_id() { return TypeCounter::id<rm_cvref_t<T>>; }
 
     public:
-        HeterogeneousContainer() = default;
-        HeterogeneousContainer(const HeterogeneousContainer&) = delete;
-        HeterogeneousContainer& operator=(const HeterogeneousContainer&) = delete;
-        HeterogeneousContainer(HeterogeneousContainer&&) = default;
-        HeterogeneousContainer& operator=(HeterogeneousContainer&&) = default;
-        ~HeterogeneousContainer() = default;
+        BasicHeterogeneousContainer() = default;
+        BasicHeterogeneousContainer(const BasicHeterogeneousContainer&) = delete;
+        BasicHeterogeneousContainer& operator=(const BasicHeterogeneousContainer&) = delete;
+        BasicHeterogeneousContainer(BasicHeterogeneousContainer&&) = default;
+        BasicHeterogeneousContainer& operator=(BasicHeterogeneousContainer&&) = default;
+        ~BasicHeterogeneousContainer()
+        {
+            if constexpr (is_observed<Observer>)
+                for_each_constructed([](type_id_t tid, void* p, const type_ops*) { Observer::on_destruct(tid, p); });
+        }
+
+        using observer_type = Observer;
 
-        using ptr_dtor = std::unique_ptr<void,void(*)(void*)>;
-        std::unordered_map<type_id_t, ptr_dtor> data;
+        std::unordered_map<type_id_t, shared_object> data;
+        std::unordered_map<type_id_t, std::shared_ptr<lazy_entry>> lazy;//< registered by insert_lazy, constructed or not
+        stat_counter rehashes;
 
+        //Stored object detached with its map node, see extract and insert
+        using node_type = typename std::unordered_map<type_id_t, shared_object>::node_type;
+
+        //Map nodes freed by erase, reused by the next insertions of new types
+        static constexpr std::size_t max_spare_nodes = 16;
+        std::vector<node_type> spare_nodes;
+        std::shared_ptr<block_pool> blocks;//< created with the first object
+
+        //Lazy entries are contained before their construction
         template<typename... Ts>
-        bool contains() const noexcept { return (data.count(type_id<Ts>()) && ...);}
+        bool contains() const noexcept { return ((data.count(type_id<Ts>()) || lazy.count(type_id<Ts>())) && ...);}
 
         template<typename...Ts>
         void reserve() { reserve(sizeof...(Ts)); }
-        void reserve(std::size_t n) { data.reserve(n); }
+        void reserve(std::size_t n) {
+            const auto watch = watch_rehash(data);
+            data.reserve(n);
+        }
 
+        //Pointer to the object of type T, nullptr if missing. Constructs the object of a lazy entry.
+        //Unless T is const, the object is first copied if a snapshot shares it.
         template<typename T, typename... Rest>
-        auto has() noexcept -> decltype(auto)
+        auto has() -> decltype(auto)
         {
             using U = std::remove_reference_t<T>;
             if constexpr (sizeof...(Rest) == 0) {
                 auto it = data.find(type_id<U>());
-                return (it != data.cend()) ? static_cast<U*>(it->second.get()) : nullptr;
+                if (it != data.cend())
+                    return static_cast<U*>(std::is_const_v<U> ? it->second.get() : it->second.writable());
+                if (!lazy.empty())
+                    if (auto entry = lazy.find(type_id<U>()); entry != lazy.cend())
+                        return static_cast<U*>(std::is_const_v<U> ? entry->second->get() : entry->second->writable());
+                Observer::on_get_miss(type_id<U>());
+                return (U*)nullptr;
             }
             else
                 return std::forward_as_tuple(has<T>(), has<Rest>()...);
         }
 
+        //Throws std::out_of_range if T is missing. Constructs the object of a lazy entry.
+        //Unless T is const, the object is first copied if a snapshot shares it.
         template<typename T, typename... Rest>
-        auto get() noexcept -> decltype(auto)
+        auto get() -> decltype(auto)
         {
             using U = std::remove_reference_t<T>;
-            if constexpr (sizeof...(Rest) == 0)
-                return *static_cast<U*>(data.at(type_id<U>()).get());
+            if constexpr (sizeof...(Rest) == 0 && std::is_const_v<U>)
+                return std::as_const(*this).template get<T>();
+            else if constexpr (sizeof...(Rest) == 0)
+                return *static_cast<U*>(checked_writable(type_id<U>()));
             else
                 return std::forward_as_tuple(get<T>(), get<Rest>()...);
         }
 
         template<typename T, typename... Rest>
-        auto get() const noexcept -> decltype(auto)
+        auto get() const -> decltype(auto)
         {
             using U = std::remove_reference_t<T>;
             if constexpr (sizeof...(Rest) == 0)
-                return *static_cast<U*>(data.at(type_id<U>()).get());
+                return *static_cast<U*>(checked_get(type_id<U>()));
             else
                 return std::forward_as_tuple(get<T>(), get<Rest>()...);
         }
@@ -99,7 +408,7 @@ namespace heco
         auto insert(Args&& ... args) -> decltype(auto)
         {
             if constexpr (std::is_same_v<T, void>)
-                static_assert(((copyable_if_lvalue<Args> || moveable_if_rvalue<Args>) && ...)
+                static_assert(((must_be_copyable_if_lvalue<Args> || must_be_moveable_if_rvalue<Args>) && ...)
                     , "Use in-place construction version insert<T>(Args...) instead.");
 
             if constexpr (!std::is_same_v<T, void>)
@@ -121,40 +430,398 @@ namespace heco
                 return std::forward_as_tuple(insert_or_assign_1<Args>(std::forward<Args>(args))...);
         }
 
-    private:
-        template<typename T>
-        static constexpr bool copyable_if_lvalue = std::is_lvalue_reference_v<T> && std::is_copy_constructible_v<T>;
+        //Destroy the objects of Ts, lazy entries included, and return how many there were.
+        //Their map nodes and memory blocks are kept for the next insertions, so that erase then insert cycles do not allocate.
+        template<typename... Ts>
+        std::size_t erase() { return (erase(type_id<Ts>()) + ... + 0); }
+
+        std::size_t erase(type_id_t type)
+        {
+            if (auto node = data.extract(type)) {
+                Observer::on_destruct(type, node.mapped().get());
+                node.mapped() = {};//< the object outlives this if a snapshot shares it
+                if (spare_nodes.size() < max_spare_nodes)
+                    spare_nodes.push_back(std::move(node));
+                return 1;
+            }
+            if (lazy.empty())
+                return 0;
+            if (const auto it = lazy.find(type); it != lazy.end()) {
+                if (void* p = it->second->detach())
+                    Observer::on_destruct(type, p);
+                lazy.erase(it);
+                return 1;
+            }
+            return 0;
+        }
+
+        //Register a factory, called without arguments and returning a T, to construct T on the first get<T>() or has<T>().
+        //The first access constructs the object exactly once, even from several threads. Later ones miss in data then look the entry up,
+        //a const access adding an atomic load and a non-const one an atomic store, as writable may copy an object shared with a snapshot.
+        //Returns false, registering nothing, if T is already stored or registered. Registration itself is not thread-safe.
+        template<typename T, typename Factory>
+        bool insert_lazy(Factory&& factory)
+        {
+            using U = rm_cvref_t<T>;
+            const type_id_t tid = type_id<U>();
+            if (data.count(tid))
+                return false;
+            auto&& [it, in] = lazy.try_emplace(tid, std::make_shared<lazy_entry>(type_ops_of<U>(), [f = std::forward<Factory>(factory)]() mutable { return shared_object::make_with<U>(f); }));
+            if (in)
+                Observer::on_insert(tid);
+            return in;
+        }
+
+        //Construct the lazy entries of Ts not constructed yet on the threads of the pool, from a background thread.
+        //The future is ready once they are, rethrowing the first exception of a factory; accesses meanwhile wait for their object.
+        //Types which are not lazy are skipped. The container must not be destroyed before the future is ready.
+        //Entries may be erased, replaced by insert_or_assign or merged meanwhile: the task holds them, and does not construct
+        //the objects of entries which have left the container, waiting for those being constructed when they leave.
+        template<typename... Ts>
+        [[nodiscard]] std::future<void> warm(thread_pool& pool = thread_pool::global())
+        {
+            static_assert(sizeof...(Ts) > 0);
+            std::vector<std::shared_ptr<const lazy_entry>> pending;
+            for (const type_id_t tid : { type_id<Ts>()... })
+                if (auto it = lazy.find(tid); it != lazy.cend() && !it->second->constructed())
+                    pending.push_back(it->second);
+            return std::async(std::launch::async, [&pool, pending = std::move(pending)] {
+                pool.run(pending.size(), [&](std::size_t i) { pending[i]->warm(); });
+            });
+        }
+
+        //Detach the object of type T along with its map node, without allocating, moving or copying anything.
+        //The node is empty if T is not stored; lazy entries are not extracted.
+        //Observers see the object leave as if it were destroyed, and enter the container it is attached to as if it were constructed.
         template<typename T>
-        static constexpr bool moveable_if_rvalue = (std::is_object_v<T> || std::is_rvalue_reference_v<T>) && std::is_move_constructible_v<T>;
+        node_type extract()
+        {
+            node_type node = data.extract(type_id<T>());
+            if (!node.empty())
+                Observer::on_destruct(node.key(), node.mapped().get());
+            return node;
+        }
+
+        //Attach a node extracted from any container of this type, its object staying where it is.
+        //Returns false if the node is empty or its type is already contained, the node then staying with the caller.
+        bool insert(node_type&& node)
+        {
+            if (node.empty() || lazy.count(node.key()))
+                return false;
+            const type_id_t tid = node.key();
+            const auto watch = watch_rehash(data);
+            auto result = data.insert(std::move(node));
+            if (!result.inserted) {
+                node = std::move(result.node);
+                return false;
+            }
+            Observer::on_insert(tid);
+            Observer::on_construct(tid, result.position->second.get());
+            return true;
+        }
+
+        //Transfer the nodes of the types this container lacks from other, lazy entries included, without allocating or moving objects.
+        //The types both contain stay in other. Observers see the transfer as extract then insert do.
+        void merge(BasicHeterogeneousContainer& other)
+        {
+            const auto watch = watch_rehash(data);
+            for (auto it = other.data.begin(); it != other.data.end();) {
+                const auto node = it++;
+                if (!data.count(node->first) && !lazy.count(node->first)) {
+                    const type_id_t tid = node->first;
+                    void* p = node->second.get();
+                    Observer::on_destruct(tid, p);
+                    data.insert(other.data.extract(node));
+                    Observer::on_insert(tid);
+                    Observer::on_construct(tid, p);
+                }
+            }
+            for (auto it = other.lazy.begin(); it != other.lazy.end();) {
+                const auto node = it++;
+                if (!data.count(node->first) && !lazy.count(node->first)) {
+                    const type_id_t tid = node->first;
+                    void* p = node->second->constructed();
+                    if (p)
+                        Observer::on_destruct(tid, p);
+                    lazy.insert(other.lazy.extract(node));
+                    Observer::on_insert(tid);
+                    if (p)
+                        Observer::on_construct(tid, p);
+                }
+            }
+        }
+
+        void merge(BasicHeterogeneousContainer&& other) { merge(other); }
+
+        //Objects as they are now, constructed lazy entries included, in O(number of types) and without copying them.
+        //The container copies an object shared with snapshots before writing it: only the types written after a snapshot are copied.
+        //References obtained before the snapshot must not be used to write afterwards.
+        container_snapshot snapshot() const
+        {
+            auto objects = std::make_shared<container_snapshot::map_type>();
+            objects->reserve(data.size() + lazy.size());
+            for (auto& [tid, object] : data)
+                objects->emplace(tid, object);
+            for (auto& [tid, entry] : lazy)
+                if (entry->constructed())
+                    objects->emplace(tid, entry->owner);
+            return container_snapshot(std::move(objects));
+        }
+
+        //Constructed lazy entries are copied as objects, the others with their factory
+        BasicHeterogeneousContainer clone() const
+        {
+            BasicHeterogeneousContainer copy;
+            copy.data.reserve(data.size());
+            for_each_constructed([&](type_id_t tid, void* p, const type_ops* ops) { copy.data.emplace(tid, shared_object::adopt(ops->clone(p), ops)); });
+            for (auto& [tid, entry] : lazy)
+                if (!entry->constructed())
+                    copy.lazy.try_emplace(tid, std::make_shared<lazy_entry>(entry->ops, entry->factory));
+            return copy;
+        }
+
+        //Over the constructed objects, lazy entries included once constructed
+        bool operator==(const BasicHeterogeneousContainer& other) const
+        {
+            std::size_t n = 0, other_n = 0;
+            bool equal = true;
+            for_each_constructed([&](type_id_t tid, void* p, const type_ops* ops) {
+                const void* q = other.constructed(tid);
+                equal = equal && q && ops->equals(p, q);
+                ++n;
+            });
+            other.for_each_constructed([&](type_id_t, void*, const type_ops*) { ++other_n; });
+            return equal && n == other_n;
+        }
+        bool operator!=(const BasicHeterogeneousContainer& other) const { return !(*this == other); }
+
+        //Over the constructed objects like ==, so pending lazy entries do not change the hash
+        std::size_t hash() const
+        {
+            return hash_objects([&](auto&& f) {
+                for_each_constructed([&](type_id_t tid, void* p, const type_ops* ops) { f(tid, p, *ops); });
+            });
+        }
+
+        //Memory report, objects being allocated one by one on the heap
+        container_stats stats() const
+        {
+            container_stats s;
+            s.container = "HeterogeneousContainer";
+            s.types.reserve(data.size());
+            for_each_constructed([&](type_id_t tid, void*, const type_ops* ops) { s.add_object(tid, *ops); });
+            s.add_table(data);
+            if (!lazy.empty()) {
+                s.add_table(lazy);
+                s.index_bytes += lazy.size() * sizeof(lazy_entry);
+            }
+            s.spare_bytes += spare_nodes.size() * (sizeof(typename decltype(data)::value_type) + sizeof(void*));
+            if (blocks)
+                s.spare_bytes += blocks->bytes();
+            s.rehashes = rehashes;
+            return s;
+        }
+
+        //Default construct an object of the type described by ops, for producers which only know types at runtime.
+        //Returns nullptr, constructing nothing, if the type is already stored or registered by insert_lazy.
+        void* emplace(const type_ops& ops)
+        {
+            if (data.count(ops.id) || lazy.count(ops.id))
+                return nullptr;
+            shared_object& object = insert_new(ops.id, shared_object::adopt(ops.create(), &ops));
+            Observer::on_insert(ops.id);
+            Observer::on_construct(ops.id, object.get());
+            return object.get();
+        }
+
+        //Call f(type_id, pointer) for each stored object, lazy entries included once constructed.
+        //Objects shared with a snapshot are copied first
+        template<typename F>
+        void for_each(F&& f)
+        {
+            for (auto& [tid, object] : data)
+                f(tid, object.writable());
+            for (auto& [tid, entry] : lazy)
+                if (entry->constructed())
+                    f(tid, entry->writable());
+        }
+
+        template<typename F>
+        void for_each(F&& f) const
+        {
+            for_each_constructed([&](type_id_t tid, void* p, const type_ops*) { f(tid, static_cast<const void*>(p)); });
+        }
+
+        //Call visitor(T&) for each stored object whose type T is among the candidates.
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>)
+        {
+            using handler_t = void(*)(Visitor&, void*);
+            static const jump_table<handler_t> table{ { type_id<Cands>(), +[](Visitor& v, void* p) { v(*static_cast<Cands*>(p)); } }... };
+            for_each([&](type_id_t tid, void* p) { if (const auto handler = table[tid]) handler(visitor, p); });
+        }
+
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>) const
+        {
+            using handler_t = void(*)(Visitor&, const void*);
+            static const jump_table<handler_t> table{ { type_id<Cands>(), +[](Visitor& v, const void* p) { v(*static_cast<const Cands*>(p)); } }... };
+            for_each([&](type_id_t tid, const void* p) { if (const auto handler = table[tid]) handler(visitor, p); });
+        }
+
+    private:
+        void* checked_get(type_id_t type) const
+        {
+            const auto it = data.find(type);
+            if (it != data.cend())
+                return it->second.get();
+            if (void* p = get_lazy(type))
+                return p;
+            Observer::on_get_miss(type);
+            throw std::out_of_range("heco: type not found");
+        }
+
+        void* checked_writable(type_id_t type)
+        {
+            const auto it = data.find(type);
+            if (it != data.cend())
+                return it->second.writable();
+            if (!lazy.empty())
+                if (auto entry = lazy.find(type); entry != lazy.cend())
+                    return entry->second->writable();
+            Observer::on_get_miss(type);
+            throw std::out_of_range("heco: type not found");
+        }
+
+        //Object of the lazy entry of the type, constructed if needed, nullptr if there is none
+        void* get_lazy(type_id_t type) const
+        {
+            if (lazy.empty())
+                return nullptr;
+            const auto it = lazy.find(type);
+            return it != lazy.cend() ? it->second->get() : nullptr;
+        }
+
+        //Stored object of the type or constructed lazy entry, nullptr if none
+        const void* constructed(type_id_t type) const
+        {
+            if (const auto it = data.find(type); it != data.cend())
+                return it->second.get();
+            const auto it = lazy.find(type);
+            return it != lazy.cend() ? it->second->constructed() : nullptr;
+        }
+
+        //Call f(type_id, pointer, operations) for each stored object then each constructed lazy entry
+        template<typename F>
+        void for_each_constructed(F&& f) const
+        {
+            for (auto& [tid, object] : data)
+                f(tid, object.get(), object.ops);
+            for (auto& [tid, entry] : lazy)
+                if (void* p = entry->constructed())
+                    f(tid, p, entry->ops);
+        }
+
+        template<typename Map>
+        auto watch_rehash(const Map& m) { return rehash_watch<Map, Observer>(m, rehashes); }
+
+        template<typename T, typename... Args>
+        shared_object make_object(Args&&... args)
+        {
+            if (!blocks)
+                blocks = std::make_shared<block_pool>();
+            return shared_object::make_in<T>(blocks, std::forward<Args>(args)...);
+        }
+
+        //Store the object of a new type, in a node freed by erase if any
+        shared_object& insert_new(type_id_t type, shared_object object)
+        {
+            const auto watch = watch_rehash(data);
+            if (spare_nodes.empty())
+                return data.emplace(type, std::move(object)).first->second;
+            node_type node = std::move(spare_nodes.back());
+            spare_nodes.pop_back();
+            node.key() = type;
+            node.mapped() = std::move(object);
+            return data.insert(std::move(node)).position->second;
+        }
 
         template<typename T, typename... Args>
          auto insert_1(Args&&... args) -> decltype(auto)
         {
             using U = rm_cvref_t<T>;
-            auto&&[it, in] = data.emplace(
-                type_id<T>(),
-                std::unique_ptr<void, void (*)(void*)>{ new U{ std::forward<Args>(args)... },
-                                                        +[](void* instance) { delete static_cast<U*>(instance); } });
-            return *static_cast<U*>(it->second.get());
+            if (auto it = data.find(type_id<T>()); it != data.end())
+                return *static_cast<U*>(it->second.writable());
+            //a lazy entry is stored too: its object is constructed and returned, as get would
+            if (!lazy.empty())
+                if (auto entry = lazy.find(type_id<T>()); entry != lazy.end())
+                    return *static_cast<U*>(entry->second->writable());
+            shared_object& object = insert_new(type_id<T>(), make_object<U>(std::forward<Args>(args)...));
+            Observer::on_insert(type_id<T>());
+            Observer::on_construct(type_id<T>(), object.get());
+            return *static_cast<U*>(object.get());
         }
 
          template<typename... Ts>
          auto insert_n(Ts&&... values) -> decltype(auto)
          {
-             data.reserve(data.size() + sizeof...(Ts));
+             reserve(data.size() + sizeof...(Ts));
              return std::forward_as_tuple(insert_1<Ts>(std::forward<Ts>(values))...);
          }
 
+        //Assign a stored object in place, unless a snapshot shares it: it is then replaced to leave the snapshot as it was.
+        //The value replaces a lazy entry, constructed or not, the type being stored as any other from then on.
         template<typename T, typename... Args>
         auto insert_or_assign_1(Args&& ... args) -> decltype(auto)
         {
             using U = rm_cvref_t<T>;
-            auto&&[it,in] = data.insert_or_assign(
-                type_id<T>(),
-                std::unique_ptr<void, void(*)(void*)>{ new U{ std::forward<Args>(args)... },
-                                                       +[](void* instance) { delete static_cast<U*>(instance); } }
-            );
-            return *static_cast<U*>(it->second.get());
+            const auto it = data.find(type_id<T>());
+            if (it == data.end() && !lazy.empty())
+                if (const auto entry = lazy.find(type_id<T>()); entry != lazy.end()) {
+                    shared_object& object = insert_new(type_id<T>(), make_object<U>(std::forward<Args>(args)...));
+                    const bool constructed = entry->second->detach() != nullptr;
+                    lazy.erase(entry);
+                    if (constructed)
+                        Observer::on_assign(type_id<T>(), object.get());
+                    else
+                        Observer::on_construct(type_id<T>(), object.get());
+                    return *static_cast<U*>(object.get());
+                }
+            if (it == data.end()) {
+                shared_object& object = insert_new(type_id<T>(), make_object<U>(std::forward<Args>(args)...));
+                Observer::on_insert(type_id<T>());
+                Observer::on_construct(type_id<T>(), object.get());
+                return *static_cast<U*>(object.get());
+            }
+            shared_object& object = it->second;
+            if constexpr (is_assignable_from<U, Args...>)
+                if (object.exclusive()) {
+                    auto& value = do_assign<U>(*static_cast<U*>(object.get()), std::forward<Args>(args)...);
+                    Observer::on_assign(type_id<T>(), &value);
+                    return value;
+                }
+            object = make_object<U>(std::forward<Args>(args)...);
+            Observer::on_assign(type_id<T>(), object.get());
+            return *static_cast<U*>(object.get());
+        }
+
+        template<typename U, typename... Args>
+        static constexpr bool is_assignable_from = [] {
+            if constexpr (sizeof...(Args) == 1 && (std::is_same_v<U, rm_cvref_t<Args>> && ...))
+                return (std::is_assignable_v<U&, Args&&> && ...);
+            else
+                return std::is_move_assignable_v<U>;
+        }();
+
+        template<typename U, typename... Args>
+        static U& do_assign(U& value, Args&&... args)
+        {
+            if constexpr (sizeof...(Args) == 1 && (std::is_same_v<U, rm_cvref_t<Args>> && ...))
+                return value = (std::forward<Args>(args), ...);
+            else
+                return value = U{ std::forward<Args>(args)... };
         }
     };
-}
\ No newline at end of file
+
+    using HeterogeneousContainer = BasicHeterogeneousContainer<>;
+}
@@ -0,0 +1,882 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <algorithm>        // for lower_bound, max
+#include <cassert>
+#include <cstddef>          // for size_t
+#include <cstdint>          // for uint32_t
+#include <iterator>         // for begin, end
+#include <memory_resource>  // for pmr::memory_resource
+#include <new>              // for align_val_t
+#include <stdexcept>        // for logic_error
+#include <tuple>            // for forward_as_tuple
+#include <type_traits>      // for is_same_v
+#include <unordered_map>    // for unordered_map
+#include <utility>          // for forward, exchange, pair
+#include <vector>           // for vector
+#include "heco_common.h"
+
+//One container template whose policies pick how objects are stored, indexed, identified and allocated.
+//Each combination is a container of at most one object per type, with the interface shared by the other headers.
+namespace heco
+{
+    //Id policies: the key an object is indexed by
+    namespace id
+    {
+        //Sequential ids of the process, small and dense
+        struct dense
+        {
+            using type = type_id_t;
+            static constexpr bool is_dense = true;
+            template<typename T> static type of() { return type_id<T>(); }
+            static type of(const type_ops& ops) noexcept { return ops.id; }
+        };
+
+        //Hash of the type name, identical across processes, see stable_type_id
+        struct stable
+        {
+            using type = std::uint64_t;
+            static constexpr bool is_dense = false;
+            template<typename T> static type of() noexcept { return stable_type_id<T>(); }
+            static type of(const type_ops& ops) noexcept { return ops.stable_id; }
+        };
+    }
+
+    //Index policies: the table mapping a key to the slot of an object.
+    //A table exposes find, find_type<T>, emplace, erase, for_each, size, clear, reserve and stats.
+    namespace index
+    {
+        //Hash table of the standard library
+        struct hash_map
+        {
+            template<typename IdPolicy, typename Slot>
+            class table
+            {
+                using key_type = typename IdPolicy::type;
+                std::unordered_map<key_type, Slot> entries;
+                stat_counter rehashes;
+
+            public:
+                Slot* find(key_type key) noexcept
+                {
+                    auto it = entries.find(key);
+                    return it != entries.end() ? &it->second : nullptr;
+                }
+                const Slot* find(key_type key) const noexcept { return const_cast<table*>(this)->find(key); }
+                template<typename T> Slot* find_type() noexcept { return find(IdPolicy::template of<T>()); }
+                template<typename T> const Slot* find_type() const noexcept { return find(IdPolicy::template of<T>()); }
+
+                Slot& emplace(key_type key, const Slot& slot)
+                {
+                    const rehash_watch watch(entries, rehashes);
+                    return entries.emplace(key, slot).first->second;
+                }
+                void erase(key_type key) { entries.erase(key); }
+
+                template<typename F>
+                void for_each(F&& f) const
+                {
+                    for (auto& [key, slot] : entries)
+                        f(slot);
+                }
+
+                std::size_t size() const noexcept { return entries.size(); }
+                void clear() noexcept { entries.clear(); }
+                void reserve(std::size_t n)
+                {
+                    const rehash_watch watch(entries, rehashes);
+                    entries.reserve(n);
+                }
+                void stats(container_stats& s) const
+                {
+                    s.add_table(entries);
+                    s.rehashes += rehashes;
+                }
+            };
+        };
+
+        //Sorted vector searched by bisection: no node allocation, cheaper to walk, slower to insert into
+        struct flat_map
+        {
+            template<typename IdPolicy, typename Slot>
+            class table
+            {
+                using key_type = typename IdPolicy::type;
+                using entry = std::pair<key_type, Slot>;
+                std::vector<entry> entries;
+
+                auto lower_bound(key_type key) const noexcept
+                {
+                    return std::lower_bound(entries.begin(), entries.end(), key, [](const entry& e, key_type k) { return e.first < k; });
+                }
+
+            public:
+                Slot* find(key_type key) noexcept
+                {
+                    auto it = lower_bound(key);
+                    return it != entries.end() && it->first == key ? const_cast<Slot*>(&it->second) : nullptr;
+                }
+                const Slot* find(key_type key) const noexcept { return const_cast<table*>(this)->find(key); }
+                template<typename T> Slot* find_type() noexcept { return find(IdPolicy::template of<T>()); }
+                template<typename T> const Slot* find_type() const noexcept { return find(IdPolicy::template of<T>()); }
+
+                Slot& emplace(key_type key, const Slot& slot)
+                {
+                    auto it = lower_bound(key);
+                    if (it != entries.end() && it->first == key)
+                        return const_cast<Slot&>(it->second);
+                    return entries.insert(it, { key, slot })->second;
+                }
+                void erase(key_type key)
+                {
+                    auto it = lower_bound(key);
+                    if (it != entries.end() && it->first == key)
+                        entries.erase(it);
+                }
+
+                template<typename F>
+                void for_each(F&& f) const
+                {
+                    for (auto& [key, slot] : entries)
+                        f(slot);
+                }
+
+                std::size_t size() const noexcept { return entries.size(); }
+                void clear() noexcept { entries.clear(); }
+                void reserve(std::size_t n) { entries.reserve(n); }
+                void stats(container_stats& s) const
+                {
+                    s.table_entries += entries.size();
+                    s.index_bytes += entries.capacity() * sizeof(entry);
+                }
+            };
+        };
+
+        //Sparse set over dense ids: an array indexed by id locating the entry in a packed array
+        struct sparse
+        {
+            template<typename IdPolicy, typename Slot>
+            class table
+            {
+                static_assert(IdPolicy::is_dense, "heco: the sparse index needs dense ids, see id::dense");
+                using key_type = typename IdPolicy::type;
+                using entry = std::pair<key_type, Slot>;
+                static constexpr std::uint32_t npos = std::uint32_t(-1);
+                std::vector<std::uint32_t> positions;
+                std::vector<entry> entries;
+
+            public:
+                Slot* find(key_type key) noexcept
+                {
+                    return key < positions.size() && positions[key] != npos ? &entries[positions[key]].second : nullptr;
+                }
+                const Slot* find(key_type key) const noexcept { return const_cast<table*>(this)->find(key); }
+                template<typename T> Slot* find_type() noexcept { return find(IdPolicy::template of<T>()); }
+                template<typename T> const Slot* find_type() const noexcept { return find(IdPolicy::template of<T>()); }
+
+                Slot& emplace(key_type key, const Slot& slot)
+                {
+                    if (key >= positions.size())
+                        positions.resize(key + 1, npos);
+                    if (positions[key] == npos) {
+                        positions[key] = std::uint32_t(entries.size());
+                        entries.push_back({ key, slot });
+                    }
+                    return entries[positions[key]].second;
+                }
+                void erase(key_type key)
+                {
+                    if (key >= positions.size() || positions[key] == npos)
+                        return;
+                    const std::uint32_t i = std::exchange(positions[key], npos);
+                    if (i + 1 != entries.size()) {
+                        entries[i] = entries.back();
+                        positions[entries[i].first] = i;
+                    }
+                    entries.pop_back();
+                }
+
+                template<typename F>
+                void for_each(F&& f) const
+                {
+                    for (auto& [key, slot] : entries)
+                        f(slot);
+                }
+
+                std::size_t size() const noexcept { return entries.size(); }
+                void clear() noexcept
+                {
+                    positions.clear();
+                    entries.clear();
+                }
+                void reserve(std::size_t n) { entries.reserve(n); }
+                void stats(container_stats& s) const
+                {
+                    s.table_entries += entries.size();
+                    s.sparse_size += positions.size();
+                    s.sparse_used += entries.size();
+                    s.index_bytes += positions.capacity() * sizeof(std::uint32_t) + entries.capacity() * sizeof(entry);
+                }
+            };
+        };
+
+        //Same sparse set with keys and slots packed in two arrays, so that walking the slots loads no key
+        struct split_sparse
+        {
+            template<typename IdPolicy, typename Slot>
+            class table
+            {
+                static_assert(IdPolicy::is_dense, "heco: the sparse index needs dense ids, see id::dense");
+                using key_type = typename IdPolicy::type;
+                static constexpr std::uint32_t npos = std::uint32_t(-1);
+                std::vector<std::uint32_t> positions;
+                std::vector<key_type> keys;
+                std::vector<Slot> slots;
+
+            public:
+                Slot* find(key_type key) noexcept
+                {
+                    return key < positions.size() && positions[key] != npos ? &slots[positions[key]] : nullptr;
+                }
+                const Slot* find(key_type key) const noexcept { return const_cast<table*>(this)->find(key); }
+                template<typename T> Slot* find_type() noexcept { return find(IdPolicy::template of<T>()); }
+                template<typename T> const Slot* find_type() const noexcept { return find(IdPolicy::template of<T>()); }
+
+                Slot& emplace(key_type key, const Slot& slot)
+                {
+                    if (key >= positions.size())
+                        positions.resize(key + 1, npos);
+                    if (positions[key] == npos) {
+                        keys.reserve(keys.size() + 1);
+                        slots.push_back(slot);
+                        keys.push_back(key);
+                        positions[key] = std::uint32_t(slots.size() - 1);
+                    }
+                    return slots[positions[key]];
+                }
+                void erase(key_type key)
+                {
+                    if (key >= positions.size() || positions[key] == npos)
+                        return;
+                    const std::uint32_t i = std::exchange(positions[key], npos);
+                    if (i + 1 != slots.size()) {
+                        slots[i] = slots.back();
+                        keys[i] = keys.back();
+                        positions[keys[i]] = i;
+                    }
+                    slots.pop_back();
+                    keys.pop_back();
+                }
+
+                template<typename F>
+                void for_each(F&& f) const
+                {
+                    for (auto& slot : slots)
+                        f(slot);
+                }
+
+                std::size_t size() const noexcept { return slots.size(); }
+                void clear() noexcept
+                {
+                    positions.clear();
+                    keys.clear();
+                    slots.clear();
+                }
+                void reserve(std::size_t n)
+                {
+                    keys.reserve(n);
+                    slots.reserve(n);
+                }
+                void stats(container_stats& s) const
+                {
+                    s.table_entries += slots.size();
+                    s.sparse_size += positions.size();
+                    s.sparse_used += slots.size();
+                    s.index_bytes += positions.capacity() * sizeof(std::uint32_t) + keys.capacity() * sizeof(key_type) + slots.capacity() * sizeof(Slot);
+                }
+            };
+        };
+
+        //Fixed set of types known at compile time: one slot per type, found without any lookup by get<T>.
+        //Inserting a type outside of the set throws std::logic_error.
+        template<typename... Ts>
+        struct fixed
+        {
+            template<typename IdPolicy, typename Slot>
+            class table
+            {
+                using key_type = typename IdPolicy::type;
+                static constexpr std::size_t npos = sizeof...(Ts);
+                Slot slots[sizeof...(Ts) + 1] = {};//< the last one stays empty, returned for types outside of the set
+                bool used[sizeof...(Ts) + 1] = {};
+                std::size_t n = 0;
+
+                template<typename T>
+                static constexpr std::size_t position()
+                {
+                    std::size_t i = 0;
+                    ((std::is_same_v<rm_cvref_t<T>, Ts> ? false : (++i, true)) && ...);
+                    return i;
+                }
+                static std::size_t position(key_type key)
+                {
+                    std::size_t i = 0;
+                    ((IdPolicy::template of<Ts>() == key ? false : (++i, true)) && ...);
+                    return i;
+                }
+
+            public:
+                Slot* find(key_type key) noexcept
+                {
+                    const std::size_t i = position(key);
+                    return used[i] ? &slots[i] : nullptr;
+                }
+                const Slot* find(key_type key) const noexcept { return const_cast<table*>(this)->find(key); }
+                template<typename T> Slot* find_type() noexcept
+                {
+                    constexpr std::size_t i = position<T>();
+                    return used[i] ? &slots[i] : nullptr;
+                }
+                template<typename T> const Slot* find_type() const noexcept { return const_cast<table*>(this)->template find_type<T>(); }
+
+                Slot& emplace(key_type key, const Slot& slot)
+                {
+                    const std::size_t i = position(key);
+                    if (i == npos)
+                        throw std::logic_error("heco: type is not part of the fixed index");
+                    if (!used[i]) {
+                        used[i] = true;
+                        slots[i] = slot;
+                        ++n;
+                    }
+                    return slots[i];
+                }
+                void erase(key_type key)
+                {
+                    const std::size_t i = position(key);
+                    if (used[i]) {
+                        used[i] = false;
+                        --n;
+                    }
+                }
+
+                template<typename F>
+                void for_each(F&& f) const
+                {
+                    for (std::size_t i = 0; i < npos; ++i)
+                        if (used[i])
+                            f(slots[i]);
+                }
+
+                std::size_t size() const noexcept { return n; }
+                void clear() noexcept
+                {
+                    std::fill(std::begin(used), std::end(used), false);
+                    n = 0;
+                }
+                void reserve(std::size_t) noexcept {}
+                void stats(container_stats& s) const
+                {
+                    s.table_entries += n;
+                    s.index_bytes += sizeof(table);
+                }
+            };
+        };
+    }
+
+    //Allocation policies: where the memory of the objects comes from
+    namespace alloc
+    {
+        //Global aligned operator new
+        struct new_delete
+        {
+            void* allocate(std::size_t size, std::size_t alignment) { return ::operator new(size, std::align_val_t(alignment)); }
+            void deallocate(void* p, std::size_t size, std::size_t alignment) noexcept { ::operator delete(p, size, std::align_val_t(alignment)); }
+        };
+
+        //Polymorphic memory resource, e.g. a std::pmr::monotonic_buffer_resource to allocate from an arena
+        struct resource
+        {
+            std::pmr::memory_resource* upstream = std::pmr::get_default_resource();
+
+            void* allocate(std::size_t size, std::size_t alignment) { return upstream->allocate(size, alignment); }
+            void deallocate(void* p, std::size_t size, std::size_t alignment) noexcept { upstream->deallocate(p, size, alignment); }
+        };
+    }
+
+    //Storage policies: how the objects are laid out in memory.
+    //A storage hands out slots, locating an object and its type operations; the container constructs and destroys the objects.
+    namespace storage
+    {
+        //One allocation per object: addresses are stable, objects are scattered
+        struct stable
+        {
+            struct slot
+            {
+                void* p;
+                const type_ops* ops;
+            };
+
+            stable() = default;
+            stable(stable&&) noexcept = default;
+            stable& operator=(stable&&) noexcept = default;
+
+            template<typename Alloc, typename Slots>
+            slot allocate(Alloc& alloc, const type_ops& ops, Slots&&)
+            {
+                return { alloc.allocate(ops.size, ops.alignment), &ops };
+            }
+            template<typename Alloc, typename Slots>
+            void reserve(Alloc&, std::size_t /*bytes*/, std::size_t /*alignment*/, Slots&&) noexcept {}
+            template<typename Alloc>
+            void deallocate(Alloc& alloc, const slot& s) noexcept { alloc.deallocate(s.p, s.ops->size, s.ops->alignment); }
+            template<typename Alloc>
+            void release(Alloc&) noexcept {}
+
+            static void* address(const slot& s) noexcept { return s.p; }
+            void stats(container_stats&) const noexcept {}
+        };
+
+        //One buffer for all objects: compact and cache friendly, objects being relocated through their type operations when it grows.
+        //Contrary to HeterogeneousArray, relocation moves the objects instead of copying their bytes, so any movable type is allowed.
+        //Objects whose move may throw are copied instead, so that a throwing copy leaves the buffer as it was.
+        //Erased objects leave dead bytes behind until clear().
+        struct contiguous
+        {
+            struct slot
+            {
+                std::size_t offset;
+                const type_ops* ops;
+            };
+
+            contiguous() = default;
+            contiguous(contiguous&& other) noexcept
+                : buffer(std::exchange(other.buffer, nullptr)), capacity(std::exchange(other.capacity, 0)), used(std::exchange(other.used, 0))
+                , alignment(std::exchange(other.alignment, 1)), padding(std::move(other.padding)), dead(std::move(other.dead)) {}
+            contiguous& operator=(contiguous&& other) noexcept
+            {
+                assert(!buffer);//< released by the container beforehand
+                buffer = std::exchange(other.buffer, nullptr);
+                capacity = std::exchange(other.capacity, 0);
+                used = std::exchange(other.used, 0);
+                alignment = std::exchange(other.alignment, 1);
+                padding = std::move(other.padding);
+                dead = std::move(other.dead);
+                return *this;
+            }
+
+            //slots(f) calls f(const slot&) for each live object, to relocate them when the buffer grows
+            template<typename Alloc, typename Slots>
+            slot allocate(Alloc& alloc, const type_ops& ops, Slots&& slots)
+            {
+                const std::size_t offset = (used + ops.alignment - 1) / ops.alignment * ops.alignment;
+                if (offset + ops.size > capacity || ops.alignment > alignment)
+                    grow(alloc, std::max(2 * capacity, offset + ops.size), std::max(alignment, ops.alignment), slots);
+                padding += offset - used;
+                used = offset + ops.size;
+                return { offset, &ops };
+            }
+            //Room for objects of the given bytes, alignment included, so that allocating them relocates nothing
+            template<typename Alloc, typename Slots>
+            void reserve(Alloc& alloc, std::size_t bytes, std::size_t max_alignment, Slots&& slots)
+            {
+                if (used + bytes > capacity || max_alignment > alignment)
+                    grow(alloc, std::max(2 * capacity, used + bytes), std::max(alignment, max_alignment), slots);
+            }
+            template<typename Alloc>
+            void deallocate(Alloc&, const slot& s) noexcept { dead += s.ops->size; }
+            template<typename Alloc>
+            void release(Alloc& alloc) noexcept
+            {
+                if (buffer)
+                    alloc.deallocate(buffer, capacity, alignment);
+                buffer = nullptr;
+                capacity = used = 0;
+                alignment = 1;
+                padding = stat_counter{};
+                dead = stat_counter{};
+            }
+
+            void* address(const slot& s) const noexcept { return buffer + s.offset; }
+            void stats(container_stats& s) const noexcept
+            {
+                s.padding_bytes += padding;
+                s.dead_bytes += dead;
+                s.spare_bytes += capacity - used;
+            }
+
+        private:
+            std::byte* buffer = nullptr;
+            std::size_t capacity = 0;
+            std::size_t used = 0;
+            std::size_t alignment = 1;
+            stat_counter padding;
+            stat_counter dead;
+
+            template<typename Alloc, typename Slots>
+            void grow(Alloc& alloc, std::size_t new_capacity, std::size_t new_alignment, Slots& slots)
+            {
+                auto* fresh = static_cast<std::byte*>(alloc.allocate(new_capacity, new_alignment));
+                std::size_t copied = 0;
+                try {
+                    slots([&](const slot& s) {
+                        if (!s.ops->nothrow_relocatable) {
+                            s.ops->copy_construct(fresh + s.offset, buffer + s.offset);
+                            ++copied;
+                        }
+                    });
+                }
+                catch (...) {
+                    slots([&](const slot& s) {
+                        if (!s.ops->nothrow_relocatable && copied > 0) {
+                            s.ops->destroy(fresh + s.offset);
+                            --copied;
+                        }
+                    });
+                    alloc.deallocate(fresh, new_capacity, new_alignment);
+                    throw;
+                }
+                slots([&](const slot& s) {
+                    if (s.ops->nothrow_relocatable)
+                        s.ops->relocate(fresh + s.offset, buffer + s.offset);
+                    else
+                        s.ops->destroy(buffer + s.offset);
+                });
+                if (buffer)
+                    alloc.deallocate(buffer, capacity, alignment);
+                buffer = fresh;
+                capacity = new_capacity;
+                alignment = new_alignment;
+            }
+        };
+    }
+
+    //Name reported by stats(), specialized by the headers whose containers are configurations of basic_container
+    template<typename Container>
+    inline constexpr const char* container_name = "basic_container";
+
+    //Observer is notified of the operations on the container, see null_observer in heco_common.h
+    template<typename StoragePolicy = storage::stable, typename IndexPolicy = index::hash_map, typename IdPolicy = id::dense, typename AllocPolicy = alloc::new_delete, typename Observer = null_observer>
+    class basic_container
+    {
+    public:
+        using storage_policy = StoragePolicy;
+        using index_policy = IndexPolicy;
+        using id_policy = IdPolicy;
+        using alloc_policy = AllocPolicy;
+        using observer_type = Observer;
+        using key_type = typename IdPolicy::type;
+        using slot = typename StoragePolicy::slot;
+        using table_type = typename IndexPolicy::template table<IdPolicy, slot>;
+
+        basic_container() = default;
+        explicit basic_container(AllocPolicy alloc) : allocator(std::move(alloc)) {}
+        basic_container(const basic_container&) = delete;
+        basic_container& operator=(const basic_container&) = delete;
+        basic_container(basic_container&& other) noexcept
+            : data(std::exchange(other.data, {})), allocator(other.allocator), storage(std::move(other.storage)) {}
+        basic_container& operator=(basic_container&& other) noexcept
+        {
+            if (this != &other) {
+                clear();
+                allocator = other.allocator;
+                storage = std::move(other.storage);
+                data = std::exchange(other.data, {});
+            }
+            return *this;
+        }
+        ~basic_container() { clear(); }
+
+        table_type data;//< index of the objects, the slots locating them in the storage
+
+        template<typename... Ts>
+        bool contains() const noexcept { return (data.template find_type<Ts>() && ...); }
+
+        std::size_t size() const noexcept { return data.size(); }
+        bool empty() const noexcept { return data.size() == 0; }
+
+        template<typename...Ts>
+        void reserve() { reserve(sizeof...(Ts)); }
+        void reserve(std::size_t n) { data.reserve(n); }
+
+        //Pointer to the object of type T, nullptr if missing
+        template<typename T, typename... Rest>
+        auto has() const noexcept -> decltype(auto)
+        {
+            using U = std::remove_reference_t<T>;
+            if constexpr (sizeof...(Rest) == 0) {
+                if (const slot* s = data.template find_type<U>())
+                    return static_cast<U*>(storage.address(*s));
+                Observer::on_get_miss(IdPolicy::template of<U>());
+                return (U*)nullptr;
+            }
+            else
+                return std::forward_as_tuple(has<T>(), has<Rest>()...);
+        }
+
+        //T must be stored, see has and contains otherwise
+        template<typename T, typename... Rest>
+        auto get() const noexcept -> decltype(auto)
+        {
+            using U = std::remove_reference_t<T>;
+            if constexpr (sizeof...(Rest) == 0) {
+                const slot* s = data.template find_type<U>();
+                assert(s);
+                return *static_cast<U*>(storage.address(*s));
+            }
+            else
+                return std::forward_as_tuple(get<T>(), get<Rest>()...);
+        }
+
+        //Like the emplace of std::map, an object already stored is left untouched.
+        //With contiguous storage, growth relocates the objects: references are valid until the next insertion.
+        template<typename T = void, typename... Args>
+        auto insert(Args&& ... args) -> decltype(auto)
+        {
+            if constexpr (std::is_same_v<T, void>)
+                static_assert(((must_be_copyable_if_lvalue<Args> || must_be_moveable_if_rvalue<Args>) && ...)
+                    , "Use in-place construction version insert<T>(Args...) instead.");
+
+            if constexpr (!std::is_same_v<T, void>)
+                return insert_1<T>(std::forward<Args>(args)...);
+            else if constexpr (sizeof...(Args) == 1)
+                return insert_1<Args...>(std::forward<Args>(args)...);
+            else
+                return insert_n(std::forward<Args>(args)...);
+        }
+
+        template<typename T, typename... Args>
+        auto insert_1(Args&&... args) -> decltype(auto)
+        {
+            using U = rm_cvref_t<T>;
+            if (const slot* s = data.template find_type<U>())
+                return *static_cast<U*>(storage.address(*s));
+            U* p = static_cast<U*>(construct(*type_ops_of<U>(), [&](void* p) { ::new(p) U{ std::forward<Args>(args)... }; }));
+            Observer::on_insert(type_id<U>());
+            Observer::on_construct(type_id<U>(), p);
+            return *p;
+        }
+
+        template<typename... Ts>
+        auto insert_n(Ts&&... values) -> decltype(auto)
+        {
+            reserve(size() + sizeof...(Ts));
+            storage.reserve(allocator, ((sizeof(rm_cvref_t<Ts>) + alignof(rm_cvref_t<Ts>) - 1) + ...), std::max({ alignof(rm_cvref_t<Ts>)... }), live_slots());
+            //braces construct in order, so that objects are laid out as listed
+            return std::tuple<decltype(insert_1<Ts>(std::forward<Ts>(values)))...>{ insert_1<Ts>(std::forward<Ts>(values))... };
+        }
+
+        template<typename T = void, typename... Args>
+        auto insert_or_assign(Args&& ... args) -> decltype(auto)
+        {
+            if constexpr (!std::is_same_v<T, void>)
+                return insert_or_assign_1<T>(std::forward<Args>(args)...);
+            else if constexpr (sizeof...(Args) == 1)
+                return insert_or_assign_1<Args...>(std::forward<Args>(args)...);
+            else
+                return std::tuple<decltype(insert_or_assign_1<Args>(std::forward<Args>(args)))...>{ insert_or_assign_1<Args>(std::forward<Args>(args))... };
+        }
+
+        template<typename T, typename... Args>
+        auto insert_or_assign_1(Args&&... args) -> decltype(auto)
+        {
+            using U = rm_cvref_t<T>;
+            if (const slot* s = data.template find_type<U>()) {
+                U* p = static_cast<U*>(storage.address(*s));
+                *p = U{ std::forward<Args>(args)... };
+                Observer::on_assign(type_id<U>(), p);
+                return *p;
+            }
+            return insert_1<T>(std::forward<Args>(args)...);
+        }
+
+        //Default construct an object of the type described by ops, for producers which only know types at runtime.
+        //Returns nullptr, constructing nothing, if the type is already stored.
+        void* emplace(const type_ops& ops)
+        {
+            if (data.find(IdPolicy::of(ops)))
+                return nullptr;
+            void* p = construct(ops, [&](void* p) { ops.default_construct(p); });
+            Observer::on_insert(ops.id);
+            Observer::on_construct(ops.id, p);
+            return p;
+        }
+
+        template<typename... Ts>
+        void erase()
+        {
+            (erase_key(IdPolicy::template of<Ts>()), ...);
+        }
+
+        //Runtime removal, e.g. to undo emplace. Returns 0 if the type was not stored.
+        std::size_t erase(type_id_t type)
+        {
+            if constexpr (IdPolicy::is_dense)
+                return erase_key(type);
+            else {
+                const type_ops* ops = nullptr;
+                data.for_each([&](const slot& s) { if (s.ops->id == type) ops = s.ops; });
+                return ops ? erase_key(IdPolicy::of(*ops)) : 0;
+            }
+        }
+
+        void clear() noexcept
+        {
+            data.for_each([&](const slot& s) {
+                Observer::on_destruct(s.ops->id, storage.address(s));
+                s.ops->destroy(storage.address(s));
+                storage.deallocate(allocator, s);
+            });
+            data.clear();
+            storage.release(allocator);
+        }
+
+        //Call f(type_id, pointer) for each stored object, type_id being the dense id whatever the id policy.
+        template<typename F>
+        void for_each(F&& f)
+        {
+            data.for_each([&](const slot& s) { f(s.ops->id, storage.address(s)); });
+        }
+
+        template<typename F>
+        void for_each(F&& f) const
+        {
+            data.for_each([&](const slot& s) { f(s.ops->id, static_cast<const void*>(storage.address(s))); });
+        }
+
+        //Call visitor(T&) for each stored object whose type T is among the candidates.
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>)
+        {
+            using handler_t = void(*)(Visitor&, void*);
+            static const jump_table<handler_t> handlers{ { type_id<Cands>(), +[](Visitor& v, void* p) { v(*static_cast<Cands*>(p)); } }... };
+            for_each([&](type_id_t tid, void* p) { if (const auto handler = handlers[tid]) handler(visitor, p); });
+        }
+
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>) const
+        {
+            using handler_t = void(*)(Visitor&, const void*);
+            static const jump_table<handler_t> handlers{ { type_id<Cands>(), +[](Visitor& v, const void* p) { v(*static_cast<const Cands*>(p)); } }... };
+            for_each([&](type_id_t tid, const void* p) { if (const auto handler = handlers[tid]) handler(visitor, p); });
+        }
+
+        //Copy of every object, with the same allocation policy
+        basic_container clone() const
+        {
+            basic_container copy(allocator);
+            copy.reserve(size());
+            data.for_each([&](const slot& s) {
+                const void* src = storage.address(s);
+                copy.construct(*s.ops, [&](void* p) { s.ops->copy_construct(p, src); });
+            });
+            return copy;
+        }
+
+        bool operator==(const basic_container& other) const
+        {
+            if (size() != other.size())
+                return false;
+            bool equal = true;
+            data.for_each([&](const slot& s) {
+                const slot* o = equal ? other.data.find(IdPolicy::of(*s.ops)) : nullptr;
+                equal = o && s.ops->equals(storage.address(s), other.storage.address(*o));
+            });
+            return equal;
+        }
+        bool operator!=(const basic_container& other) const { return !(*this == other); }
+
+        //Independent of insertion order and of the policies
+        std::size_t hash() const
+        {
+            return hash_objects([&](auto&& f) {
+                data.for_each([&](const slot& s) { f(s.ops->id, storage.address(s), *s.ops); });
+            });
+        }
+
+        container_stats stats() const
+        {
+            container_stats s;
+            s.container = container_name<basic_container>;
+            s.types.reserve(size());
+            data.for_each([&](const slot& e) { s.add_object(e.ops->id, *e.ops); });
+            data.stats(s);
+            storage.stats(s);
+            return s;
+        }
+
+    private:
+        AllocPolicy allocator;
+        StoragePolicy storage;
+
+        auto live_slots() const
+        {
+            return [this](auto&& f) { data.for_each(f); };
+        }
+
+        //Allocate a slot for ops, then construct the object with init(void*)
+        template<typename Init>
+        void* construct(const type_ops& ops, Init&& init)
+        {
+            slot s = storage.allocate(allocator, ops, live_slots());
+            void* p = storage.address(s);
+            try {
+                init(p);
+            }
+            catch (...) {
+                storage.deallocate(allocator, s);
+                throw;
+            }
+            try {
+                data.emplace(IdPolicy::of(ops), s);
+            }
+            catch (...) {
+                ops.destroy(p);
+                storage.deallocate(allocator, s);
+                throw;
+            }
+            return p;
+        }
+
+        std::size_t erase_key(key_type key)
+        {
+            const slot* s = data.find(key);
+            if (!s)
+                return 0;
+            Observer::on_destruct(s->ops->id, storage.address(*s));
+            s->ops->destroy(storage.address(*s));
+            storage.deallocate(allocator, *s);
+            data.erase(key);
+            return 1;
+        }
+
+    };
+
+    //Configurations close to HeterogeneousContainer and HeterogeneousArray, without their specific features (snapshots, relayout, ...).
+    //The sparse sets of heco_1_sparseset_stable.h are configurations of basic_container.
+    using stable_map_container = basic_container<storage::stable, index::hash_map>;
+    using stable_sparse_container = basic_container<storage::stable, index::sparse>;//< HeterogeneousContainer_SparseSet
+    using contiguous_map_container = basic_container<storage::contiguous, index::hash_map>;
+    using portable_container = basic_container<storage::stable, index::flat_map, id::stable>;//< same keys in every process
+    template<typename... Ts>
+    using fixed_container = basic_container<storage::contiguous, index::fixed<Ts...>>;
+}
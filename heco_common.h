@@ -0,0 +1,449 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <algorithm>        // for max
+#include <cstddef>          // for size_t
+#include <cstdint>          // for std::uint32_t
+#include <cstring>          // for memcpy
+#include <functional>       // for hash
+#include <initializer_list> // for initializer_list
+#include <iterator>         // for begin, end
+#include <memory>           // for destroy_at
+#include <new>              // for placement new
+#include <stdexcept>        // for logic_error
+#include <string>           // for string
+#include <type_traits>      // for remove_reference_t, remove_cv_t
+#include <utility>          // for pair, exchange
+#include <vector>
+
+namespace heco
+{
+    template<typename T>
+    using rm_cvref_t = std::remove_cv_t<std::remove_reference_t<T>>;//remove_cvref_t from C++20 only
+
+    using type_id_t = std::uint32_t;
+
+    class TypeCounter {
+        static inline type_id_t i = 0;
+    public:
+        template<typename T>
+        static inline const auto id = i++;
+    };
+    template<typename T> inline auto type_id() { return TypeCounter::id<rm_cvref_t<T>>; }
+
+    template<typename... Ts>
+    struct type_list {};
+
+    constexpr std::uint64_t fnv1a(const char* s) noexcept {
+        std::uint64_t h = 14695981039346656037ull;
+        while (*s) {
+            h ^= std::uint64_t(static_cast<unsigned char>(*s++));
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    template<typename T>
+    constexpr std::uint64_t stable_type_id_impl() noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+        return fnv1a(__FUNCSIG__);
+#else
+        return fnv1a(__PRETTY_FUNCTION__);
+#endif
+    }
+    //Identifier of a type that does not depend on the order of instantiation, contrary to type_id.
+    //It is a hash of the type name, thus stable across processes of binaries built with the same compiler.
+    template<typename T>
+    constexpr std::uint64_t stable_type_id() noexcept { return stable_type_id_impl<rm_cvref_t<T>>(); }
+
+    // Dispatch table from a runtime type id to a handler, one slot per id.
+    // Ids are dense and sequential, so a lookup is a bound check plus an indexed load.
+    template<typename Fn>
+    class jump_table
+    {
+        std::vector<Fn> handlers;
+    public:
+        jump_table(std::initializer_list<std::pair<type_id_t, Fn>> entries)
+        {
+            type_id_t n = 0;
+            for (auto& [id, fn] : entries)
+                n = std::max(n, type_id_t(id + 1));
+            handlers.resize(n, nullptr);
+            for (auto& [id, fn] : entries)
+                handlers[id] = fn;
+        }
+
+        Fn operator[](type_id_t id) const noexcept { return id < handlers.size() ? handlers[id] : nullptr; }
+    };
+
+    inline std::size_t hash_combine(std::size_t seed, std::size_t value) noexcept {
+        return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    }
+
+    template<typename T, typename = void>
+    struct is_range : std::false_type {};
+    template<typename T>
+    struct is_range<T, std::void_t<decltype(std::begin(std::declval<const T&>())), decltype(std::end(std::declval<const T&>()))>> : std::true_type {};
+
+    template<typename T>
+    struct is_std_vector : std::false_type {};
+    template<typename T, typename A>
+    struct is_std_vector<std::vector<T, A>> : std::true_type {};
+
+    template<typename T, typename = void>
+    struct has_std_hash : std::false_type {};
+    template<typename T>
+    struct has_std_hash<T, std::void_t<decltype(std::hash<T>{}(std::declval<const T&>()))>> : std::true_type {};
+
+    template<typename T, typename = void>
+    struct has_equal_to : std::false_type {};
+    template<typename T>
+    struct has_equal_to<T, std::void_t<decltype(bool(std::declval<const T&>() == std::declval<const T&>()))>> : std::true_type {};
+
+    //Ranges (e.g. std::vector) are hashable, comparable and copyable when their elements are, the usual traits decide otherwise
+    template<typename T>
+    constexpr bool is_hashable() {
+        if constexpr (has_std_hash<T>::value) return true;
+        else if constexpr (is_range<T>::value) return is_hashable<rm_cvref_t<decltype(*std::begin(std::declval<const T&>()))>>();
+        else return false;
+    }
+
+    template<typename T>
+    constexpr bool is_equality_comparable() {
+        if constexpr (is_range<T>::value) return is_equality_comparable<rm_cvref_t<decltype(*std::begin(std::declval<const T&>()))>>() && has_equal_to<T>::value;
+        else return has_equal_to<T>::value;
+    }
+
+    template<typename T>
+    constexpr bool is_copy_constructible() {
+        if constexpr (is_range<T>::value) return is_copy_constructible<rm_cvref_t<decltype(*std::begin(std::declval<const T&>()))>>() && std::is_copy_constructible_v<T>;
+        else return std::is_copy_constructible_v<T>;
+    }
+
+    //Arguments of insert(values...) are stored by copy or move, other constructions need insert<T>(args...)
+    template<typename T>
+    constexpr bool must_be_copyable_if_lvalue = std::is_lvalue_reference_v<T> && std::is_copy_constructible_v<T>;
+    template<typename T>
+    constexpr bool must_be_moveable_if_rvalue = (std::is_object_v<T> || std::is_rvalue_reference_v<T>) && std::is_move_constructible_v<T>;
+
+    //Base classes of T by which containers iterate it with for_each<Base>, recorded by specializing this trait, e.g.
+    //template<> struct heco::bases_of<Circle> { using type = heco::type_list<Shape>; };
+    template<typename T>
+    struct bases_of { using type = type_list<>; };
+
+    //p as a pointer to Base if Base is T or one of its recorded bases, else nullptr
+    template<typename T, typename... Bases>
+    void* upcast_to(T* p, type_id_t base, type_list<Bases...>) noexcept {
+        static_assert((std::is_base_of_v<Bases, T> && ...), "heco: bases_of<T> lists a class which is not a base of T");
+        if (base == type_id<T>())
+            return p;
+        void* result = nullptr;
+        (void)((base == type_id<Bases>() && (result = static_cast<Bases*>(p))) || ...);
+        return result;
+    }
+
+    template<typename T>
+    std::size_t hash_value(const T& value) {
+        if constexpr (has_std_hash<T>::value)
+            return std::hash<T>{}(value);
+        else {
+            std::size_t seed = 0;
+            for (auto&& x : value)
+                seed = hash_combine(seed, hash_value(x));
+            return seed;
+        }
+    }
+
+    //Operations of a type, stored once per type and referenced through a single pointer by each entry of a container.
+    //Operations the type does not support throw std::logic_error when called.
+    struct type_ops
+    {
+        type_id_t id;
+        std::uint64_t stable_id;
+        std::size_t size;
+        std::size_t alignment;
+        bool is_empty;
+        bool trivially_copyable;
+        bool move_constructible;
+        bool nothrow_relocatable;//< relocate cannot throw: trivially copyable or nothrow move constructible
+        void (*default_construct)(void* dst);
+        void (*copy_construct)(void* dst, const void* src);
+        void (*move_construct)(void* dst, void* src);
+        void (*relocate)(void* dst, void* src);//< move construct dst from src, then destroy src
+        void (*destroy)(void* p);
+        bool (*equals)(const void* lhs, const void* rhs);
+        std::size_t (*hash)(const void* p);
+        void* (*create)();//< heap allocated default constructed object, freed by release
+        void* (*clone)(const void* p);//< heap allocated copy, freed by release
+        void (*release)(void* p);
+        std::size_t element_size;//< for a std::vector, size of its elements, else 0
+        std::size_t element_alignment;
+        std::size_t (*count)(const void* p);//< for a std::vector, its size, else 1
+        std::size_t (*capacity)(const void* p);//< for a std::vector, its capacity, else 1
+        void* (*upcast)(void* p, type_id_t base);//< p as the class of id base, if it is the type or among its bases_of, else nullptr
+        void* (*upcast_element)(void* p, type_id_t base);//< for a non empty std::vector, its first element as upcast does, else nullptr
+    };
+
+    [[noreturn]] inline void unsupported_operation(const char* what) {
+        throw std::logic_error(std::string("heco: type is not ") + what);
+    }
+
+    template<typename T>
+    const type_ops* type_ops_of()
+    {
+        using U = rm_cvref_t<T>;
+        static const type_ops ops{
+            type_id<U>(),
+            stable_type_id<U>(),
+            sizeof(U),
+            alignof(U),
+            std::is_empty_v<U>,
+            std::is_trivially_copyable_v<U>,
+            std::is_move_constructible_v<U>,
+            std::is_trivially_copyable_v<U> || std::is_nothrow_move_constructible_v<U>,
+            +[](void* dst) {
+                if constexpr (std::is_default_constructible_v<U>) ::new(dst) U{};
+                else unsupported_operation("default constructible");
+            },
+            +[](void* dst, const void* src) {
+                if constexpr (is_copy_constructible<U>()) ::new(dst) U(*static_cast<const U*>(src));
+                else unsupported_operation("copy constructible");
+            },
+            +[](void* dst, void* src) {
+                if constexpr (std::is_move_constructible_v<U>) ::new(dst) U(std::move(*static_cast<U*>(src)));
+                else unsupported_operation("move constructible");
+            },
+            +[](void* dst, void* src) {
+                if constexpr (std::is_trivially_copyable_v<U>) std::memcpy(dst, src, sizeof(U));
+                else if constexpr (std::is_move_constructible_v<U>) {
+                    ::new(dst) U(std::move(*static_cast<U*>(src)));
+                    std::destroy_at(static_cast<U*>(src));
+                }
+                else unsupported_operation("move constructible");
+            },
+            +[](void* p) { std::destroy_at(static_cast<U*>(p)); },
+            +[](const void* lhs, const void* rhs) -> bool {
+                if constexpr (is_equality_comparable<U>()) return *static_cast<const U*>(lhs) == *static_cast<const U*>(rhs);
+                else unsupported_operation("equality comparable");
+            },
+            +[](const void* p) -> std::size_t {
+                if constexpr (is_hashable<U>()) return hash_value(*static_cast<const U*>(p));
+                else unsupported_operation("hashable");
+            },
+            +[]() -> void* {
+                if constexpr (std::is_default_constructible_v<U>) return new U{};
+                else unsupported_operation("default constructible");
+            },
+            +[](const void* p) -> void* {
+                if constexpr (is_copy_constructible<U>()) return new U(*static_cast<const U*>(p));
+                else unsupported_operation("copy constructible");
+            },
+            +[](void* p) { delete static_cast<U*>(p); },
+            [] { if constexpr (is_std_vector<U>::value) return sizeof(typename U::value_type); else return std::size_t(0); }(),
+            [] { if constexpr (is_std_vector<U>::value) return alignof(typename U::value_type); else return std::size_t(0); }(),
+            +[](const void* p) -> std::size_t {
+                if constexpr (is_std_vector<U>::value) return static_cast<const U*>(p)->size();
+                else return 1;
+            },
+            +[](const void* p) -> std::size_t {
+                if constexpr (is_std_vector<U>::value) return static_cast<const U*>(p)->capacity();
+                else return 1;
+            },
+            +[](void* p, type_id_t base) -> void* {
+                return upcast_to(static_cast<U*>(p), base, typename bases_of<U>::type{});
+            },
+            +[](void* p, type_id_t base) -> void* {
+                if constexpr (is_std_vector<U>::value && !std::is_same_v<U, std::vector<bool>>) {
+                    using E = typename U::value_type;
+                    U& v = *static_cast<U*>(p);
+                    return v.empty() ? nullptr : upcast_to(v.data(), base, typename bases_of<E>::type{});
+                }
+                else return nullptr;
+            }
+        };
+        return &ops;
+    }
+
+    //Deleter of a heap allocated object through its type operations
+    struct ops_deleter
+    {
+        const type_ops* ops = nullptr;
+        void operator()(void* p) const noexcept { ops->release(p); }
+    };
+
+    //Hash of the objects that for_each_object(f) passes to f(type id, object, operations), nullptr for an object
+    //without storage. The sum does not depend on the order of the objects; type ids, and so the result, are only
+    //meaningful within a process.
+    template<typename ForEachObject>
+    std::size_t hash_objects(ForEachObject&& for_each_object)
+    {
+        std::size_t n = 0, h = 0;
+        for_each_object([&](type_id_t tid, const void* p, const type_ops& ops) {
+            h += hash_combine(tid, p ? ops.hash(p) : 0);
+            ++n;
+        });
+        return h + n;
+    }
+
+    //Memory and layout report of one type within a container
+    struct type_stats
+    {
+        type_id_t id;
+        std::uint64_t stable_id;
+        std::size_t size;
+        std::size_t alignment;
+        std::size_t objects;//< elements for the containers of vectors, else 1
+        std::size_t bytes;
+    };
+
+    //Memory and layout report of a container, see stats() on each container.
+    //Counts are in bytes and objects; the allocator's own bookkeeping is not accounted for.
+    struct container_stats
+    {
+        const char* container = "";
+        std::size_t objects = 0;
+        std::size_t object_bytes = 0;//< sizeof of the live objects
+        std::size_t padding_bytes = 0;//< inserted between objects to align them
+        std::size_t isolation_bytes = 0;//< inserted around objects to give them their own cache lines
+        std::size_t dead_bytes = 0;//< allocated for objects which were destructed or never constructed
+        std::size_t spare_bytes = 0;//< reserved capacity not in use yet
+        std::size_t index_bytes = 0;//< estimate of the tables locating the objects
+        std::size_t buckets = 0;
+        std::size_t table_entries = 0;
+        std::size_t rehashes = 0;
+        std::size_t sparse_size = 0;//< slots of the sparse array, for sparse sets
+        std::size_t sparse_used = 0;
+        std::vector<type_stats> types;
+
+        std::size_t bytes() const noexcept { return object_bytes + padding_bytes + isolation_bytes + dead_bytes + spare_bytes + index_bytes; }
+        double load_factor() const noexcept { return buckets ? double(table_entries) / double(buckets) : 0.; }
+
+        //Accumulate the report of another container, types being merged by id
+        container_stats& operator+=(const container_stats& other)
+        {
+            objects += other.objects;
+            object_bytes += other.object_bytes;
+            padding_bytes += other.padding_bytes;
+            isolation_bytes += other.isolation_bytes;
+            dead_bytes += other.dead_bytes;
+            spare_bytes += other.spare_bytes;
+            index_bytes += other.index_bytes;
+            buckets += other.buckets;
+            table_entries += other.table_entries;
+            rehashes += other.rehashes;
+            sparse_size += other.sparse_size;
+            sparse_used += other.sparse_used;
+            for (const type_stats& t : other.types) {
+                auto it = std::find_if(types.begin(), types.end(), [&](const type_stats& u) { return u.id == t.id; });
+                if (it == types.end())
+                    types.push_back(t);
+                else {
+                    it->objects += t.objects;
+                    it->bytes += t.bytes;
+                }
+            }
+            return *this;
+        }
+
+        //Account for an internal hash table, estimating a node as a pointer plus the stored pair
+        template<typename Map>
+        void add_table(const Map& m)
+        {
+            buckets += m.bucket_count();
+            table_entries += m.size();
+            index_bytes += m.bucket_count() * sizeof(void*) + m.size() * (sizeof(void*) + sizeof(typename Map::value_type));
+        }
+
+        //Account for a heap allocated object described by its type operations
+        void add_object(type_id_t id, const type_ops& ops)
+        {
+            ++objects;
+            object_bytes += ops.size;
+            types.push_back({ id, ops.stable_id, ops.size, ops.alignment, 1, ops.size });
+        }
+
+        //Account for the elements of a heap allocated std::vector described by its type operations
+        void add_elements(type_id_t id, const type_ops& ops, const void* p)
+        {
+            const std::size_t n = ops.count(p);
+            const std::size_t bytes = n * ops.element_size;
+            objects += n;
+            object_bytes += bytes;
+            spare_bytes += (ops.capacity(p) - n) * ops.element_size;
+            index_bytes += ops.size;//< the vector itself
+            types.push_back({ id, ops.stable_id, ops.element_size, ops.element_alignment, n, bytes });
+        }
+    };
+
+    //Statistic counter which a move transfers, leaving zero behind like the moved-from containers it describes
+    struct stat_counter
+    {
+        std::size_t value = 0;
+
+        stat_counter() = default;
+        stat_counter(const stat_counter&) = default;
+        stat_counter& operator=(const stat_counter&) = default;
+        stat_counter(stat_counter&& other) noexcept : value(std::exchange(other.value, 0)) {}
+        stat_counter& operator=(stat_counter&& other) noexcept { value = std::exchange(other.value, 0); return *this; }
+
+        operator std::size_t() const noexcept { return value; }
+        stat_counter& operator+=(std::size_t n) noexcept { value += n; return *this; }
+    };
+
+    //Observer policy of the containers, notified of their operations through static hooks.
+    //Every hook of null_observer is empty, so that the default policy compiles to nothing.
+    //A custom observer derives from null_observer and hides the hooks it needs.
+    struct null_observer
+    {
+        static void on_insert(type_id_t) {}//< a type enters the container
+        static void on_construct(type_id_t, const void*) {}//< an object was constructed, nullptr for empty types
+        static void on_assign(type_id_t, const void*) {}
+        static void on_get_miss(type_id_t) {}
+        static void on_destruct(type_id_t, const void*) {}//< an object is about to be destroyed
+        static void on_grow(type_id_t /*trigger*/, std::size_t /*old_capacity*/, std::size_t /*new_capacity*/) {}//< the buffer reallocated
+        static void on_rehash(std::size_t /*old_buckets*/, std::size_t /*new_buckets*/) {}
+    };
+
+    //Whether hooks are worth walking a container for, e.g. to report destruction of every object
+    template<typename Observer>
+    constexpr bool is_observed = !std::is_same_v<Observer, null_observer>;
+
+    //Counts a rehash of the table when the bucket count changed during the lifetime of the watch
+    template<typename Map, typename Observer = null_observer>
+    struct rehash_watch
+    {
+        const Map& table;
+        stat_counter& rehashes;
+        std::size_t buckets;
+
+        rehash_watch(const Map& m, stat_counter& counter) : table(m), rehashes(counter), buckets(m.bucket_count()) {}
+        rehash_watch(const rehash_watch&) = delete;
+        rehash_watch& operator=(const rehash_watch&) = delete;
+        ~rehash_watch()
+        {
+            if (table.bucket_count() != buckets) {
+                rehashes += 1;
+                Observer::on_rehash(buckets, table.bucket_count());
+            }
+        }
+    };
+}
@@ -0,0 +1,193 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <algorithm>      // for find_if
+#include <cassert>
+#include <cstddef>        // for size_t
+#include <cstdint>        // for std::uint32_t
+#include <functional>     // for invoke
+#include <map>            // for multimap
+#include <memory>         // for unique_ptr
+#include <type_traits>    // for invoke_result_t, conditional_t
+#include <unordered_map>  // for unordered_multimap
+#include <utility>        // for move, declval
+#include <vector>
+#include "heco_common.h"
+
+namespace heco
+{
+    enum class index_kind : std::uint8_t { hash, sorted };
+
+    template<typename T, typename = void>
+    struct has_less : std::false_type {};
+    template<typename T>
+    struct has_less<T, std::void_t<decltype(bool(std::declval<const T&>() < std::declval<const T&>()))>> : std::true_type {};
+
+    //Positions of the elements of a std::vector<T> by a key projected from each of them, e.g. &Order::id.
+    //Only the keys are copied, the elements stay in the vector. Several elements may share a key.
+    //Appended elements are indexed on the next operation, other changes of the vector are told to the index.
+    template<typename T, typename Projection, index_kind Kind>
+    class vector_index
+    {
+    public:
+        using vector_type = std::vector<T>;
+        using key_type = rm_cvref_t<std::invoke_result_t<const Projection&, const T&>>;
+        static constexpr std::uint32_t npos = std::uint32_t(-1);
+
+        explicit vector_index(Projection projection) : projection(std::move(projection)) {}
+
+        //Index the elements appended since the last operation
+        void sync(const vector_type& v)
+        {
+            assert(indexed <= v.size() && "elements of an indexed type are erased through erase(handle)");
+            if constexpr (Kind == index_kind::hash)
+                entries.reserve(v.size());
+            for (; indexed < v.size(); ++indexed)
+                entries.emplace(key_of(v[indexed]), std::uint32_t(indexed));
+        }
+
+        //The element i is about to be replaced by the last one, which is then removed
+        void erase(const vector_type& v, std::size_t i)
+        {
+            sync(v);
+            entries.erase(locate(v, i));
+            if (i + 1 != v.size())
+                locate(v, v.size() - 1)->second = std::uint32_t(i);
+            --indexed;
+        }
+
+        //The key of the element i is about to change, insert(v, i) follows once it did
+        void remove(const vector_type& v, std::size_t i)
+        {
+            sync(v);
+            entries.erase(locate(v, i));
+        }
+
+        void insert(const vector_type& v, std::size_t i) { entries.emplace(key_of(v[i]), std::uint32_t(i)); }
+
+        //Index the vector anew, after changes the index was not told of
+        void rebuild(const vector_type& v)
+        {
+            entries.clear();
+            indexed = 0;
+            sync(v);
+        }
+
+        //Position of an element of the key, the first appended one for a sorted index, npos if none
+        std::uint32_t find(const key_type& key) const
+        {
+            if constexpr (Kind == index_kind::hash) {
+                const auto it = entries.find(key);
+                return it != entries.end() ? it->second : npos;
+            }
+            else {
+                const auto it = entries.lower_bound(key);
+                return it != entries.end() && !(key < it->first) ? it->second : npos;
+            }
+        }
+
+        //Approximate, nodes being counted with their links
+        std::size_t bytes() const noexcept
+        {
+            if constexpr (Kind == index_kind::hash)
+                return entries.bucket_count() * sizeof(void*) + entries.size() * (sizeof(typename map_type::value_type) + 2 * sizeof(void*));
+            else
+                return entries.size() * (sizeof(typename map_type::value_type) + 4 * sizeof(void*));
+        }
+
+    private:
+        using map_type = std::conditional_t<Kind == index_kind::hash,
+            std::unordered_multimap<key_type, std::uint32_t>, std::multimap<key_type, std::uint32_t>>;
+
+        decltype(auto) key_of(const T& x) const { return std::invoke(projection, x); }
+
+        auto locate(const vector_type& v, std::size_t i) -> typename map_type::iterator
+        {
+            auto [first, last] = entries.equal_range(key_of(v[i]));
+            const auto it = std::find_if(first, last, [&](auto& entry) { return entry.second == i; });
+            assert(it != last && "key of an indexed element changed without the index being told");
+            return it;
+        }
+
+        Projection projection;
+        map_type entries;
+        std::size_t indexed = 0;//< elements of the vector which are in entries
+    };
+
+    //Operations of an index over a std::vector, through which a container maintains it without knowing its projection
+    struct index_ops
+    {
+        type_id_t key;//< type id of the keys
+        void (*erase)(void* index, const void* vector, std::size_t i);
+        void (*remove)(void* index, const void* vector, std::size_t i);
+        void (*insert)(void* index, const void* vector, std::size_t i);
+        void (*rebuild)(void* index, const void* vector);
+        std::uint32_t (*find)(void* index, const void* vector, const void* key);//< key points to a key of the type of id key
+        std::size_t (*bytes)(const void* index);
+    };
+
+    template<typename Index>
+    const index_ops* index_ops_of()
+    {
+        using V = typename Index::vector_type;
+        static const index_ops ops{
+            type_id<typename Index::key_type>(),
+            +[](void* index, const void* v, std::size_t i) { static_cast<Index*>(index)->erase(*static_cast<const V*>(v), i); },
+            +[](void* index, const void* v, std::size_t i) { static_cast<Index*>(index)->remove(*static_cast<const V*>(v), i); },
+            +[](void* index, const void* v, std::size_t i) { static_cast<Index*>(index)->insert(*static_cast<const V*>(v), i); },
+            +[](void* index, const void* v) { static_cast<Index*>(index)->rebuild(*static_cast<const V*>(v)); },
+            +[](void* index, const void* v, const void* key) {
+                auto& self = *static_cast<Index*>(index);
+                self.sync(*static_cast<const V*>(v));
+                return self.find(*static_cast<const typename Index::key_type*>(key));
+            },
+            +[](const void* index) { return static_cast<const Index*>(index)->bytes(); }
+        };
+        return &ops;
+    }
+
+    //Index owned by a container, copied and released through the type operations of its deleter
+    struct any_index
+    {
+        std::unique_ptr<void, ops_deleter> index;
+        const index_ops* ops = nullptr;
+    };
+
+    //Index of the given kind over a std::vector<T>, which indexes its elements on its first operation. Throws std::logic_error if the keys do not support the kind.
+    template<typename T, typename Projection>
+    any_index make_index(Projection projection, index_kind kind)
+    {
+        using key_type = typename vector_index<T, Projection, index_kind::hash>::key_type;
+        if (kind == index_kind::hash) {
+            if constexpr (has_std_hash<key_type>::value && has_equal_to<key_type>::value) {
+                using I = vector_index<T, Projection, index_kind::hash>;
+                return { { new I(std::move(projection)), { type_ops_of<I>() } }, index_ops_of<I>() };
+            }
+            else unsupported_operation("hashable");
+        }
+        if constexpr (has_less<key_type>::value) {
+            using I = vector_index<T, Projection, index_kind::sorted>;
+            return { { new I(std::move(projection)), { type_ops_of<I>() } }, index_ops_of<I>() };
+        }
+        else unsupported_operation("less than comparable");
+    }
+}
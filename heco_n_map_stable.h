@@ -19,33 +19,115 @@
 // LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
-#include <cstddef>        // for size_t
+#include <algorithm>      // for min
+#include <cassert>
+#include <cstddef>        // for size_t, ptrdiff_t
 #include <cstdint>        // for std::uint32_t
+#include <iterator>       // for random_access_iterator_tag, make_move_iterator, data, size
 #include <memory>         // for unique_ptr
-#include <tuple>          // for forward_as_tuple
+#include <stdexcept>      // for out_of_range, logic_error, domain_error
+#include <tuple>          // for forward_as_tuple, apply
 #include <type_traits>    // for remove_reference_t, remove_cv_t
 #include <unordered_map>  // for unordered_map
 #include <utility>        // for forward
 #include <vector>
+#include "heco_common.h"
+#include "heco_index.h"
+#include "heco_simd.h"
+#include "heco_soa.h"
+#include "heco_thread_pool.h"
 
 namespace heco
 {
-    struct HeterogeneousContainer_n
+    //Columns of several types zipped by index, over the length of the shortest one.
+    //Columns are located once at construction; dereferencing yields a std::tuple<Ts&...>, usable with structured bindings.
+    //Random access, so that a view is split in chunks with subview() or with iterator arithmetic.
+    template<typename... Ts>
+    class zip_view
     {
-    private:
-        template<typename T>
-        using rm_cvref_t = std::remove_cv_t<std::remove_reference_t<T>>;//remove_cvref_t from C++20 only
-
-        using type_id_t = std::uint32_t;
+    public:
+        using reference = std::tuple<Ts&...>;
 
-        class TypeCounter {
-            static inline type_id_t i = 0;
+        class iterator
+        {
         public:
-            template<typename T>
-            static inline const auto id = i++;
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = std::tuple<std::remove_cv_t<Ts>...>;
+            using difference_type = std::ptrdiff_t;
+            using reference = std::tuple<Ts&...>;
+            using pointer = void;
+
+            iterator() = default;
+            iterator(std::tuple<Ts*...> columns, std::size_t i) noexcept : columns(columns), i(i) {}
+
+            reference operator*() const noexcept { return (*this)[0]; }
+            reference operator[](difference_type n) const noexcept
+            {
+                return std::apply([&](Ts*... p) { return reference{ p[i + n]... }; }, columns);
+            }
+
+            iterator& operator++() noexcept { ++i; return *this; }
+            iterator operator++(int) noexcept { iterator it = *this; ++i; return it; }
+            iterator& operator--() noexcept { --i; return *this; }
+            iterator operator--(int) noexcept { iterator it = *this; --i; return it; }
+            iterator& operator+=(difference_type n) noexcept { i += n; return *this; }
+            iterator& operator-=(difference_type n) noexcept { i -= n; return *this; }
+            friend iterator operator+(iterator it, difference_type n) noexcept { return it += n; }
+            friend iterator operator+(difference_type n, iterator it) noexcept { return it += n; }
+            friend iterator operator-(iterator it, difference_type n) noexcept { return it -= n; }
+            friend difference_type operator-(const iterator& a, const iterator& b) noexcept { return difference_type(a.i) - difference_type(b.i); }
+
+            friend bool operator==(const iterator& a, const iterator& b) noexcept { return a.i == b.i; }
+            friend bool operator!=(const iterator& a, const iterator& b) noexcept { return a.i != b.i; }
+            friend bool operator<(const iterator& a, const iterator& b) noexcept { return a.i < b.i; }
+            friend bool operator>(const iterator& a, const iterator& b) noexcept { return a.i > b.i; }
+            friend bool operator<=(const iterator& a, const iterator& b) noexcept { return a.i <= b.i; }
+            friend bool operator>=(const iterator& a, const iterator& b) noexcept { return a.i >= b.i; }
+
+        private:
+            std::tuple<Ts*...> columns;
+            std::size_t i = 0;
         };
-        template<typename T> inline auto type_id() { return TypeCounter::id<rm_cvref_t<T>>; }
 
+        zip_view(std::tuple<Ts*...> columns, std::size_t first, std::size_t last) noexcept : columns(columns), first(first), last(last) {}
+
+        iterator begin() const noexcept { return { columns, first }; }
+        iterator end() const noexcept { return { columns, last }; }
+        std::size_t size() const noexcept { return last - first; }
+        bool empty() const noexcept { return first == last; }
+        reference operator[](std::size_t i) const noexcept { return begin()[i]; }
+
+        //Elements [from, to) of this view
+        zip_view subview(std::size_t from, std::size_t to) const noexcept
+        {
+            assert(from <= to && to <= size());
+            return { columns, first + from, first + to };
+        }
+
+    private:
+        std::tuple<Ts*...> columns;
+        std::size_t first;
+        std::size_t last;
+    };
+
+    //Reference to an element of a HeterogeneousContainer_n which survives erasures and reallocations, see insert_handle.
+    //Once its element is erased the handle is stale, and detected as such even when its slot was reused.
+    template<typename T>
+    struct handle
+    {
+        std::uint32_t slot = std::uint32_t(-1);
+        std::uint32_t generation = 0;
+
+        bool operator==(const handle& other) const noexcept { return slot == other.slot && generation == other.generation; }
+        bool operator!=(const handle& other) const noexcept { return !(*this == other); }
+    };
+
+    //Observer is notified of the operations on the container, see null_observer in heco_common.h.
+    //Objects seen by the observer are the vectors.
+    template<typename Observer = null_observer>
+    struct BasicHeterogeneousContainer_n
+    {
+    private:
         template<typename T>
         struct is_vector : public std::false_type {};
         template<typename... Args>
@@ -53,49 +135,659 @@ namespace heco
         template<typename T>
         constexpr static inline bool is_vector_v = is_vector<T>::value;
 
+        template<typename T, typename Range, typename = void>
+        struct is_contiguous_of : std::false_type {};
+        template<typename T, typename Range>
+        struct is_contiguous_of<T, Range, std::void_t<decltype(std::data(std::declval<Range&>())), decltype(std::size(std::declval<Range&>()))>>
+            : std::is_same<rm_cvref_t<decltype(*std::data(std::declval<Range&>()))>, T> {};
+
+        //Slot map of a type: slots indirect handles to positions in the vector, owners map positions back to slots.
+        //Free slots are chained through their position field.
+        struct slot_index
+        {
+            struct slot { std::uint32_t position; std::uint32_t generation; };
+            static constexpr std::uint32_t npos = std::uint32_t(-1);
+            std::vector<slot> slots;
+            std::vector<std::uint32_t> owners;
+            std::uint32_t free = npos;
+
+            //Give a slot to the elements appended without handles
+            void sync(std::size_t n)
+            {
+                assert(owners.size() <= n && "elements of a type with handles are erased through erase(handle)");
+                while (owners.size() < n) {
+                    const auto position = std::uint32_t(owners.size());
+                    std::uint32_t s = free;
+                    if (s != npos) {
+                        free = slots[s].position;
+                        slots[s].position = position;
+                    }
+                    else {
+                        s = std::uint32_t(slots.size());
+                        slots.push_back({ position, 0 });
+                    }
+                    owners.push_back(s);
+                }
+            }
+
+            std::uint32_t position(std::uint32_t s, std::uint32_t generation) const noexcept
+            {
+                return s < slots.size() && slots[s].generation == generation ? slots[s].position : npos;
+            }
+
+            //Swap the last element into position i, then free the slot of i
+            void erase(std::uint32_t i)
+            {
+                const std::uint32_t s = owners[i];
+                owners[i] = owners.back();
+                slots[owners[i]].position = i;
+                owners.pop_back();
+                ++slots[s].generation;
+                slots[s].position = free;
+                free = s;
+            }
+
+            std::size_t bytes() const noexcept { return slots.capacity() * sizeof(slot) + owners.capacity() * sizeof(std::uint32_t); }
+        };
+
+        //Entries are keyed by the id of the stored std::vector<T>, the same id as the one of their type_ops
+        template<typename T>
+        static type_id_t key() { return type_id<std::vector<rm_cvref_t<T>>>(); }
+
     public:
-        HeterogeneousContainer_n() = default;
-        HeterogeneousContainer_n(const HeterogeneousContainer_n&) = delete;
-        HeterogeneousContainer_n& operator=(const HeterogeneousContainer_n&) = delete;
-        HeterogeneousContainer_n(HeterogeneousContainer_n&&) = default;
-        HeterogeneousContainer_n& operator=(HeterogeneousContainer_n&&) = default;
-        ~HeterogeneousContainer_n() = default;
-
-        using ptr_dtor = std::unique_ptr<void, void(*)(void*)>;
+        BasicHeterogeneousContainer_n() = default;
+        BasicHeterogeneousContainer_n(const BasicHeterogeneousContainer_n&) = delete;
+        BasicHeterogeneousContainer_n& operator=(const BasicHeterogeneousContainer_n&) = delete;
+        BasicHeterogeneousContainer_n(BasicHeterogeneousContainer_n&&) = default;
+        BasicHeterogeneousContainer_n& operator=(BasicHeterogeneousContainer_n&&) = default;
+        ~BasicHeterogeneousContainer_n()
+        {
+            if constexpr (is_observed<Observer>)
+                for (auto& [tid, ptr] : data)
+                    Observer::on_destruct(tid, ptr.get());
+        }
+
+        using observer_type = Observer;
+
+        using ptr_dtor = std::unique_ptr<void, ops_deleter>;
         std::unordered_map<type_id_t, ptr_dtor> data;
+        std::unordered_map<type_id_t, slot_index> handles;//< of the types used with handles
+        std::unordered_map<type_id_t, any_index> indexes;//< of the types with a secondary index
+        stat_counter rehashes;
 
         template<typename T>
-        auto vector() noexcept -> std::vector<T>& {
-            return *static_cast<std::vector<T>*>(data.at(type_id<T>()).get());
+        auto vector() -> std::vector<T>& {
+            return *static_cast<std::vector<T>*>(checked_get(key<T>()));
         }
 
         template<typename T>
-        auto vector(std::size_t i) noexcept -> T& {
-            return (*static_cast<std::vector<T>*>(data.at(type_id<T>()).get()))[i];
+        auto vector(std::size_t i) -> T& {
+            return (*static_cast<std::vector<T>*>(checked_get(key<T>())))[i];
         }
 
-        template<typename Arg, typename... Args, typename = std::enable_if_t<!is_vector_v<Arg>>>
+        //Elements of the vectors of Ts zipped by index, up to the shortest vector. Throws std::out_of_range if a type is missing.
+        //The view is invalidated by insertions into its vectors.
+        template<typename... Ts>
+        auto view() -> zip_view<Ts...>
+        {
+            static_assert(sizeof...(Ts) > 0);
+            std::tuple<std::vector<rm_cvref_t<Ts>>*...> vectors{ static_cast<std::vector<rm_cvref_t<Ts>>*>(checked_get(key<Ts>()))... };
+            const std::size_t n = std::apply([](auto*... v) { return std::min({ v->size()... }); }, vectors);
+            return { std::apply([](auto*... v) { return std::tuple<Ts*...>{ v->data()... }; }, vectors), 0, n };
+        }
+
+        template<typename... Ts>
+        auto view() const -> zip_view<const Ts...>
+        {
+            return const_cast<BasicHeterogeneousContainer_n*>(this)->template view<const Ts...>();
+        }
+
+        //Append the values to the vector of their type, created if missing. Returns whether it was created.
+        template<typename Arg, typename... Args, typename = std::enable_if_t<!is_vector_v<rm_cvref_t<Arg>>>>
         bool insert(Arg&& arg, Args&&... args) {
-            static_assert((std::is_same_v<Arg, Args> && ...));
-            auto&& [it, b] = data.emplace(
-                type_id<Arg>()
-                , ptr_dtor(new std::vector{ std::forward<Arg>(arg),std::forward<Args>(args)... },
-                    [](void* instance) { delete static_cast<std::vector<Arg>*>(instance); }));
-            return b;
+            using T = rm_cvref_t<Arg>;
+            static_assert((std::is_same_v<T, rm_cvref_t<Args>> && ...));
+            auto&& [v, created] = find_or_create<T>();
+            v.reserve(v.size() + 1 + sizeof...(Args));
+            v.push_back(std::forward<Arg>(arg));
+            (v.push_back(std::forward<Args>(args)), ...);
+            return created;
         }
 
+        //Append the elements of the vectors to the vector of their type, created if missing. Returns whether it was created.
         template<typename Arg, typename... Args>
         bool insert(const std::vector<Arg>& arg, const std::vector<Args>&... args) {
             static_assert((std::is_same_v<Arg, Args> && ...));
-            std::vector<Arg> tmp(arg);
-            auto&& [it, b] = data.emplace(
-                type_id<Arg>()
-                , ptr_dtor(new std::vector(arg),
-                    [](void* instance) { delete static_cast<std::vector<Arg>*>(instance); }));
-            auto&& v = it->second;
-            (v.insert(v.end(), args.begin(), args.end()), ...);
-            return b;
+            auto&& [v, created] = find_or_create<Arg>();
+            v.reserve(v.size() + arg.size() + (args.size() + ... + 0));
+            append_to(v, arg.data(), arg.data() + arg.size());
+            (append_to(v, args.data(), args.data() + args.size()), ...);
+            return created;
+        }
+
+        //Adopt the buffer of the vector when its type is missing or empty, else move its elements at the end
+        template<typename Arg>
+        bool insert(std::vector<Arg>&& arg) {
+            auto&& [v, created] = find_or_create<Arg>();
+            if (v.empty())
+                v = std::move(arg);
+            else
+                append_to(v, std::make_move_iterator(arg.begin()), std::make_move_iterator(arg.end()));
+            return created;
+        }
+
+        //Append the elements of a range, moved from when it is an rvalue, with a single reservation when its size is known.
+        //Contiguous ranges of trivially copyable elements are copied as a block.
+        template<typename T, typename Range>
+        std::vector<T>& append(Range&& range) {
+            using std::begin;
+            using std::end;
+            if constexpr (std::is_same_v<Range, std::vector<T>>) {
+                insert(std::move(range));
+                return vector<T>();
+            }
+            else if constexpr (std::is_trivially_copyable_v<T> && is_contiguous_of<T, Range>::value) {
+                std::vector<T>& v = find_or_create<T>().first;
+                append_to(v, std::data(range), std::data(range) + std::size(range));
+                return v;
+            }
+            else if constexpr (std::is_lvalue_reference_v<Range>)
+                return append<T>(begin(range), end(range));
+            else
+                return append<T>(std::make_move_iterator(begin(range)), std::make_move_iterator(end(range)));
+        }
+
+        template<typename T, typename It>
+        std::vector<T>& append(It first, It last) {
+            std::vector<T>& v = find_or_create<T>().first;
+            append_to(v, first, last);
+            return v;
+        }
+
+        //Construct an element at the end of the vector of T, created if missing
+        template<typename T, typename... Args>
+        T& emplace_back(Args&&... args) {
+            std::vector<T>& v = find_or_create<T>().first;
+            if constexpr (std::is_constructible_v<T, Args...>)
+                return v.emplace_back(std::forward<Args>(args)...);
+            else
+                return v.emplace_back(T{ std::forward<Args>(args)... });
+        }
+
+        //Handles of this container are valid in the copy
+        BasicHeterogeneousContainer_n clone() const
+        {
+            BasicHeterogeneousContainer_n copy;
+            copy.data.reserve(data.size());
+            for (auto& [tid, ptr] : data) {
+                const type_ops* ops = ptr.get_deleter().ops;
+                ptr_dtor instance{ ops->clone(ptr.get()), { ops } };
+                copy.data.emplace(tid, std::move(instance));
+            }
+            copy.handles = handles;
+            for (auto& [tid, ix] : indexes) {
+                const type_ops* ops = ix.index.get_deleter().ops;
+                copy.indexes.emplace(tid, any_index{ { ops->clone(ix.index.get()), { ops } }, ix.ops });
+            }
+            return copy;
+        }
+
+        bool operator==(const BasicHeterogeneousContainer_n& other) const
+        {
+            if (data.size() != other.data.size())
+                return false;
+            for (auto& [tid, ptr] : data) {
+                auto it = other.data.find(tid);
+                if (it == other.data.cend() || !ptr.get_deleter().ops->equals(ptr.get(), it->second.get()))
+                    return false;
+            }
+            return true;
+        }
+        bool operator!=(const BasicHeterogeneousContainer_n& other) const { return !(*this == other); }
+
+        //Hashes each vector as a whole, elements in order; handles and indexes are left out, as by ==
+        std::size_t hash() const
+        {
+            return hash_objects([&](auto&& f) {
+                for (auto& [tid, ptr] : data)
+                    f(tid, ptr.get(), *ptr.get_deleter().ops);
+            });
+        }
+
+        //Memory report, objects being the elements of the vectors
+        container_stats stats() const
+        {
+            container_stats s;
+            s.container = "HeterogeneousContainer_n";
+            s.types.reserve(data.size());
+            for (auto& [tid, ptr] : data)
+                s.add_elements(tid, *ptr.get_deleter().ops, ptr.get());
+            s.add_table(data);
+            for (auto& [tid, index] : handles)
+                s.index_bytes += index.bytes();
+            for (auto& [tid, ix] : indexes)
+                s.index_bytes += ix.ops->bytes(ix.index.get());
+            s.rehashes = rehashes;
+            return s;
+        }
+
+        //Default construct an object of the type described by ops, for producers which only know types at runtime.
+        //Objects are the vectors, so ops must describe a std::vector<T>.
+        //Returns nullptr, constructing nothing, if the vector is already stored.
+        void* emplace(const type_ops& ops)
+        {
+            if (data.count(ops.id))
+                return nullptr;
+            ptr_dtor instance{ ops.create(), { &ops } };
+            const auto watch = watch_rehash(data);
+            auto it = data.emplace(ops.id, std::move(instance)).first;
+            Observer::on_insert(ops.id);
+            Observer::on_construct(ops.id, it->second.get());
+            return it->second.get();
+        }
+
+        //Runtime removal of a vector, e.g. to undo emplace, with the handles and index of its elements.
+        //The key is the type id of the vector, as in emplace. Returns 0 if there was none.
+        std::size_t erase(type_id_t type)
+        {
+            const auto it = data.find(type);
+            if (it == data.end())
+                return 0;
+            Observer::on_destruct(type, it->second.get());
+            handles.erase(type);
+            indexes.erase(type);
+            data.erase(it);
+            return 1;
+        }
+
+        //Kernels of heco_simd.h over the vector of an arithmetic type T, which throw std::out_of_range if it is missing.
+        //min and max throw std::domain_error if the vector is empty.
+        template<typename T>
+        T sum() const { return simd::sum(column_of<T>()); }
+
+        template<typename T>
+        T min() const { return simd::min(non_empty_column_of<T>()); }
+
+        template<typename T>
+        T max() const { return simd::max(non_empty_column_of<T>()); }
+
+        //Over the elements both vectors have
+        template<typename T, typename U>
+        auto dot() const {
+            const std::vector<T>& a = column_of<T>();
+            const std::vector<U>& b = column_of<U>();
+            return simd::dot(a.data(), b.data(), std::min(a.size(), b.size()));
+        }
+
+        template<typename T, typename Pred>
+        std::size_t count_if(Pred&& pred) const { return simd::count_if(column_of<T>(), std::forward<Pred>(pred)); }
+
+        //Replace each element x of the vector of T by f(x)
+        template<typename T, typename F>
+        void transform(F&& f) { simd::transform(vector<T>(), std::forward<F>(f)); }
+
+        //Columns of the aggregate T, stored by insert_soa as one vector per member listed by soa_members<T>.
+        //Throws std::out_of_range if missing. Independent of vector<T>(), which stores T as a whole.
+        template<typename T>
+        auto soa() -> soa_vector<T>& {
+            return *static_cast<soa_vector<T>*>(checked_get(type_id<soa_vector<T>>()));
+        }
+
+        template<typename T>
+        auto soa() const -> const soa_vector<T>& {
+            return *static_cast<const soa_vector<T>*>(checked_get(type_id<soa_vector<T>>()));
+        }
+
+        //Append the values to the columns of their type, created if missing. Returns whether they were created.
+        template<typename Arg, typename... Args>
+        bool insert_soa(Arg&& arg, Args&&... args) {
+            using T = rm_cvref_t<Arg>;
+            static_assert((std::is_same_v<T, rm_cvref_t<Args>> && ...));
+            auto&& [v, created] = find_or_create_as<soa_vector<T>>();
+            v.reserve(v.size() + 1 + sizeof...(Args));
+            v.push_back(std::forward<Arg>(arg));
+            (v.push_back(std::forward<Args>(args)), ...);
+            return created;
         }
 
+        //Column of a member of an aggregate stored by insert_soa, e.g. column<&Point3::x>()
+        template<auto Member>
+        auto column() {
+            return soa<typename member_pointer_traits<decltype(Member)>::class_type>().template column<Member>();
+        }
+
+        template<auto Member>
+        auto column() const {
+            return soa<typename member_pointer_traits<decltype(Member)>::class_type>().template column<Member>();
+        }
+
+        //Append an element and return a handle to it, turning the vector of T into a slot map:
+        //it stays dense for iteration, and its elements are erased by swapping in the last one.
+        template<typename T, typename... Args>
+        handle<T> insert_handle(Args&&... args)
+        {
+            emplace_back<T>(std::forward<Args>(args)...);
+            return handle_of<T>(vector<T>().size() - 1);
+        }
+
+        //Handle of the element at position i of the vector of T
+        template<typename T>
+        handle<T> handle_of(std::size_t i)
+        {
+            const std::vector<T>& v = vector<T>();
+            assert(i < v.size());
+            slot_index& index = handles[key<T>()];
+            index.sync(v.size());
+            const std::uint32_t s = index.owners[i];
+            return { s, index.slots[s].generation };
+        }
+
+        //Element of the handle, nullptr when stale
+        template<typename T>
+        T* has(handle<T> h) noexcept
+        {
+            auto it = handles.find(key<T>());
+            if (it == handles.end())
+                return nullptr;
+            const std::uint32_t i = it->second.position(h.slot, h.generation);
+            return i != slot_index::npos ? static_cast<std::vector<T>*>(data.find(key<T>())->second.get())->data() + i : nullptr;
+        }
+
+        template<typename T>
+        const T* has(handle<T> h) const noexcept { return const_cast<BasicHeterogeneousContainer_n*>(this)->has(h); }
+
+        template<typename T>
+        T& get(handle<T> h)
+        {
+            if (T* p = has(h))
+                return *p;
+            throw std::out_of_range("heco: stale handle");
+        }
+
+        template<typename T>
+        const T& get(handle<T> h) const { return const_cast<BasicHeterogeneousContainer_n*>(this)->get(h); }
+
+        template<typename T>
+        bool valid(handle<T> h) const noexcept { return has(h) != nullptr; }
+
+        //Erase the element of the handle in O(1), moving the last element of the vector into its position.
+        //Other handles stay valid; returns false if the handle was stale.
+        template<typename T>
+        bool erase(handle<T> h)
+        {
+            auto it = handles.find(key<T>());
+            if (it == handles.end())
+                return false;
+            slot_index& index = it->second;
+            const std::uint32_t i = index.position(h.slot, h.generation);
+            if (i == slot_index::npos)
+                return false;
+            std::vector<T>& v = vector<T>();
+            index.sync(v.size());
+            if (auto ix = indexes.find(key<T>()); ix != indexes.end())
+                ix->second.ops->erase(ix->second.index.get(), &v, i);
+            if (i + 1 != v.size())
+                v[i] = std::move(v.back());
+            v.pop_back();
+            index.erase(i);
+            return true;
+        }
+
+        //Call f(T&) on the element of the handle, whose key may change, keeping the index of T up to date.
+        //Throws std::out_of_range if the handle is stale.
+        template<typename T, typename F>
+        void modify(handle<T> h, F&& f)
+        {
+            T& x = get(h);
+            auto ix = indexes.find(key<T>());
+            if (ix == indexes.end()) {
+                f(x);
+                return;
+            }
+            const std::vector<T>& v = vector<T>();
+            const std::size_t i = std::size_t(&x - v.data());
+            ix->second.ops->remove(ix->second.index.get(), &v, i);
+            try {
+                f(x);
+            }
+            catch (...) {
+                ix->second.ops->insert(ix->second.index.get(), &v, i);
+                throw;
+            }
+            ix->second.ops->insert(ix->second.index.get(), &v, i);
+        }
+
+        //Index the vector of T, created if missing, by the key projected from its elements by a callable or a pointer to member,
+        //replacing its previous index. Appends, erase(handle) and modify keep it up to date, other changes of keys need reindex<T>().
+        //Throws std::logic_error if the keys are not hashable, or not ordered by operator< for a sorted index.
+        template<typename T, typename Projection>
+        void index(Projection projection, index_kind kind = index_kind::hash)
+        {
+            find_or_create<T>();
+            indexes.insert_or_assign(key<T>(), make_index<T>(std::move(projection), kind));
+        }
+
+        template<typename T>
+        void reindex()
+        {
+            any_index& ix = index_of<T>();
+            ix.ops->rebuild(ix.index.get(), &vector<T>());
+        }
+
+        template<typename T>
+        bool is_indexed() const { return indexes.count(key<T>()); }
+
+        //Element of the vector of T whose key is equal to k, nullptr if none; the first appended one with a sorted index.
+        //Throws std::out_of_range if T has no index, std::logic_error if K is not the type of the keys, e.g. find<Order, std::uint64_t>(42).
+        template<typename T, typename K>
+        T* find(const K& k)
+        {
+            any_index& ix = index_of<T>();
+            if (type_id<K>() != ix.ops->key)
+                throw std::logic_error("heco: key is not of the type of the index");
+            std::vector<T>& v = vector<T>();
+            const std::uint32_t i = ix.ops->find(ix.index.get(), &v, &k);
+            return i != std::uint32_t(-1) ? v.data() + i : nullptr;
+        }
+
+        template<typename T, typename K>
+        const T* find(const K& k) const { return const_cast<BasicHeterogeneousContainer_n*>(this)->template find<T>(k); }
+
+        //Call f(type_id of std::vector<T>, pointer to std::vector<T>) for each stored type.
+        template<typename F>
+        void for_each(F&& f)
+        {
+            for (auto& [tid, ptr] : data)
+                f(tid, ptr.get());
+        }
+
+        template<typename F>
+        void for_each(F&& f) const
+        {
+            for (auto& [tid, ptr] : data)
+                f(tid, static_cast<const void*>(ptr.get()));
+        }
+
+        //Call f(Base&) for each element of each vector whose type is Base or records Base in bases_of, see heco_common.h.
+        //Vectors are walked one after the other, so that calls of virtual functions of Base stay predictable within a vector.
+        template<typename Base, typename F>
+        void for_each(F&& f)
+        {
+            for_each<Base>(std::forward<F>(f), type_list<>{});
+        }
+
+        //Like for_each<Base>(f), but the elements of the listed types are passed as Ds& to f, which calls their functions directly
+        template<typename Base, typename F, typename... Ds>
+        void for_each(F&& f, type_list<Ds...>)
+        {
+            static_assert((std::is_base_of_v<Base, Ds> && ...));
+            const type_id_t base = type_id<Base>();
+            const type_id_t listed[] = { key<Ds>()..., type_id_t(-1) };
+            for (auto& [tid, ptr] : data) {
+                if (std::find(std::begin(listed), std::end(listed), tid) != std::end(listed))
+                    continue;
+                const type_ops* ops = ptr.get_deleter().ops;
+                auto* first = static_cast<std::byte*>(ops->upcast_element(ptr.get(), base));
+                if (!first)
+                    continue;
+                const std::size_t n = ops->count(ptr.get());
+                for (std::size_t i = 0; i < n; ++i)
+                    f(*reinterpret_cast<Base*>(first + i * ops->element_size));
+            }
+            if constexpr (sizeof...(Ds) > 0) {
+                auto walk = [&](auto* tag) {
+                    using D = std::remove_pointer_t<decltype(tag)>;
+                    if (auto it = data.find(key<D>()); it != data.end())
+                        for (D& x : *static_cast<std::vector<D>*>(it->second.get()))
+                            f(x);
+                };
+                (walk(static_cast<Ds*>(nullptr)), ...);
+            }
+        }
+
+        template<typename Base, typename F>
+        void for_each(F&& f) const
+        {
+            const_cast<BasicHeterogeneousContainer_n*>(this)->template for_each<Base>([&](Base& x) { f(static_cast<const Base&>(x)); });
+        }
+
+        template<typename Base, typename F, typename... Ds>
+        void for_each(F&& f, type_list<Ds...> types) const
+        {
+            const_cast<BasicHeterogeneousContainer_n*>(this)->template for_each<Base>([&](auto& x) { f(std::as_const(x)); }, types);
+        }
+
+        //Call visitor(T&) for each element of each vector whose type T is among the candidates.
+        //The type is resolved once per vector, elements are then walked contiguously.
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>)
+        {
+            using handler_t = void(*)(Visitor&, void*);
+            static const jump_table<handler_t> table{ { key<Cands>(), +[](Visitor& v, void* p) {
+                for (auto& x : *static_cast<std::vector<rm_cvref_t<Cands>>*>(p))
+                    v(static_cast<Cands&>(x));
+            } }... };
+            for_each([&](type_id_t tid, void* p) { if (const auto handler = table[tid]) handler(visitor, p); });
+        }
+
+        template<typename Visitor, typename... Cands>
+        void visit(Visitor&& visitor, type_list<Cands...>) const
+        {
+            using handler_t = void(*)(Visitor&, const void*);
+            static const jump_table<handler_t> table{ { key<Cands>(), +[](Visitor& v, const void* p) {
+                for (auto& x : *static_cast<const std::vector<rm_cvref_t<Cands>>*>(p))
+                    v(static_cast<const Cands&>(x));
+            } }... };
+            for_each([&](type_id_t tid, const void* p) { if (const auto handler = table[tid]) handler(visitor, p); });
+        }
+
+        //Call f(T&) for each element of the vector of T, on chunks of whole cache lines run by several threads.
+        //f must be safe to call concurrently on different elements. Throws std::out_of_range if the type is missing.
+        template<typename T, typename F>
+        void parallel_for_each(F&& f, const parallel_options& options = {})
+        {
+            std::vector<T>& v = vector<T>();
+            const auto chunks = parallel_chunks(v.data(), v.size(), sizeof(T), options, pool_size(options));
+            parallel_run(chunks.size(), [&](std::size_t c) {
+                for (std::size_t i = chunks[c].first; i < chunks[c].second; ++i)
+                    f(v[i]);
+            }, options);
+        }
+
+        //Call visitor(T&) for each element of each vector whose type T is among the candidates, like visit.
+        //Chunks of all the vectors are run as a single batch, so that different types are processed concurrently.
+        template<typename Visitor, typename... Cands>
+        void parallel_for_each_type(Visitor&& visitor, type_list<Cands...>, const parallel_options& options = {})
+        {
+            struct task
+            {
+                void (*run)(Visitor&, void*, std::size_t, std::size_t);
+                void* vector;
+                std::size_t first;
+                std::size_t last;
+            };
+            std::vector<task> tasks;
+            const std::size_t threads = pool_size(options);
+            auto add_tasks = [&](auto* tag) {
+                using C = std::remove_pointer_t<decltype(tag)>;
+                using U = rm_cvref_t<C>;
+                auto it = data.find(key<U>());
+                if (it == data.end())
+                    return;
+                auto& v = *static_cast<std::vector<U>*>(it->second.get());
+                for (auto [first, last] : parallel_chunks(v.data(), v.size(), sizeof(U), options, threads))
+                    tasks.push_back({ +[](Visitor& visitor, void* p, std::size_t first, std::size_t last) {
+                        auto& elements = *static_cast<std::vector<U>*>(p);
+                        for (std::size_t i = first; i < last; ++i)
+                            visitor(static_cast<C&>(elements[i]));
+                    }, &v, first, last });
+            };
+            (add_tasks(static_cast<Cands*>(nullptr)), ...);
+            parallel_run(tasks.size(), [&](std::size_t i) { tasks[i].run(visitor, tasks[i].vector, tasks[i].first, tasks[i].last); }, options);
+        }
+
+    private:
+        template<typename T>
+        any_index& index_of() {
+            const auto it = indexes.find(key<T>());
+            if (it == indexes.end())
+                throw std::out_of_range("heco: type not indexed");
+            return it->second;
+        }
+
+        template<typename T>
+        const std::vector<T>& column_of() const {
+            return *static_cast<const std::vector<T>*>(checked_get(key<T>()));
+        }
+
+        template<typename T>
+        const std::vector<T>& non_empty_column_of() const {
+            const std::vector<T>& v = column_of<T>();
+            if (v.empty())
+                throw std::domain_error("heco: no min or max of an empty vector");
+            return v;
+        }
+
+        //Vector of T and whether it was just created
+        template<typename T>
+        std::pair<std::vector<T>&, bool> find_or_create() { return find_or_create_as<std::vector<T>>(); }
+
+        template<typename V>
+        std::pair<V&, bool> find_or_create_as() {
+            const type_id_t k = type_id<V>();
+            if (auto it = data.find(k); it != data.end())
+                return { *static_cast<V*>(it->second.get()), false };
+            const auto watch = watch_rehash(data);
+            auto&& [it, in] = data.emplace(k, ptr_dtor(new V(), { type_ops_of<V>() }));
+            Observer::on_insert(k);
+            Observer::on_construct(k, it->second.get());
+            return { *static_cast<V*>(it->second.get()), true };
+        }
+
+        //Forward iterators are counted to reserve once; pointers to trivially copyable elements are copied as a block by insert
+        template<typename T, typename It>
+        static void append_to(std::vector<T>& v, It first, It last) {
+            v.insert(v.end(), first, last);
+        }
+
+        static std::size_t pool_size(const parallel_options& options)
+        {
+            return (options.pool ? *options.pool : thread_pool::global()).size();
+        }
+
+        void* checked_get(type_id_t type) const
+        {
+            const auto it = data.find(type);
+            if (it == data.cend()) {
+                Observer::on_get_miss(type);
+                throw std::out_of_range("heco: type not found");
+            }
+            return it->second.get();
+        }
+
+        template<typename Map>
+        auto watch_rehash(const Map& m) { return rehash_watch<Map, Observer>(m, rehashes); }
     };
-}
\ No newline at end of file
+
+    using HeterogeneousContainer_n = BasicHeterogeneousContainer_n<>;
+}
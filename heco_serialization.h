@@ -0,0 +1,402 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <algorithm>      // for min, equal
+#include <cstddef>        // for size_t
+#include <cstdint>        // for std::uint64_t
+#include <cstring>        // for memcpy
+#include <istream>        // for istream
+#include <iterator>       // for begin, end
+#include <ostream>        // for ostream
+#include <stdexcept>      // for runtime_error, logic_error
+#include <string>         // for basic_string
+#include <string_view>    // for string_view
+#include <type_traits>    // for enable_if_t, is_trivially_copyable_v
+#include <unordered_map>  // for unordered_map
+#include <vector>
+#include "heco_common.h"
+
+namespace heco
+{
+    //Stream layout, all sizes being LEB128 varints:
+    //  magic record* 0
+    //  record := name_size name chunk* 0
+    //  chunk  := size bytes
+    //An object is written through a bounded buffer and flushed as a chunk each time the buffer is full,
+    //so neither side ever holds more than one buffer of serialized data.
+    constexpr char stream_magic[8] = "hecoser";
+
+    class output
+    {
+    public:
+        output(std::ostream& os, std::size_t capacity) : os(os), capacity(capacity > 0 ? capacity : 1) { buffer.reserve(this->capacity); }
+
+        void write(const void* p, std::size_t n)
+        {
+            auto* bytes = static_cast<const char*>(p);
+            while (n > 0) {
+                if (buffer.size() == capacity)
+                    flush_chunk();
+                const std::size_t k = std::min(n, capacity - buffer.size());
+                buffer.insert(buffer.end(), bytes, bytes + k);
+                bytes += k;
+                n -= k;
+            }
+        }
+
+        void write_varint(std::uint64_t value)
+        {
+            char bytes[10];
+            write(bytes, encode_varint(value, bytes));
+        }
+
+        template<typename T>
+        void write(const T& value);
+
+    private:
+        friend class writer;
+        std::ostream& os;
+        std::size_t capacity;
+        std::vector<char> buffer;
+
+        static std::size_t encode_varint(std::uint64_t value, char* bytes)
+        {
+            std::size_t n = 0;
+            do {
+                bytes[n] = char(value & 0x7f);
+                value >>= 7;
+                bytes[n++] |= value ? char(0x80) : char(0);
+            } while (value);
+            return n;
+        }
+
+        void write_raw_varint(std::uint64_t value)
+        {
+            char bytes[10];
+            os.write(bytes, std::streamsize(encode_varint(value, bytes)));
+        }
+
+        void flush_chunk()
+        {
+            if (buffer.empty())
+                return;
+            write_raw_varint(buffer.size());
+            os.write(buffer.data(), std::streamsize(buffer.size()));
+            buffer.clear();
+        }
+
+        void begin_record(std::string_view name)
+        {
+            write_raw_varint(name.size());
+            os.write(name.data(), std::streamsize(name.size()));
+        }
+
+        void end_record()
+        {
+            flush_chunk();
+            write_raw_varint(0);
+            if (!os)
+                throw std::runtime_error("heco: cannot write stream");
+        }
+    };
+
+    class input
+    {
+    public:
+        explicit input(std::istream& is) : is(is) {}
+
+        void read(void* p, std::size_t n)
+        {
+            auto* bytes = static_cast<char*>(p);
+            while (n > 0) {
+                if (remaining == 0 && (remaining = read_raw_varint()) == 0)
+                    throw std::runtime_error("heco: record is shorter than expected");
+                const std::size_t k = std::min<std::uint64_t>(n, remaining);
+                if (!is.read(bytes, std::streamsize(k)))
+                    throw std::runtime_error("heco: unexpected end of stream");
+                bytes += k;
+                n -= k;
+                remaining -= k;
+            }
+        }
+
+        std::uint64_t read_varint()
+        {
+            std::uint64_t value = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7) {
+                unsigned char byte;
+                read(&byte, 1);
+                value |= std::uint64_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                    return value;
+            }
+            throw std::runtime_error("heco: invalid varint");
+        }
+
+        template<typename T>
+        void read(T& value);
+
+        //Read a length and the n elements of value after it, refusing a length the rest of the stream cannot hold.
+        //Where the stream cannot tell, e.g. a pipe, value grows as its bytes arrive: a corrupt length then fails
+        //on the end of the stream instead of allocating its size.
+        template<typename Contiguous>
+        void read_sized(Contiguous& value)
+        {
+            read_sized(value, read_varint(), [&](void* p, std::size_t n) { read(p, n); });
+        }
+
+        //Read a count of elements taking a byte of the stream at least each, refusing a count the rest of the stream cannot hold
+        std::uint64_t read_count()
+        {
+            const std::uint64_t n = read_varint();
+            if (n > bytes_left())
+                throw std::runtime_error("heco: length exceeds the stream");
+            return n;
+        }
+
+    private:
+        friend class reader;
+        std::istream& is;
+        std::uint64_t remaining = 0;
+        static constexpr std::size_t growth_step = 1 << 16;//< bytes
+
+        template<typename Contiguous, typename ReadBytes>
+        void read_sized(Contiguous& value, std::uint64_t n, ReadBytes&& read_bytes)
+        {
+            using E = typename Contiguous::value_type;
+            if (n > bytes_left() / sizeof(E))
+                throw std::runtime_error("heco: length exceeds the stream");
+            value.clear();
+            while (value.size() < n) {
+                const std::size_t done = value.size();
+                const std::size_t k = std::size_t(std::min<std::uint64_t>(n - done, std::max<std::size_t>(growth_step / sizeof(E), 1)));
+                value.resize(done + k);
+                read_bytes(value.data() + done, k * sizeof(E));
+            }
+        }
+
+        //Bytes between the position and the end of the stream, or the maximum if the stream cannot seek
+        std::uint64_t bytes_left()
+        {
+            const auto position = is.tellg();
+            if (position == std::istream::pos_type(-1))
+                return std::uint64_t(-1);
+            is.seekg(0, std::ios::end);
+            const auto end = is.tellg();
+            is.seekg(position);
+            return end == std::istream::pos_type(-1) ? std::uint64_t(-1) : std::uint64_t(end - position);
+        }
+
+        std::uint64_t read_raw_varint()
+        {
+            std::uint64_t value = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7) {
+                const int byte = is.get();
+                if (byte == std::istream::traits_type::eof())
+                    throw std::runtime_error("heco: unexpected end of stream");
+                value |= std::uint64_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                    return value;
+            }
+            throw std::runtime_error("heco: invalid varint");
+        }
+
+        //Skip what the serializer left of the record, up to its terminating empty chunk
+        void end_record()
+        {
+            for (;;) {
+                if (remaining == 0 && (remaining = read_raw_varint()) == 0)
+                    return;
+                is.ignore(std::streamsize(remaining));
+                remaining = 0;
+            }
+        }
+    };
+
+    //How an object of type T is written and read back in place. Specialize it for user types with
+    //  static void write(output&, const T&);
+    //  static void read(input&, T&);//< T is default constructed beforehand
+    template<typename T, typename = void>
+    struct serializer;
+
+    //Trivially copyable types are written as their bytes, i.e. with the endianness of the writer
+    template<typename T>
+    struct serializer<T, std::enable_if_t<std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>>>
+    {
+        static void write(output& out, const T& value) { out.write(&value, sizeof(T)); }
+        static void read(input& in, T& value) { in.read(&value, sizeof(T)); }
+    };
+
+    template<typename C, typename Traits, typename Alloc>
+    struct serializer<std::basic_string<C, Traits, Alloc>>
+    {
+        static void write(output& out, const std::basic_string<C, Traits, Alloc>& value) {
+            out.write_varint(value.size());
+            out.write(value.data(), value.size() * sizeof(C));
+        }
+        static void read(input& in, std::basic_string<C, Traits, Alloc>& value) { in.read_sized(value); }
+    };
+
+    template<typename T, typename Alloc>
+    struct serializer<std::vector<T, Alloc>>
+    {
+        static void write(output& out, const std::vector<T, Alloc>& value) {
+            out.write_varint(value.size());
+            if constexpr (std::is_trivially_copyable_v<T>)
+                out.write(value.data(), value.size() * sizeof(T));
+            else
+                for (const T& x : value)
+                    serializer<T>::write(out, x);
+        }
+        static void read(input& in, std::vector<T, Alloc>& value) {
+            if constexpr (std::is_trivially_copyable_v<T>)
+                in.read_sized(value);
+            else {
+                const std::uint64_t n = in.read_count();
+                value.clear();
+                for (std::uint64_t i = 0; i < n; ++i)
+                    serializer<T>::read(in, value.emplace_back());
+            }
+        }
+    };
+
+    template<typename T>
+    void output::write(const T& value) { serializer<T>::write(*this, value); }
+    template<typename T>
+    void input::read(T& value) { serializer<T>::read(*this, value); }
+
+    //Types which can be written and read, each one under a name that must not change between writer and reader
+    class serializer_registry
+    {
+    public:
+        struct entry
+        {
+            std::string name;
+            const type_ops* ops;
+            void (*write)(output&, const void*);
+            void (*read)(input&, void*);
+        };
+
+        template<typename T>
+        serializer_registry& add(std::string name)
+        {
+            using U = rm_cvref_t<T>;
+            const type_ops* ops = type_ops_of<U>();
+            if (name.empty() || by_name.count(name) || find(ops->id))
+                throw std::logic_error("heco: type or name registered twice");
+            by_name.emplace(name, entries.size());
+            if (ops->id >= by_id.size())
+                by_id.resize(ops->id + 1, npos);
+            by_id[ops->id] = entries.size();
+            entries.push_back({ std::move(name), ops,
+                +[](output& out, const void* p) { serializer<U>::write(out, *static_cast<const U*>(p)); },
+                +[](input& in, void* p) { serializer<U>::read(in, *static_cast<U*>(p)); } });
+            return *this;
+        }
+
+        const entry* find(type_id_t id) const noexcept {
+            return (id < by_id.size() && by_id[id] != npos) ? &entries[by_id[id]] : nullptr;
+        }
+        const entry* find(const std::string& name) const noexcept {
+            auto it = by_name.find(name);
+            return it != by_name.end() ? &entries[it->second] : nullptr;
+        }
+
+    private:
+        static constexpr std::size_t npos = std::size_t(-1);
+        std::vector<entry> entries;
+        std::unordered_map<std::string, std::size_t> by_name;
+        std::vector<std::size_t> by_id;
+    };
+
+    //Write every object of a container, one at a time, through a buffer of buffer_size bytes
+    class writer
+    {
+    public:
+        writer(std::ostream& os, const serializer_registry& registry, std::size_t buffer_size = 4096)
+            : out(os, buffer_size), registry(registry) {}
+
+        template<typename Container>
+        void write(const Container& container)
+        {
+            out.os.write(stream_magic, sizeof(stream_magic));
+            container.for_each([&](type_id_t tid, const void* p) {
+                const auto* e = registry.find(tid);
+                if (!e)
+                    throw std::logic_error("heco: no serializer registered for a stored type");
+                out.begin_record(e->name);
+                e->write(out, p);
+                out.end_record();
+            });
+            out.write_raw_varint(0);
+            out.os.flush();
+            if (!out.os)
+                throw std::runtime_error("heco: cannot write stream");
+        }
+
+    private:
+        output out;
+        const serializer_registry& registry;
+    };
+
+    //Read objects back, each one being default constructed in place in the destination container then filled.
+    //A record of a type the container already holds is an error: objects are not overwritten. An object whose
+    //record fails to read is removed, those read before it stay.
+    class reader
+    {
+    public:
+        reader(std::istream& is, const serializer_registry& registry) : in(is), registry(registry) {}
+
+        template<typename Container>
+        void read(Container& container)
+        {
+            char magic[sizeof(stream_magic)];
+            if (!in.is.read(magic, sizeof(magic)) || !std::equal(std::begin(magic), std::end(magic), stream_magic))
+                throw std::runtime_error("heco: invalid stream");
+            std::string name;
+            while (const std::uint64_t n = in.read_raw_varint()) {
+                in.read_sized(name, n, [&](void* p, std::size_t k) {
+                    if (!in.is.read(static_cast<char*>(p), std::streamsize(k)))
+                        throw std::runtime_error("heco: unexpected end of stream");
+                });
+                const auto* e = registry.find(name);
+                if (!e)
+                    throw std::runtime_error("heco: no serializer registered under " + name);
+                void* p = container.emplace(*e->ops);
+                if (!p)
+                    throw std::runtime_error("heco: " + name + " is already stored");
+                try {
+                    e->read(in, p);
+                }
+                catch (...) {
+                    container.erase(e->ops->id);
+                    throw;
+                }
+                in.end_record();
+            }
+        }
+
+    private:
+        input in;
+        const serializer_registry& registry;
+    };
+}
@@ -0,0 +1,287 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <cassert>
+#include <cstddef>        // for size_t
+#include <cstring>        // for memcpy
+#include <iterator>       // for data, size
+#include <type_traits>    // for is_arithmetic_v, common_type_t
+
+//Reduction and transform kernels over contiguous arithmetic data, e.g. HeterogeneousContainer_n::vector<double>() or a column_span.
+//With GCC or Clang, kernels are written with vector extensions and compiled twice on x86: for the baseline (SSE2) and for AVX2,
+//picked at runtime from the CPU features; on other targets they use 16 bytes vectors. Other compilers run scalar loops.
+//Loads are unaligned, which costs nothing on current x86 cores, so that no peeling loop is needed whatever the storage.
+//Floating point sums and dot products accumulate in several lanes, thus in another order than a scalar loop.
+namespace heco
+{
+    namespace simd
+    {
+        namespace detail
+        {
+            template<typename T>
+            constexpr bool is_lane = std::is_arithmetic_v<T> && !std::is_same_v<T, bool>;
+
+            template<bool Min, typename T>
+            constexpr T pick(T x, T r) noexcept { return (Min ? x < r : r < x) ? x : r; }
+
+#if defined(__GNUC__) || defined(__clang__)
+            template<typename T, std::size_t Bytes>
+            struct vector_of { typedef T type __attribute__((vector_size(Bytes))); };
+            template<typename T, std::size_t Bytes>
+            using vec = typename vector_of<T, Bytes>::type;
+
+            //Vectors are passed by reference: by value, 32 bytes vectors would depend on the ABI of the translation unit
+            template<typename V, typename T>
+            [[gnu::always_inline]] inline void load(V& v, const T* p) noexcept { std::memcpy(&v, p, sizeof(V)); }
+
+            template<std::size_t Bytes, typename T>
+            [[gnu::always_inline]] inline T sum(const T* p, std::size_t n) noexcept
+            {
+                using V = vec<T, Bytes>;
+                constexpr std::size_t L = Bytes / sizeof(T);
+                V a0{}, a1{}, a2{}, a3{}, x0, x1, x2, x3;//< independent accumulators hide the latency of the additions
+                std::size_t i = 0;
+                for (; i + 4 * L <= n; i += 4 * L) {
+                    load(x0, p + i);
+                    load(x1, p + i + L);
+                    load(x2, p + i + 2 * L);
+                    load(x3, p + i + 3 * L);
+                    a0 += x0;
+                    a1 += x1;
+                    a2 += x2;
+                    a3 += x3;
+                }
+                for (; i + L <= n; i += L) {
+                    load(x0, p + i);
+                    a0 += x0;
+                }
+                a0 += a1 + a2 + a3;
+                T s = 0;
+                for (std::size_t k = 0; k < L; ++k)
+                    s += a0[k];
+                for (; i < n; ++i)
+                    s += p[i];
+                return s;
+            }
+
+            //Minimum if Min, else maximum
+            template<std::size_t Bytes, bool Min, typename T>
+            [[gnu::always_inline]] inline T reduce(const T* p, std::size_t n) noexcept
+            {
+                using V = vec<T, Bytes>;
+                constexpr std::size_t L = Bytes / sizeof(T);
+                T r = p[0];
+                std::size_t i = 0;
+                if (n >= L) {
+                    V a, x;
+                    load(a, p);
+                    for (i = L; i + L <= n; i += L) {
+                        load(x, p + i);
+                        a = (Min ? x < a : a < x) ? x : a;
+                    }
+                    for (std::size_t k = 0; k < L; ++k)
+                        r = pick<Min>(a[k], r);
+                }
+                for (; i < n; ++i)
+                    r = pick<Min>(p[i], r);
+                return r;
+            }
+
+            template<std::size_t Bytes, typename T>
+            [[gnu::always_inline]] inline T dot(const T* p, const T* q, std::size_t n) noexcept
+            {
+                using V = vec<T, Bytes>;
+                constexpr std::size_t L = Bytes / sizeof(T);
+                V a0{}, a1{}, x0, y0, x1, y1;
+                std::size_t i = 0;
+                for (; i + 2 * L <= n; i += 2 * L) {
+                    load(x0, p + i);
+                    load(y0, q + i);
+                    load(x1, p + i + L);
+                    load(y1, q + i + L);
+                    a0 += x0 * y0;
+                    a1 += x1 * y1;
+                }
+                for (; i + L <= n; i += L) {
+                    load(x0, p + i);
+                    load(y0, q + i);
+                    a0 += x0 * y0;
+                }
+                a0 += a1;
+                T s = 0;
+                for (std::size_t k = 0; k < L; ++k)
+                    s += a0[k];
+                for (; i < n; ++i)
+                    s += p[i] * q[i];
+                return s;
+            }
+#endif
+
+            //Plain loops, left to the auto-vectorizer of each compiled variant: the callables are inlined into them
+            template<typename T, typename Pred>
+            [[gnu::always_inline]] inline std::size_t count_if(const T* p, std::size_t n, Pred& pred)
+            {
+                std::size_t c = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                    c += pred(p[i]) ? 1 : 0;
+                return c;
+            }
+
+            template<typename T, typename U, typename F>
+            [[gnu::always_inline]] inline void transform(const T* src, U* dst, std::size_t n, F& f)
+            {
+                for (std::size_t i = 0; i < n; ++i)
+                    dst[i] = f(src[i]);
+            }
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+            inline bool has_avx2() noexcept
+            {
+                static const bool avx2 = __builtin_cpu_supports("avx2");
+                return avx2;
+            }
+
+            template<typename T> [[gnu::target("avx2")]] T sum_avx2(const T* p, std::size_t n) noexcept { return sum<32>(p, n); }
+            template<typename T> T sum_base(const T* p, std::size_t n) noexcept { return sum<16>(p, n); }
+            template<bool Min, typename T> [[gnu::target("avx2")]] T reduce_avx2(const T* p, std::size_t n) noexcept { return reduce<32, Min>(p, n); }
+            template<bool Min, typename T> T reduce_base(const T* p, std::size_t n) noexcept { return reduce<16, Min>(p, n); }
+            template<typename T> [[gnu::target("avx2")]] T dot_avx2(const T* p, const T* q, std::size_t n) noexcept { return dot<32>(p, q, n); }
+            template<typename T> T dot_base(const T* p, const T* q, std::size_t n) noexcept { return dot<16>(p, q, n); }
+            template<typename T, typename Pred> [[gnu::target("avx2")]] std::size_t count_if_avx2(const T* p, std::size_t n, Pred& pred) { return count_if(p, n, pred); }
+            template<typename T, typename U, typename F> [[gnu::target("avx2")]] void transform_avx2(const T* src, U* dst, std::size_t n, F& f) { transform(src, dst, n, f); }
+#else
+            inline bool has_avx2() noexcept { return false; }
+#endif
+        }
+
+        //Sum of the n elements at p, accumulated in T
+        template<typename T>
+        T sum(const T* p, std::size_t n) noexcept
+        {
+            static_assert(detail::is_lane<T>, "heco: simd kernels work on arithmetic types");
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+            return detail::has_avx2() ? detail::sum_avx2(p, n) : detail::sum_base(p, n);
+#elif defined(__GNUC__) || defined(__clang__)
+            return detail::sum<16>(p, n);
+#else
+            T s = 0;
+            for (std::size_t i = 0; i < n; ++i)
+                s += p[i];
+            return s;
+#endif
+        }
+
+        //Smallest of the n > 0 elements at p; the result is unspecified when they include NaN
+        template<typename T>
+        T min(const T* p, std::size_t n) noexcept
+        {
+            static_assert(detail::is_lane<T>, "heco: simd kernels work on arithmetic types");
+            assert(n > 0);
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+            return detail::has_avx2() ? detail::reduce_avx2<true>(p, n) : detail::reduce_base<true>(p, n);
+#elif defined(__GNUC__) || defined(__clang__)
+            return detail::reduce<16, true>(p, n);
+#else
+            T r = p[0];
+            for (std::size_t i = 1; i < n; ++i)
+                r = detail::pick<true>(p[i], r);
+            return r;
+#endif
+        }
+
+        //Largest of the n > 0 elements at p; the result is unspecified when they include NaN
+        template<typename T>
+        T max(const T* p, std::size_t n) noexcept
+        {
+            static_assert(detail::is_lane<T>, "heco: simd kernels work on arithmetic types");
+            assert(n > 0);
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+            return detail::has_avx2() ? detail::reduce_avx2<false>(p, n) : detail::reduce_base<false>(p, n);
+#elif defined(__GNUC__) || defined(__clang__)
+            return detail::reduce<16, false>(p, n);
+#else
+            T r = p[0];
+            for (std::size_t i = 1; i < n; ++i)
+                r = detail::pick<false>(p[i], r);
+            return r;
+#endif
+        }
+
+        //Sum of the products of the n elements at p and q. Elements of different types are multiplied in their common type, by a scalar loop.
+        template<typename T, typename U>
+        std::common_type_t<T, U> dot(const T* p, const U* q, std::size_t n) noexcept
+        {
+            static_assert(detail::is_lane<T> && detail::is_lane<U>, "heco: simd kernels work on arithmetic types");
+            if constexpr (std::is_same_v<T, U>) {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+                return detail::has_avx2() ? detail::dot_avx2(p, q, n) : detail::dot_base(p, q, n);
+#elif defined(__GNUC__) || defined(__clang__)
+                return detail::dot<16>(p, q, n);
+#endif
+            }
+            std::common_type_t<T, U> s = 0;
+            for (std::size_t i = 0; i < n; ++i)
+                s += std::common_type_t<T, U>(p[i]) * std::common_type_t<T, U>(q[i]);
+            return s;
+        }
+
+        //Number of the n elements at p for which pred(element) holds
+        template<typename T, typename Pred>
+        std::size_t count_if(const T* p, std::size_t n, Pred pred)
+        {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+            if (detail::has_avx2())
+                return detail::count_if_avx2(p, n, pred);
+#endif
+            return detail::count_if(p, n, pred);
+        }
+
+        //dst[i] = f(src[i]) for the n elements at src; dst may be src
+        template<typename T, typename U, typename F>
+        void transform(const T* src, U* dst, std::size_t n, F f)
+        {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+            if (detail::has_avx2())
+                return detail::transform_avx2(src, dst, n, f);
+#endif
+            detail::transform(src, dst, n, f);
+        }
+
+        //Same kernels over contiguous ranges: std::vector, std::array, column_span...
+        template<typename Range>
+        auto sum(const Range& r) noexcept { return sum(std::data(r), std::size(r)); }
+        template<typename Range>
+        auto min(const Range& r) noexcept { return min(std::data(r), std::size(r)); }
+        template<typename Range>
+        auto max(const Range& r) noexcept { return max(std::data(r), std::size(r)); }
+        template<typename Range1, typename Range2>
+        auto dot(const Range1& a, const Range2& b) noexcept
+        {
+            assert(std::size(a) == std::size(b));
+            return dot(std::data(a), std::data(b), std::size(a));
+        }
+        template<typename Range, typename Pred>
+        std::size_t count_if(const Range& r, Pred pred) { return count_if(std::data(r), std::size(r), pred); }
+        template<typename Range, typename F>
+        void transform(Range&& r, F f) { transform(std::data(r), std::data(r), std::size(r), f); }
+    }
+}
@@ -0,0 +1,205 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <cassert>
+#include <cstddef>        // for size_t
+#include <tuple>          // for tuple, get
+#include <type_traits>    // for remove_cv_t
+#include <utility>        // for index_sequence
+#include <vector>         // for vector
+#include "heco_common.h"
+
+namespace heco
+{
+    //Members of an aggregate stored column-wise by soa_vector, one column per member, declared by specializing:
+    //template<> struct heco::soa_members<Point3> { static constexpr auto value = std::make_tuple(&Point3::x, &Point3::y, &Point3::z); };
+    template<typename T>
+    struct soa_members;
+
+    template<typename T, typename = void>
+    struct is_soa : std::false_type {};
+    template<typename T>
+    struct is_soa<T, std::void_t<decltype(soa_members<T>::value)>> : std::true_type {};
+
+    template<typename M>
+    struct member_pointer_traits;
+    template<typename C, typename M>
+    struct member_pointer_traits<M C::*>
+    {
+        using class_type = C;
+        using member_type = M;
+    };
+
+    //Contiguous elements of one column
+    template<typename T>
+    class column_span
+    {
+    public:
+        column_span(T* first, std::size_t n) noexcept : first(first), n(n) {}
+
+        T* data() const noexcept { return first; }
+        std::size_t size() const noexcept { return n; }
+        bool empty() const noexcept { return n == 0; }
+        T* begin() const noexcept { return first; }
+        T* end() const noexcept { return first + n; }
+        T& operator[](std::size_t i) const noexcept { assert(i < n); return first[i]; }
+
+    private:
+        T* first;
+        std::size_t n;
+    };
+
+    //Sequence of T stored as one std::vector per member listed by soa_members<T> (structure of arrays).
+    //A pass over one member loads that member only; whole objects are read and written through proxies.
+    //T must be default constructible, to be rebuilt from its members.
+    template<typename T>
+    class soa_vector
+    {
+        static_assert(is_soa<T>::value, "heco: specialize soa_members<T> to store T column-wise");
+        using members_t = std::remove_cv_t<decltype(soa_members<T>::value)>;
+        static constexpr std::size_t N = std::tuple_size_v<members_t>;
+        using indexes = std::make_index_sequence<N>;
+
+        template<std::size_t I>
+        static constexpr auto member = std::get<I>(soa_members<T>::value);
+        template<std::size_t I>
+        using member_t = typename member_pointer_traits<std::tuple_element_t<I, members_t>>::member_type;
+
+        template<typename Seq> struct columns_of;
+        template<std::size_t... I> struct columns_of<std::index_sequence<I...>> { using type = std::tuple<std::vector<member_t<I>>...>; };
+        template<typename Seq> struct comparable;
+        template<std::size_t... I> struct comparable<std::index_sequence<I...>> : std::bool_constant<(is_equality_comparable<member_t<I>>() && ...)> {};
+
+        template<auto M, typename P>
+        static constexpr bool same_member(P p) noexcept
+        {
+            if constexpr (std::is_same_v<decltype(M), P>) return M == p;
+            else return false;
+        }
+        template<auto M, std::size_t... I>
+        static constexpr std::size_t index_of(std::index_sequence<I...>) noexcept
+        {
+            std::size_t found = N;
+            ((same_member<M>(member<I>) ? (found = I, true) : false) || ...);
+            return found;
+        }
+
+    public:
+        using value_type = T;
+
+        class reference
+        {
+        public:
+            reference(soa_vector& v, std::size_t i) noexcept : v(&v), i(i) {}
+            template<auto M> auto& get() const noexcept { return v->template column<M>()[i]; }
+            operator T() const { return v->load(i); }
+            const reference& operator=(const T& value) const { v->store(i, value); return *this; }
+            const reference& operator=(const reference& other) const { v->store(i, T(other)); return *this; }
+
+        private:
+            soa_vector* v;
+            std::size_t i;
+        };
+
+        class const_reference
+        {
+        public:
+            const_reference(const soa_vector& v, std::size_t i) noexcept : v(&v), i(i) {}
+            template<auto M> const auto& get() const noexcept { return v->template column<M>()[i]; }
+            operator T() const { return v->load(i); }
+
+        private:
+            const soa_vector* v;
+            std::size_t i;
+        };
+
+        std::size_t size() const noexcept { return std::get<0>(columns).size(); }
+        bool empty() const noexcept { return size() == 0; }
+        void reserve(std::size_t n) { std::apply([&](auto&... c) { (c.reserve(n), ...); }, columns); }
+        void clear() noexcept { std::apply([](auto&... c) { (c.clear(), ...); }, columns); }
+
+        reference operator[](std::size_t i) noexcept { assert(i < size()); return { *this, i }; }
+        const_reference operator[](std::size_t i) const noexcept { assert(i < size()); return { *this, i }; }
+
+        void push_back(const T& value) { push_back(value, indexes{}); }
+        void push_back(T&& value) { push_back(std::move(value), indexes{}); }
+        void pop_back() noexcept { std::apply([](auto&... c) { (c.pop_back(), ...); }, columns); }
+
+        //Column of the member M, e.g. column<&Point3::x>()
+        template<auto M>
+        auto column() noexcept
+        {
+            constexpr std::size_t I = index_of<M>(indexes{});
+            static_assert(I < N, "heco: member is not listed by soa_members");
+            auto& c = std::get<I>(columns);
+            return column_span<member_t<I>>(c.data(), c.size());
+        }
+
+        template<auto M>
+        auto column() const noexcept
+        {
+            constexpr std::size_t I = index_of<M>(indexes{});
+            static_assert(I < N, "heco: member is not listed by soa_members");
+            auto& c = std::get<I>(columns);
+            return column_span<const member_t<I>>(c.data(), c.size());
+        }
+
+        T load(std::size_t i) const { return load(i, indexes{}); }
+        void store(std::size_t i, const T& value) { store(i, value, indexes{}); }
+
+        template<typename U = T, typename = std::enable_if_t<comparable<indexes>::value, U>>
+        bool operator==(const soa_vector& other) const { return columns == other.columns; }
+        template<typename U = T, typename = std::enable_if_t<comparable<indexes>::value, U>>
+        bool operator!=(const soa_vector& other) const { return !(columns == other.columns); }
+
+    private:
+        typename columns_of<indexes>::type columns;
+
+        //Columns which grew are shrunk back if a member throws, so that they keep the same size
+        template<typename V, std::size_t... I>
+        void push_back(V&& value, std::index_sequence<I...>)
+        {
+            std::size_t pushed = 0;
+            try {
+                ((std::get<I>(columns).push_back(std::forward<V>(value).*member<I>), ++pushed), ...);
+            }
+            catch (...) {
+                ((I < pushed ? std::get<I>(columns).pop_back() : void()), ...);
+                throw;
+            }
+        }
+
+        template<std::size_t... I>
+        T load(std::size_t i, std::index_sequence<I...>) const
+        {
+            T value{};
+            ((value.*member<I> = std::get<I>(columns)[i]), ...);
+            return value;
+        }
+
+        template<std::size_t... I>
+        void store(std::size_t i, const T& value, std::index_sequence<I...>)
+        {
+            ((std::get<I>(columns)[i] = value.*member<I>), ...);
+        }
+    };
+}
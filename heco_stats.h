@@ -0,0 +1,125 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <cstddef>        // for size_t
+#include <functional>     // for function
+#include <map>            // for map
+#include <mutex>          // for mutex, lock_guard
+#include <string>         // for string
+#include <utility>        // for exchange, move
+#include <vector>         // for vector
+#include "heco_common.h"
+
+namespace heco
+{
+    //Process-wide aggregation of the stats() of containers registered under a label.
+    //Registration is explicit so that untracked containers pay nothing. A tracked container must outlive
+    //its registration and must not be modified while a report is collected.
+    class stats_registry
+    {
+    public:
+        struct entry { std::string label; container_stats stats; };
+
+        //Unregisters the container when destroyed
+        class registration
+        {
+            stats_registry* registry = nullptr;
+            std::size_t key = 0;
+            friend class stats_registry;
+            registration(stats_registry* r, std::size_t k) : registry(r), key(k) {}
+        public:
+            registration() = default;
+            registration(const registration&) = delete;
+            registration& operator=(const registration&) = delete;
+            registration(registration&& other) noexcept : registry(std::exchange(other.registry, nullptr)), key(other.key) {}
+            registration& operator=(registration&& other) noexcept {
+                if (this != &other) {
+                    reset();
+                    registry = std::exchange(other.registry, nullptr);
+                    key = other.key;
+                }
+                return *this;
+            }
+            ~registration() { reset(); }
+
+            void reset() {
+                if (registry)
+                    registry->untrack(key);
+                registry = nullptr;
+            }
+        };
+
+        static stats_registry& global() {
+            static stats_registry registry;
+            return registry;
+        }
+
+        template<typename Container>
+        [[nodiscard]] registration track(const Container& container, std::string label)
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            const std::size_t key = next_key++;
+            tracked.emplace(key, source{ std::move(label), [&container] { return container.stats(); } });
+            return registration(this, key);
+        }
+
+        //One report per tracked container, in registration order
+        std::vector<entry> collect() const
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            std::vector<entry> entries;
+            entries.reserve(tracked.size());
+            for (auto& [key, src] : tracked)
+                entries.push_back({ src.label, src.stats() });
+            return entries;
+        }
+
+        //Sum of the reports of all tracked containers
+        container_stats total() const
+        {
+            container_stats sum;
+            sum.container = "total";
+            for (const entry& e : collect())
+                sum += e.stats;
+            return sum;
+        }
+
+        std::size_t size() const
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            return tracked.size();
+        }
+
+    private:
+        struct source { std::string label; std::function<container_stats()> stats; };
+
+        mutable std::mutex mutex;
+        std::size_t next_key = 0;
+        std::map<std::size_t, source> tracked;
+
+        void untrack(std::size_t key)
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            tracked.erase(key);
+        }
+    };
+}
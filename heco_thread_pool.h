@@ -0,0 +1,256 @@
+// MIT License
+//
+// Copyright(c) 2020 Fabien Pan
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include <algorithm>          // for max, min
+#include <atomic>             // for atomic
+#include <condition_variable> // for condition_variable
+#include <cstddef>            // for size_t
+#include <cstdint>            // for uintptr_t
+#include <exception>          // for exception_ptr
+#include <mutex>              // for mutex, unique_lock
+#include <thread>             // for thread
+#include <type_traits>        // for remove_reference_t
+#include <utility>            // for pair
+#include <vector>             // for vector
+#if defined(HECO_PARALLEL_STD_EXECUTION)
+#include <execution>          // for execution::par
+#include <numeric>            // for iota
+#endif
+
+namespace heco
+{
+    //Pool of threads running batches of indexed tasks, the calling thread taking part.
+    //Tasks of a batch are split in one range per thread; a thread done with its range steals from the others.
+    //One batch runs at a time; a batch started from within a task runs inline on the calling thread.
+    class thread_pool
+    {
+    public:
+        explicit thread_pool(std::size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+        {
+            workers.reserve(threads - 1);
+            for (std::size_t i = 1; i < threads; ++i)
+                workers.emplace_back([this, i] { work(i); });
+        }
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+        ~thread_pool()
+        {
+            {
+                const std::lock_guard<std::mutex> lock(m);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& t : workers)
+                t.join();
+        }
+
+        static thread_pool& global()
+        {
+            static thread_pool pool;
+            return pool;
+        }
+
+        //Threads running a batch, the calling one included
+        std::size_t size() const noexcept { return workers.size() + 1; }
+
+        //Call f(i) for each i in [0, n), returning once all calls did. The first exception thrown by f is rethrown.
+        //Without stealing, each thread runs its own range only: the assignment of tasks to threads depends on n and size() alone.
+        template<typename F>
+        void run(std::size_t n, F&& f, bool steal = true)
+        {
+            if (n == 0)
+                return;
+            if (in_task() || workers.empty() || n == 1) {
+                for (std::size_t i = 0; i < n; ++i)
+                    f(i);
+                return;
+            }
+            const std::lock_guard<std::mutex> serial(running);
+            batch b(n, size(), steal, &f, [](void* ctx, std::size_t i) { (*static_cast<std::remove_reference_t<F>*>(ctx))(i); });
+            {
+                const std::lock_guard<std::mutex> lock(m);
+                current = &b;
+                ++generation;
+            }
+            wake.notify_all();
+            in_task() = true;
+            b.execute(0);
+            in_task() = false;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                done.wait(lock, [&] { return b.remaining.load() == 0 && b.active == 0; });
+                current = nullptr;
+            }
+            if (b.error)
+                std::rethrow_exception(b.error);
+        }
+
+    private:
+        struct alignas(64) range
+        {
+            std::atomic<std::size_t> next{ 0 };
+            std::size_t end = 0;
+        };
+
+        struct batch
+        {
+            std::vector<range> ranges;
+            bool steal;
+            void* ctx;
+            void (*call)(void*, std::size_t);
+            std::atomic<std::size_t> remaining;
+            std::size_t active = 0;//< workers within execute, guarded by the pool mutex
+            std::mutex error_mutex;
+            std::exception_ptr error;
+
+            batch(std::size_t n, std::size_t threads, bool steal, void* ctx, void (*call)(void*, std::size_t))
+                : ranges(std::min(n, threads)), steal(steal), ctx(ctx), call(call), remaining(n)
+            {
+                for (std::size_t r = 0; r < ranges.size(); ++r) {
+                    ranges[r].next = n * r / ranges.size();
+                    ranges[r].end = n * (r + 1) / ranges.size();
+                }
+            }
+
+            void execute(std::size_t self)
+            {
+                if (self < ranges.size())
+                    drain(ranges[self]);
+                if (steal)
+                    for (std::size_t k = 1; k < ranges.size(); ++k)
+                        drain(ranges[(self + k) % ranges.size()]);
+            }
+
+            void drain(range& r)
+            {
+                std::size_t done = 0;
+                for (std::size_t i = r.next++; i < r.end; i = r.next++) {
+                    try {
+                        call(ctx, i);
+                    }
+                    catch (...) {
+                        const std::lock_guard<std::mutex> lock(error_mutex);
+                        if (!error)
+                            error = std::current_exception();
+                    }
+                    ++done;
+                }
+                remaining -= done;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        std::mutex running;//< serializes batches
+        std::mutex m;
+        std::condition_variable wake;
+        std::condition_variable done;
+        batch* current = nullptr;
+        std::size_t generation = 0;
+        bool stopping = false;
+
+        static bool& in_task() noexcept
+        {
+            thread_local bool flag = false;
+            return flag;
+        }
+
+        void work(std::size_t self)
+        {
+            in_task() = true;
+            std::size_t seen = 0;
+            for (;;) {
+                batch* b = nullptr;
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    wake.wait(lock, [&] { return stopping || generation != seen; });
+                    if (stopping)
+                        return;
+                    seen = generation;
+                    if (!current)
+                        continue;
+                    b = current;
+                    ++b->active;
+                }
+                b->execute(self);
+                {
+                    const std::lock_guard<std::mutex> lock(m);
+                    --b->active;
+                }
+                done.notify_all();
+            }
+        }
+    };
+
+    //How to split and where to run a parallel loop over contiguous elements
+    struct parallel_options
+    {
+        thread_pool* pool = nullptr;//< thread_pool::global() when null
+        std::size_t chunk_bytes = 0;//< 0 for about four chunks per thread, at least a cache line
+        bool deterministic = false;//< chunks depend on the element count only, each thread runs a fixed share of them
+    };
+
+    inline constexpr std::size_t parallel_cache_line = 64;
+    inline constexpr std::size_t deterministic_chunk_bytes = 16 * 1024;
+
+    //Boundaries [first, last) of the chunks of n elements of the given size starting at address base.
+    //Chunks are whole cache lines: after the first one, each chunk starts on a line, so that no two threads write the same line.
+    //Deterministic chunks ignore the address and the number of threads.
+    inline std::vector<std::pair<std::size_t, std::size_t>> parallel_chunks(const void* base, std::size_t n, std::size_t element_size, const parallel_options& options, std::size_t threads)
+    {
+        std::vector<std::pair<std::size_t, std::size_t>> chunks;
+        if (n == 0)
+            return chunks;
+        std::size_t bytes = options.chunk_bytes;
+        if (!bytes)
+            bytes = options.deterministic ? deterministic_chunk_bytes : n * element_size / (4 * threads);
+        const std::size_t per_line = std::max<std::size_t>(1, parallel_cache_line / element_size);
+        const std::size_t step = std::max(per_line, (bytes / element_size + per_line - 1) / per_line * per_line);
+        std::size_t first = 0;
+        if (!options.deterministic) {
+            const std::size_t misalignment = reinterpret_cast<std::uintptr_t>(base) % parallel_cache_line;
+            if (misalignment && misalignment % element_size == 0 && parallel_cache_line % element_size == 0)
+                first = std::min(n, (parallel_cache_line - misalignment) / element_size);
+            if (first)
+                chunks.emplace_back(0, first);
+        }
+        for (; first < n; first += step)
+            chunks.emplace_back(first, std::min(n, first + step));
+        return chunks;
+    }
+
+    //Call f(i) for each i in [0, n) on the pool of the options, or on the std::execution::par backend when
+    //HECO_PARALLEL_STD_EXECUTION is defined and no pool was given
+    template<typename F>
+    void parallel_run(std::size_t n, F&& f, const parallel_options& options)
+    {
+#if defined(HECO_PARALLEL_STD_EXECUTION)
+        if (!options.pool && !options.deterministic) {
+            std::vector<std::size_t> indexes(n);
+            std::iota(indexes.begin(), indexes.end(), std::size_t(0));
+            std::for_each(std::execution::par, indexes.begin(), indexes.end(), f);
+            return;
+        }
+#endif
+        thread_pool& pool = options.pool ? *options.pool : thread_pool::global();
+        pool.run(n, std::forward<F>(f), !options.deterministic);
+    }
+}
@@ -0,0 +1,85 @@
+﻿#include <benchmark/benchmark.h>
+
+#include <heco_1_map_array.h>
+#include <heco_1_map_stable.h>
+#include <heco_1_sparseset_stable.h>
+#include <heco_basic_container.h>
+
+#include <string>
+
+//Insertion, lookup and iteration over every configuration of basic_container, next to the hand written containers.
+//Not a test: build the target and run it, e.g. bench_heco_basic_container --benchmark_filter=get
+
+using namespace heco;
+
+template<int N> struct P { int v[N]; };
+
+template<typename Container>
+void fill(Container& c)
+{
+    c.insert(P<1>{}, P<2>{}, P<3>{}, P<4>{}, P<5>{}, P<6>{}, P<7>{}, P<8>{}, std::string("heco"), 1.);
+}
+
+template<typename Container>
+void insert(benchmark::State& state)
+{
+    for (auto _ : state) {
+        Container c;
+        fill(c);
+        benchmark::DoNotOptimize(c);
+    }
+}
+
+template<typename Container>
+void get(benchmark::State& state)
+{
+    Container c;
+    fill(c);
+    for (auto _ : state) {
+        int sum = c.template get<P<1>>().v[0] + c.template get<P<4>>().v[0] + c.template get<P<8>>().v[0];
+        benchmark::DoNotOptimize(sum);
+        benchmark::DoNotOptimize(&c.template get<double>());
+    }
+}
+
+template<typename Container>
+void for_each(benchmark::State& state)
+{
+    Container c;
+    fill(c);
+    for (auto _ : state) {
+        std::size_t n = 0;
+        c.for_each([&](type_id_t tid, const void* p) { n += tid + (p != nullptr); });
+        benchmark::DoNotOptimize(n);
+    }
+}
+
+using fixed = fixed_container<P<1>, P<2>, P<3>, P<4>, P<5>, P<6>, P<7>, P<8>, std::string, double>;
+using contiguous_flat = basic_container<storage::contiguous, index::flat_map>;
+using contiguous_sparse = basic_container<storage::contiguous, index::sparse>;
+using stable_flat = basic_container<storage::stable, index::flat_map>;
+using stable_map_stable_id = basic_container<storage::stable, index::hash_map, id::stable>;
+using contiguous_map_pmr = basic_container<storage::contiguous, index::hash_map, id::dense, alloc::resource>;
+
+#define HECO_BENCHMARK_MATRIX(fn) \
+    BENCHMARK_TEMPLATE(fn, HeterogeneousContainer); \
+    BENCHMARK_TEMPLATE(fn, HeterogeneousContainer_SparseSet); \
+    BENCHMARK_TEMPLATE(fn, stable_map_container); \
+    BENCHMARK_TEMPLATE(fn, stable_map_stable_id); \
+    BENCHMARK_TEMPLATE(fn, stable_flat); \
+    BENCHMARK_TEMPLATE(fn, HeterogeneousContainer_SparseSet2); \
+    BENCHMARK_TEMPLATE(fn, contiguous_map_container); \
+    BENCHMARK_TEMPLATE(fn, contiguous_map_pmr); \
+    BENCHMARK_TEMPLATE(fn, contiguous_flat); \
+    BENCHMARK_TEMPLATE(fn, contiguous_sparse); \
+    BENCHMARK_TEMPLATE(fn, portable_container); \
+    BENCHMARK_TEMPLATE(fn, fixed)
+
+HECO_BENCHMARK_MATRIX(insert);
+HECO_BENCHMARK_MATRIX(get);
+HECO_BENCHMARK_MATRIX(for_each);
+BENCHMARK_TEMPLATE(insert, HeterogeneousArray);
+BENCHMARK_TEMPLATE(get, HeterogeneousArray);
+BENCHMARK_TEMPLATE(for_each, HeterogeneousArray);
+
+BENCHMARK_MAIN();
@@ -1,9 +1,16 @@
 ﻿#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <fstream>
+#include <map>
 
 #undef NDEBUG
 #define protected public
 #define private   public
 #include <heco_1_map_array.h>
+#include <heco_1_map_archetype.h>
+#include <heco_1_map_mapped.h>
+#include <heco_1_map_shm.h>
+#include <heco_stats.h>
 #undef protected
 #undef private
 
@@ -379,6 +386,709 @@ TEST(HeterogeneousArray, reserve_construct)
     EXPECT_EQ(b.b, 42);
 }
 
+TEST(HeterogeneousArray, visit)
+{
+    HeterogeneousArray container;
+    container.insert(char{ 'a' }, double{ 1.5 }, int{ 3 });
+    struct empty {};
+    container.insert(empty{});
+    container.insert(A{ 7 });
+    std::vector<std::uintptr_t> addresses;
+    double sum = 0;
+    int n_char = 0;
+    container.visit([&](auto& x) {
+        addresses.push_back(std::uintptr_t(&x));
+        using T = std::remove_reference_t<decltype(x)>;
+        if constexpr (std::is_same_v<T, A>) sum += x.x;
+        else if constexpr (std::is_same_v<T, char>) ++n_char;
+        else if constexpr (std::is_same_v<T, empty>) FAIL();
+        else sum += x;
+    }, type_list<int, double, char, A, empty>{});
+    EXPECT_EQ(addresses.size(), 4);
+    EXPECT_TRUE(std::is_sorted(addresses.begin(), addresses.end()));
+    EXPECT_EQ(sum, 1.5 + 3 + 7);
+    EXPECT_EQ(n_char, 1);
+    //↓ types outside of the candidates are skipped
+    int n = 0;
+    static_cast<const HeterogeneousArray&>(container).visit([&](const auto&) { ++n; }, type_list<double>{});
+    EXPECT_EQ(n, 1);
+    container.destruct<double>();
+    n = 0;
+    container.for_each([&](type_id_t, void*) { ++n; });
+    EXPECT_EQ(n, 3);
+    //↓ the order follows destructions and relayouts
+    container.hot<A>();
+    container.relayout();
+    addresses.clear();
+    container.for_each([&](type_id_t, void* p) { addresses.push_back(std::uintptr_t(p)); });
+    EXPECT_EQ(addresses.size(), 3);
+    EXPECT_TRUE(std::is_sorted(addresses.begin(), addresses.end()));
+    EXPECT_EQ(addresses.front(), std::uintptr_t(&container.get<A>()));
+}
+
+TEST(HeterogeneousArray, clone_equal_hash)
+{
+    {// trivially copyable only
+        HeterogeneousArray a;
+        a.insert(char{ 'a' }, double{ 1.5 }, int{ 3 });
+        HeterogeneousArray b = a.clone();
+        EXPECT_EQ(b.non_trivially_copyable, 0);
+        EXPECT_EQ(b.data.size(), a.data.size());
+        EXPECT_TRUE(a == b);
+        EXPECT_EQ(a.hash(), b.hash());
+        b.get<double>() = 2.5;
+        EXPECT_EQ(a.get<double>(), 1.5);
+        EXPECT_TRUE(a != b);
+    }
+    {// with non-trivial types
+        using vec = std::vector<int>;
+        HeterogeneousArray a;
+        a.insert(vec{ 5, 25 });
+        a.insert(42);
+        struct empty {};
+        a.insert(empty{});
+        HeterogeneousArray b = a.clone();
+        EXPECT_EQ(b.non_trivially_copyable, 1);
+        EXPECT_NE(b.get<vec>().data(), a.get<vec>().data());
+        EXPECT_TRUE(a == b);
+        EXPECT_EQ(a.hash(), b.hash());
+        b.get<vec>().push_back(3);
+        EXPECT_TRUE(a != b);
+        b.destruct<vec>();
+        EXPECT_EQ(b.non_trivially_copyable, 0);
+        EXPECT_TRUE(a != b);
+    }
+    {// unsupported operations
+        HeterogeneousArray a;
+        a.insert(std::make_unique<int>(4));
+        EXPECT_THROW(a.clone(), std::logic_error);
+        a.clear();
+        a.insert(A{ 1 });
+        EXPECT_THROW(a.hash(), std::logic_error);
+        EXPECT_THROW((void)(a == a), std::logic_error);
+    }
+}
+
+TEST(HeterogeneousArray, save_and_map)
+{
+    struct point { double x, y; };
+    struct empty {};
+    const std::string path = ::testing::TempDir() + "heco_save_and_map.bin";
+    {
+        HeterogeneousArray container;
+        container.insert(char{ 'a' }, double{ 1.5 }, int{ 3 });
+        container.insert(point{ 4, 2 });
+        container.insert(empty{});
+        container.save(path);
+    }
+    {
+        auto mapped = MappedHeterogeneousArray::map(path);
+        EXPECT_EQ(mapped.size(), 5);
+        EXPECT_TRUE((mapped.contains<char, double, int, point, empty>()));
+        EXPECT_FALSE(mapped.contains<float>());
+        EXPECT_EQ(mapped.get<int>(), 3);
+        EXPECT_EQ(mapped.get<const point>().y, 2);
+        auto&& [c, d] = mapped.get<char, double>();
+        static_assert(std::is_same_v<decltype(d), const double&>);
+        EXPECT_EQ(c, 'a');
+        EXPECT_EQ(d, 1.5);
+        EXPECT_EQ(std::uintptr_t(&d) % alignof(double), 0);
+        EXPECT_EQ(mapped.has<float>(), nullptr);
+        EXPECT_TRUE(mapped.has<empty>());
+        EXPECT_THROW(mapped.get<float>(), std::out_of_range);
+        EXPECT_THROW(mapped.get_mutable<int>(), std::logic_error);
+    }
+    {
+        auto mapped = MappedHeterogeneousArray::map(path, MappedHeterogeneousArray::mode::copy_on_write);
+        mapped.get_mutable<int>() = 42;
+        EXPECT_EQ(mapped.get<int>(), 42);
+        //↓ modifications do not reach the file
+        EXPECT_EQ(MappedHeterogeneousArray::map(path).get<int>(), 3);
+    }
+    {
+        HeterogeneousArray container;
+        container.insert(std::vector<int>{});
+        EXPECT_THROW(container.save(path), std::logic_error);
+    }
+    EXPECT_THROW(MappedHeterogeneousArray::map(path + ".missing"), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(HeterogeneousArray, save_deterministic_and_map_invalid)
+{
+    const std::string path = ::testing::TempDir() + "heco_save_invalid.bin";
+    {
+        HeterogeneousArray container;
+        container.insert(int{ 0x5a5a5a5a }, double{ 1.5 });
+        const auto off = container.offset_of<int>()[0];
+        container.destruct<int>();
+        container.save(path);
+        //↓ the bytes of the destructed int are saved as zeros
+        std::ifstream file(path, std::ios::binary);
+        snapshot_header header{};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        file.seekg(std::streamoff(header.data_offset + off));
+        int saved = -1;
+        file.read(reinterpret_cast<char*>(&saved), sizeof(saved));
+        EXPECT_EQ(saved, 0);
+    }
+    {
+        //↓ data_offset + data_size wraps around and must not pass for a size within the file
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        snapshot_header header{};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        header.data_size = std::uint64_t(0) - header.data_offset;
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    EXPECT_THROW(MappedHeterogeneousArray::map(path), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(HeterogeneousArray, shared_memory)
+{
+    struct point { double x, y; };
+    const std::string name = "/heco_test_" + std::to_string(::getpid());
+    auto shm = SharedHeterogeneousArray::create(name, 1024, 4);
+    EXPECT_THROW(SharedHeterogeneousArray::create(name, 1024, 4), std::runtime_error);
+    shm.insert<int>(3);
+    shm.insert<point>(4., 2.);
+    EXPECT_EQ(shm.size(), 2);
+    EXPECT_EQ(shm.used(), 24);
+    EXPECT_TRUE((shm.contains<int, point>()));
+    EXPECT_FALSE(shm.contains<char>());
+    EXPECT_EQ(shm.has<char>(), nullptr);
+    EXPECT_THROW(shm.get<char>(), std::out_of_range);
+    EXPECT_THROW(shm.insert<int>(5), std::logic_error);
+    EXPECT_EQ(shm.get<int>(), 3);
+
+    const pid_t child = ::fork();
+    if (child == 0) {
+        //↓ another process sees the objects and the modifications of the writer
+        auto reader = SharedHeterogeneousArray::open(name);
+        bool ok = reader.get<point>().y == 2;
+        const volatile int& i = reader.get<int>();
+        while (i != 4) {}
+        try { reader.get_mutable<int>(); ok = false; } catch (const std::logic_error&) {}
+        ::_exit(ok ? 0 : 1);
+    }
+    shm.get_mutable<int>() = 4;
+    int status = 0;
+    ASSERT_EQ(::waitpid(child, &status, 0), child);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+
+    auto writer = SharedHeterogeneousArray::open(name, SharedHeterogeneousArray::access::read_write);
+    writer.insert<char>('a');
+    EXPECT_EQ(shm.get<char>(), 'a');
+    writer.insert<float>(1.f);
+    EXPECT_THROW(writer.insert<double>(1.), std::length_error);
+    SharedHeterogeneousArray::remove(name);
+    EXPECT_THROW(SharedHeterogeneousArray::open(name), std::runtime_error);
+    EXPECT_EQ(shm.get<float>(), 1.f);//< still mapped
+
+    //↓ a layout mismatch is reported by has as by get
+    const_cast<SharedHeterogeneousArray::slot_t*>(shm.find(stable_type_id<float>()))->size = 8;
+    EXPECT_THROW(shm.has<float>(), std::runtime_error);
+    EXPECT_THROW(shm.get<float>(), std::runtime_error);
+}
+
+TEST(HeterogeneousArray, shared_memory_invalid)
+{
+    const std::string name = "/heco_test_invalid_" + std::to_string(::getpid());
+    auto shm = SharedHeterogeneousArray::create(name, 1024, 4);
+    auto& h = shm.header();
+    for (std::uint32_t n_slots : { 0u, 12u, 4u }) {//< none, not a power of two, no empty slot
+        h.n_slots = n_slots;
+        EXPECT_THROW(SharedHeterogeneousArray::open(name), std::runtime_error);
+    }
+    h.n_slots = 8;
+    h.capacity = std::uint64_t(-1);//< data_offset + capacity wraps around
+    EXPECT_THROW(SharedHeterogeneousArray::open(name), std::runtime_error);
+    h.capacity = 1024;
+    EXPECT_NO_THROW(SharedHeterogeneousArray::open(name));
+    SharedHeterogeneousArray::remove(name);
+}
+
+TEST(HeterogeneousArray, stats)
+{
+    struct empty {};
+    HeterogeneousArray container;
+    container.insert(char{ 'a' });
+    container.insert(double{ 1.5 });
+    container.insert(int{ 3 });
+    container.insert(empty{});
+    auto s = container.stats();
+    EXPECT_EQ(s.container, "HeterogeneousArray");
+    EXPECT_EQ(s.objects, 4);
+    EXPECT_EQ(s.object_bytes, sizeof(char) + sizeof(double) + sizeof(int));
+    EXPECT_EQ(s.padding_bytes, 7);
+    EXPECT_EQ(s.dead_bytes, 0);
+    EXPECT_EQ(s.object_bytes + s.padding_bytes + s.spare_bytes, container.data.capacity());
+    EXPECT_EQ(s.table_entries, 8);
+    EXPECT_GT(s.load_factor(), 0.);
+    ASSERT_EQ(s.types.size(), 4);
+    for (auto& t : s.types) {
+        if (t.id == type_id<double>()) {
+            EXPECT_TRUE(t.size == 8 && t.alignment == alignof(double) && t.bytes == 8);
+        }
+    }
+
+    container.destruct<double>();
+    s = container.stats();
+    EXPECT_EQ(s.objects, 3);
+    EXPECT_EQ(s.dead_bytes, sizeof(double));
+    {
+        HeterogeneousArray other;
+        other.insert(int{ 1 }, char{ 'b' });
+        auto registration = stats_registry::global().track(container, "container");
+        auto registration_other = stats_registry::global().track(other, "other");
+        const auto entries = stats_registry::global().collect();
+        ASSERT_EQ(entries.size(), 2);
+        EXPECT_EQ(entries[0].label, "container");
+        EXPECT_EQ(entries[1].stats.objects, 2);
+        const auto total = stats_registry::global().total();
+        EXPECT_EQ(total.objects, 5);
+        EXPECT_EQ(total.types.size(), 3);
+        for (auto& t : total.types) {
+            if (t.id == type_id<int>()) {
+                EXPECT_EQ(t.objects, 2);
+            }
+        }
+    }
+    EXPECT_EQ(stats_registry::global().size(), 0);
+
+    auto moved = std::move(container);
+    EXPECT_EQ(container.stats().padding_bytes, 0);
+    EXPECT_EQ(moved.stats().padding_bytes, 7);
+}
+
+struct counting_observer : null_observer
+{
+    static inline std::map<std::string, std::size_t> calls;
+    static inline std::vector<type_id_t> growth_triggers;
+    static void on_insert(type_id_t) { ++calls["insert"]; }
+    static void on_construct(type_id_t, const void*) { ++calls["construct"]; }
+    static void on_assign(type_id_t, const void*) { ++calls["assign"]; }
+    static void on_get_miss(type_id_t) { ++calls["miss"]; }
+    static void on_destruct(type_id_t, const void*) { ++calls["destruct"]; }
+    static void on_grow(type_id_t trigger, std::size_t, std::size_t) { growth_triggers.push_back(trigger); }
+    static void on_rehash(std::size_t, std::size_t) { ++calls["rehash"]; }
+};
+static_assert(sizeof(BasicHeterogeneousArray<counting_observer>) == sizeof(HeterogeneousArray));
+
+TEST(HeterogeneousArray, observer)
+{
+    struct empty {};
+    counting_observer::calls.clear();
+    counting_observer::growth_triggers.clear();
+    {
+        BasicHeterogeneousArray<counting_observer> container;
+        container.insert(int{ 1 }, double{ 2 });
+        container.insert(empty{});
+        container.assign(int{ 3 });
+        EXPECT_EQ(container.has<char>(), nullptr);
+        EXPECT_THROW(container.get<char>(), std::out_of_range);
+        container.insert(std::string("abc"));
+        container.destruct<int>();
+        EXPECT_EQ(counting_observer::calls["destruct"], 1);
+    }
+    auto& calls = counting_observer::calls;
+    EXPECT_EQ(calls["insert"], 4);
+    EXPECT_EQ(calls["construct"], 4);
+    EXPECT_EQ(calls["assign"], 1);
+    EXPECT_EQ(calls["miss"], 2);
+    EXPECT_EQ(calls["destruct"], 4);
+    EXPECT_GT(calls["rehash"], 0);
+    ASSERT_FALSE(counting_observer::growth_triggers.empty());
+    EXPECT_EQ(counting_observer::growth_triggers[0], type_id<int>());
+}
+
+TEST(HeterogeneousArray, relayout)
+{
+    struct config { char blob[200]; };
+    struct position { float x, y, z; };
+    struct velocity { float x, y, z; };
+    struct flag { bool on; };
+    HeterogeneousArray container;
+    container.insert(config{}, position{ 1, 2, 3 });
+    container.insert(std::string("cold"));
+    container.insert(velocity{ 4, 5, 6 });
+    container.insert(flag{ true });
+    container.insert(int{ 42 });
+    container.destruct<int>();
+
+    container.count_accesses();
+    for (int i = 0; i < 10; ++i)
+        container.get<position, velocity>();
+    container.get<config>();
+    EXPECT_EQ(container.accesses<position>(), 10);
+    EXPECT_EQ(container.accesses<config>(), 1);
+    EXPECT_EQ(container.accesses<flag>(), 0);
+    container.hot<flag>();
+    container.cold<std::string>();
+
+    const size_t hot = container.relayout({ 2 });
+    EXPECT_EQ(hot, 64);
+    EXPECT_EQ(container.accesses<position>(), 0);
+    EXPECT_LT(container.offset_of<position>()[0], hot);
+    EXPECT_LT(container.offset_of<velocity>()[0], hot);
+    EXPECT_LT(container.offset_of<flag>()[0], hot);
+    EXPECT_GE(container.offset_of<config>()[0], hot);
+    EXPECT_GT(container.offset_of<std::string>()[0], container.offset_of<config>()[0]);
+    EXPECT_FALSE(container.is_allocated<int>());
+    EXPECT_EQ(container.get<position>().y, 2);
+    EXPECT_EQ(container.get<velocity>().z, 6);
+    EXPECT_TRUE(container.get<flag>().on);
+    EXPECT_EQ(container.get<std::string>(), "cold");
+    const auto s = container.stats();
+    EXPECT_EQ(s.dead_bytes, 0);
+    EXPECT_EQ(s.padding_bytes + s.object_bytes, container.data.size());
+
+    container.count_accesses(false);
+    container.get<position>();
+    EXPECT_EQ(container.accesses<position>(), 0);
+}
+
+//Copyable type whose move may throw, counting live instances and failing on a chosen copy
+template<int N>
+struct fragile
+{
+    static inline int copies_left = 0, alive = 0;
+    std::string s;
+    explicit fragile(std::string s) : s(std::move(s)) { ++alive; }
+    fragile(const fragile& other) : s(other.s) {
+        if (copies_left-- == 0)
+            throw std::runtime_error("copy");
+        ++alive;
+    }
+    fragile(fragile&& other) : s(std::move(other.s)) { ++alive; }
+    fragile& operator=(const fragile&) = default;
+    ~fragile() { --alive; }
+};
+
+TEST(HeterogeneousArray, relayout_throwing_copy)
+{
+    {
+        HeterogeneousArray container;
+        container.insert(fragile<0>{ "a" }, fragile<1>{ "b" }, std::string("c"));
+        container.cold<fragile<0>>();
+        const auto before = container.offset_of<fragile<0>, fragile<1>, std::string>();
+        //↓ fragile<1> is copied first, then the copy of the cold fragile<0> throws
+        fragile<1>::copies_left = 1;
+        fragile<0>::copies_left = 0;
+        EXPECT_THROW(container.relayout(), std::runtime_error);
+        //↓ nothing moved nor destroyed
+        EXPECT_EQ((container.offset_of<fragile<0>, fragile<1>, std::string>()), before);
+        EXPECT_EQ(container.get<fragile<0>>().s, "a");
+        EXPECT_EQ(container.get<fragile<1>>().s, "b");
+        EXPECT_EQ(container.get<std::string>(), "c");
+        EXPECT_EQ(fragile<0>::alive, 1);
+        EXPECT_EQ(fragile<1>::alive, 1);
+
+        fragile<0>::copies_left = fragile<1>::copies_left = 1;
+        container.relayout();
+        EXPECT_EQ(container.get<fragile<0>>().s, "a");
+        EXPECT_EQ(container.get<fragile<1>>().s, "b");
+        EXPECT_GT(container.offset_of<fragile<0>>()[0], container.offset_of<fragile<1>>()[0]);
+        EXPECT_EQ(fragile<0>::alive, 1);
+        EXPECT_EQ(fragile<1>::alive, 1);
+    }
+    EXPECT_EQ(fragile<0>::alive, 0);
+    EXPECT_EQ(fragile<1>::alive, 0);
+}
+
+template<int I>
+struct thread_counter { std::uint64_t n; };
+
+TEST(HeterogeneousArray, isolation)
+{
+    HeterogeneousArray container;
+    container.isolate<thread_counter<0>, thread_counter<1>>();
+    container.isolate<thread_counter<2>>(isolation::line_pair);
+    container.insert(char{ 'a' });
+    container.insert(thread_counter<0>{ 1 }, thread_counter<1>{ 2 });
+    container.insert(thread_counter<2>{ 3 });
+    container.insert(int{ 4 });
+
+    auto check = [&] {
+        const auto line = [](const void* p) { return std::uintptr_t(p) / cache_line_size; };
+        auto&& [c, t0, t1, t2, i] = container.get<char, thread_counter<0>, thread_counter<1>, thread_counter<2>, int>();
+        EXPECT_EQ(std::uintptr_t(&t0) % cache_line_size, 0);
+        EXPECT_EQ(std::uintptr_t(&t1) % cache_line_size, 0);
+        EXPECT_EQ(std::uintptr_t(&t2) % cache_line_size, 0);
+        EXPECT_NE(line(&c), line(&t0));
+        EXPECT_NE(line(&t0), line(&t1));
+        EXPECT_NE(line(&i), line(&t1));
+        //↓ no neighbour within the aligned pair of lines of t2, nor in the lines next to it
+        for (const void* p : { (const void*)&c, (const void*)&t0, (const void*)&t1, (const void*)&i }) {
+            EXPECT_NE(line(p) / 2, line(&t2) / 2);
+            EXPECT_GT(std::max(line(p), line(&t2)) - std::min(line(p), line(&t2)), 1);
+        }
+        EXPECT_EQ(t0.n + t1.n + t2.n, 6);
+    };
+    check();
+    auto s = container.stats();
+    EXPECT_EQ(s.padding_bytes, 0);
+    EXPECT_EQ(s.isolation_bytes, (128 - 1 - 8) + (192 - 128 - 8) + (384 - 192 - 8));
+    EXPECT_EQ(s.object_bytes + s.padding_bytes + s.isolation_bytes, container.data.size());
+
+    container.relayout();
+    check();
+    s = container.stats();
+    EXPECT_GT(s.isolation_bytes, 0);
+    EXPECT_EQ(s.object_bytes + s.padding_bytes + s.isolation_bytes, container.data.size());
+
+    HeterogeneousArray all;
+    all.isolate_all();
+    all.insert(char{ 'a' }, int{ 1 });
+    EXPECT_EQ(all.data.size(), 2 * cache_line_size);
+}
+
+TEST(HeterogeneousArray, isolation_over_aligned)
+{
+    struct alignas(128) wide_counter { std::uint64_t n; };
+    HeterogeneousArray container;
+    container.isolate<wide_counter>(isolation::line_pair);
+    container.isolate<thread_counter<0>>();
+    container.insert(char{ 'a' });
+    container.insert(wide_counter{ 1 });
+    container.insert(thread_counter<0>{ 2 });
+
+    auto check = [&] {
+        const auto line = [](const void* p) { return std::uintptr_t(p) / cache_line_size; };
+        auto&& [c, w, t0] = container.get<char, wide_counter, thread_counter<0>>();
+        EXPECT_EQ(std::uintptr_t(&w) % alignof(wide_counter), 0);
+        EXPECT_EQ(std::uintptr_t(&t0) % cache_line_size, 0);
+        //↓ the guard lines of w stay free whatever its alignment
+        for (const void* p : { (const void*)&c, (const void*)&t0 })
+            EXPECT_GT(std::max(line(p), line(&w)) - std::min(line(p), line(&w)), 1);
+        EXPECT_EQ(w.n + t0.n, 3);
+    };
+    check();
+    container.relayout();
+    check();
+}
+
+TEST(HeterogeneousArray, over_aligned)
+{
+    struct alignas(32) avx { float v[8]; };
+    struct alignas(128) padded { int v; };
+    struct alignas(4096) page { char bytes[4096]; };
+    struct alignas(256) block { int v; };
+    AlignedHeterogeneousArray<16> container;
+    container.insert(char{ 'a' });
+    container.insert(avx{ { 1, 2, 3, 4, 5, 6, 7, 8 } });
+    container.insert(padded{ 42 });
+    container.insert(std::vector<int>{ 1, 2, 3 });
+    container.insert(page{ { 'p' } });
+    container.insert(block{ 7 }, double{ 1.5 });
+    container.emplace(*type_ops_of<std::array<double, 9>>());
+
+    auto check = [](auto& c) {
+        auto&& [a, v, p, pg, b, d] = c.template get<avx, std::vector<int>, padded, page, block, double>();
+        EXPECT_EQ(std::uintptr_t(&a) % 32, 0);
+        EXPECT_EQ(std::uintptr_t(&p) % 128, 0);
+        EXPECT_EQ(std::uintptr_t(&pg) % 4096, 0);
+        EXPECT_EQ(std::uintptr_t(&b) % 256, 0);
+        EXPECT_EQ(a.v[7], 8);
+        EXPECT_EQ(v, (std::vector<int>{ 1, 2, 3 }));
+        EXPECT_EQ(p.v, 42);
+        EXPECT_EQ(pg.bytes[0], 'p');
+        EXPECT_EQ(b.v, 7);
+        EXPECT_EQ(d, 1.5);
+        EXPECT_EQ(c.template get<char>(), 'a');
+    };
+    check(container);
+    EXPECT_EQ(container.data.alignment(), 4096);
+    container.reserve(1 << 16);
+    check(container);
+    auto copy = container.clone();
+    check(copy);
+    auto moved = std::move(copy);
+    check(moved);
+    const auto s = container.stats();
+    EXPECT_EQ(s.padding_bytes - container.padding_bytes, 4096 - 16);
+}
+
+TEST(HeterogeneousArray, over_aligned_isolated)
+{
+    struct alignas(128) padded { int v; };
+    struct alignas(256) block { int v; };
+    for (const isolation level : { isolation::none, isolation::cache_line, isolation::line_pair }) {
+        HeterogeneousArray container;
+        container.isolate_all(level);
+        container.insert(char{ 'a' });
+        container.insert(padded{ 1 });
+        container.insert(int{ 2 });
+        container.insert(block{ 3 }, double{ 4.5 });
+
+        auto check = [&] {
+            auto&& [c, p, i, b, d] = container.get<char, padded, int, block, double>();
+            EXPECT_EQ(std::uintptr_t(&p) % 128, 0);
+            EXPECT_EQ(std::uintptr_t(&b) % 256, 0);
+            EXPECT_EQ(c + p.v + i + b.v + d, 'a' + 10.5);
+        };
+        check();
+        container.relayout();
+        check();
+        container.relayout({ 2 });
+        check();
+    }
+}
+
+TEST(HeterogeneousArray, layout_table)
+{
+    struct alignas(16) v4 { float x[4]; };
+    struct odd { char c[3]; };
+    auto check = [](auto... values) {
+        for (size_t residue = 0; residue < 64; ++residue) {
+            HeterogeneousArray greedy, table;
+            greedy.data.resize(residue);
+            table.data.resize(residue);
+            EXPECT_EQ(greedy.do_allocate_n_greedy<decltype(values)...>(), table.do_allocate_n<decltype(values)...>());
+            EXPECT_EQ(greedy.data.size(), table.data.size());
+            EXPECT_EQ(greedy.padding_bytes, table.padding_bytes);
+        }
+    };
+    check(char{}, double{}, int{}, short{});
+    check(odd{}, v4{}, char{}, std::uint64_t{}, short{}, float{});
+    static_assert(layout_table<char, double, int>[1].offsets[1] == 7);
+    static_assert(layout_table<char, double, int>[1].size == 15);
+}
+
+static_assert(sizeof(ArchetypeArray) == sizeof(void*));
+
+TEST(ArchetypeArray, insert_get)
+{
+    ArchetypeArray array;
+    EXPECT_TRUE(array.empty());
+    array.insert(A{ 1, 'a' });
+    array.insert<std::string>("hello");
+    auto&& [i, c] = array.insert(2, C{ 3 });
+    EXPECT_EQ(i, 2);
+    EXPECT_EQ(c.v, 3);
+    EXPECT_EQ(array.size(), 4u);
+    EXPECT_EQ(array.get<A>().c, 'a');
+    EXPECT_EQ(array.get<std::string>(), "hello");
+    EXPECT_TRUE((array.contains<A, int, C>()));
+    EXPECT_EQ(array.has<double>(), nullptr);
+    EXPECT_THROW(array.get<double>(), std::out_of_range);
+    EXPECT_EQ(array.insert_or_assign(5), 5);
+    EXPECT_EQ(std::as_const(array).get<int>(), 5);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&array.get<C>()) % alignof(C), 0u);
+    //↓ a stored type is rejected, leaving the array as it was
+    EXPECT_THROW(array.insert(6), std::logic_error);
+    EXPECT_THROW(array.insert(1., std::string("again")), std::logic_error);
+    EXPECT_EQ(array.size(), 4u);
+    EXPECT_FALSE(array.contains<double>());
+    EXPECT_EQ(array.get<int>(), 5);
+    EXPECT_EQ(array.get<std::string>(), "hello");
+}
+
+TEST(ArchetypeArray, shared_schema)
+{
+    std::vector<ArchetypeArray> entities(100);
+    for (auto& e : entities)
+        e.insert(1, 2.);
+    for (auto& e : entities)
+        EXPECT_EQ(&e.schema(), &entities[0].schema());
+    ArchetypeArray reordered;
+    reordered.insert(3.);
+    reordered.insert(4);
+    EXPECT_EQ(&reordered.schema(), &entities[0].schema());
+
+    //transitions are cached both ways
+    const archetype* with_double = &reordered.schema();
+    reordered.destruct<int>();
+    const archetype* without_int = &reordered.schema();
+    reordered.insert(4);
+    EXPECT_EQ(&reordered.schema(), with_double);
+    reordered.destruct<int>();
+    EXPECT_EQ(&reordered.schema(), without_int);
+
+    const container_stats s = entities[0].stats();
+    EXPECT_EQ(s.objects, 2u);
+    EXPECT_EQ(s.index_bytes, sizeof(void*));
+    EXPECT_EQ(s.bytes(), sizeof(void*) + sizeof(double) + sizeof(int) + s.padding_bytes);
+    EXPECT_LT(s.padding_bytes, alignof(double));
+}
+
+TEST(ArchetypeArray, destruct_relocates)
+{
+    static int alive = 0;
+    struct Counted {
+        std::string s;
+        Counted(std::string s) : s(std::move(s)) { ++alive; }
+        Counted(const Counted& o) : s(o.s) { ++alive; }
+        Counted(Counted&& o) noexcept : s(std::move(o.s)) { ++alive; }
+        ~Counted() { --alive; }
+        bool operator==(const Counted& o) const { return s == o.s; }
+    };
+    {
+        ArchetypeArray array;
+        array.insert(Counted{ std::string(64, 'x') }, 1);
+        array.insert(std::vector<int>{ 1, 2 });
+        EXPECT_EQ(alive, 1);
+        array.destruct<int, double>();
+        EXPECT_EQ(array.get<Counted>().s, std::string(64, 'x'));
+        EXPECT_EQ(array.get<std::vector<int>>().size(), 2u);
+        EXPECT_FALSE(array.contains<int>());
+
+        ArchetypeArray copy = array.clone();
+        EXPECT_EQ(alive, 2);
+        EXPECT_TRUE(copy == array);
+        copy.get<std::vector<int>>().push_back(3);
+        EXPECT_TRUE(copy != array);
+
+        ArchetypeArray moved = std::move(copy);
+        EXPECT_TRUE(copy.empty());
+        array.destruct<Counted, std::vector<int>>();
+        EXPECT_TRUE(array.empty());
+        EXPECT_EQ(alive, 1);
+    }
+    EXPECT_EQ(alive, 0);
+}
+
+TEST(ArchetypeArray, visit)
+{
+    ArchetypeArray array;
+    array.insert(1, 2.5f, A{});
+    float sum = 0;
+    array.visit([&](auto& v) { sum += v; }, type_list<int, float>{});
+    EXPECT_EQ(sum, 3.5f);
+    array.destruct<A>();
+    EXPECT_EQ(array.clone().hash(), array.hash());
+}
+
+struct Shape { virtual ~Shape() = default; virtual double area() const = 0; };
+struct Square : Shape { double side; explicit Square(double s) : side(s) {} double area() const override { return side * side; } };
+struct Tag { int tag = 7; };
+struct TaggedSquare : Tag, Square { using Square::Square; };
+template<> struct heco::bases_of<Square> { using type = heco::type_list<Shape>; };
+template<> struct heco::bases_of<TaggedSquare> { using type = heco::type_list<Shape, Tag>; };
+
+TEST(HeterogeneousArray, for_each_base)
+{
+    HeterogeneousArray container;
+    container.insert(Square{ 2 }, int{ 1 }, TaggedSquare{ 3 });
+    double area = 0;
+    std::vector<std::uintptr_t> addresses;
+    container.for_each<Shape>([&](Shape& s) { area += s.area(); addresses.push_back(std::uintptr_t(&s)); });
+    EXPECT_EQ(area, 4 + 9);
+    EXPECT_TRUE(std::is_sorted(addresses.begin(), addresses.end()));
+    int tags = 0;
+    static_cast<const HeterogeneousArray&>(container).for_each<Tag>([&](const Tag& t) { tags += t.tag; });
+    EXPECT_EQ(tags, 7);
+    int as_square = 0, as_shape = 0;
+    static_cast<const HeterogeneousArray&>(container).for_each<Shape>([&](auto& s) {
+        if constexpr (std::is_same_v<std::remove_reference_t<decltype(s)>, const Square>) ++as_square;
+        else ++as_shape;
+    }, type_list<Square>{});
+    EXPECT_EQ(as_square, 1);
+    EXPECT_EQ(as_shape, 1);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -7,8 +7,36 @@
 #undef protected
 #undef private
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <mutex>
+#include <new>
+#include <thread>
+
 using namespace heco;
 
+//Every allocation of the test program, to check that steady workloads allocate nothing.
+//Not inlined, so that GCC does not see free called on memory from operator new.
+#if defined(__GNUC__)
+#define HECO_NOINLINE __attribute__((noinline))
+#else
+#define HECO_NOINLINE
+#endif
+static std::atomic<std::size_t> allocations{ 0 };
+
+HECO_NOINLINE void* operator new(std::size_t n)
+{
+    ++allocations;
+    if (void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+HECO_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+HECO_NOINLINE void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
 struct A
 {
     int x;
@@ -274,6 +302,536 @@ TEST(HeterogeneousContainer, destruction)
     EXPECT_EQ(test_mv_dtor::destroyed, true);
 }
 
+TEST(HeterogeneousContainer, visit)
+{
+    HeterogeneousContainer container;
+    container.insert(char{ 'a' }, double{ 1.5 }, int{ 3 });
+    container.insert(std::vector<int>{ 1, 2 });
+    double sum = 0;
+    int n = 0;
+    container.visit([&](auto& x) {
+        using T = std::remove_reference_t<decltype(x)>;
+        if constexpr (std::is_same_v<T, std::vector<int>>) sum += x.size();
+        else sum += x;
+        ++n;
+    }, type_list<int, double, std::vector<int>>{});
+    EXPECT_EQ(n, 3);
+    EXPECT_EQ(sum, 1.5 + 3 + 2);
+    n = 0;
+    static_cast<const HeterogeneousContainer&>(container).for_each([&](type_id_t, const void*) { ++n; });
+    EXPECT_EQ(n, 4);
+}
+
+TEST(HeterogeneousContainer, clone_equal_hash)
+{
+    using vec = std::vector<int>;
+    HeterogeneousContainer a;
+    a.insert(vec{ 5, 25 }, 42, std::string("heco"));
+    HeterogeneousContainer b = a.clone();
+    EXPECT_NE(&b.get<vec>(), &a.get<vec>());
+    EXPECT_TRUE(a == b);
+    EXPECT_EQ(a.hash(), b.hash());
+    b.get<std::string>() += "!";
+    EXPECT_TRUE(a != b);
+    EXPECT_EQ(a.get<std::string>(), "heco");
+    a.insert(std::make_unique<int>(4));
+    EXPECT_THROW(a.clone(), std::logic_error);
+}
+
+template<int I>
+struct tag { int v; };
+
+template<int... Is>
+void insert_tags(HeterogeneousContainer& c, std::integer_sequence<int, Is...>) { c.insert(tag<Is>{ Is }...); }
+
+TEST(HeterogeneousContainer, stats)
+{
+    HeterogeneousContainer container;
+    container.insert(C{ 1 }, std::vector<int>{ 1, 2, 3 });
+    auto s = container.stats();
+    EXPECT_EQ(s.container, "HeterogeneousContainer");
+    EXPECT_EQ(s.objects, 2);
+    EXPECT_EQ(s.object_bytes, sizeof(C) + sizeof(std::vector<int>));
+    EXPECT_EQ(s.padding_bytes + s.dead_bytes + s.spare_bytes, 0);
+    EXPECT_EQ(s.table_entries, 2);
+    ASSERT_EQ(s.types.size(), 2);
+
+    insert_tags(container, std::make_integer_sequence<int, 64>{});
+    s = container.stats();
+    EXPECT_EQ(s.objects, 66);
+    EXPECT_GT(s.rehashes, 0);
+    EXPECT_EQ(s.buckets, container.data.bucket_count());
+}
+
+struct counting_observer : null_observer
+{
+    static inline std::size_t inserts = 0, assigns = 0, misses = 0, destructs = 0;
+    static void on_insert(type_id_t) { ++inserts; }
+    static void on_assign(type_id_t, const void*) { ++assigns; }
+    static void on_get_miss(type_id_t) { ++misses; }
+    static void on_destruct(type_id_t, const void*) { ++destructs; }
+};
+
+TEST(HeterogeneousContainer, observer)
+{
+    {
+        BasicHeterogeneousContainer<counting_observer> container;
+        container.insert(C{ 1 }, 42);
+        container.insert_or_assign(43);
+        EXPECT_EQ(container.has<A>(), nullptr);
+        EXPECT_EQ(container.get<int>(), 43);
+    }
+    EXPECT_EQ(counting_observer::inserts, 2);
+    EXPECT_EQ(counting_observer::assigns, 1);
+    EXPECT_EQ(counting_observer::misses, 1);
+    EXPECT_EQ(counting_observer::destructs, 2);
+}
+
+struct service { std::string name; int calls = 0; };
+
+TEST(HeterogeneousContainer, insert_lazy)
+{
+    HeterogeneousContainer container;
+    int built = 0;
+    EXPECT_TRUE(container.insert_lazy<service>([&] { ++built; return service{ "db" }; }));
+    EXPECT_FALSE(container.insert_lazy<service>([] { return service{ "other" }; }));
+    container.insert(42);
+    EXPECT_FALSE(container.insert_lazy<int>([] { return 0; }));
+    EXPECT_TRUE((container.contains<service, int>()));
+    EXPECT_EQ(built, 0);
+
+    //↓ not visible before its construction
+    int seen = 0;
+    container.for_each([&](type_id_t, void*) { ++seen; });
+    EXPECT_EQ(seen, 1);
+    EXPECT_EQ(container.stats().objects, 1);
+
+    EXPECT_EQ(container.get<service>().name, "db");
+    EXPECT_EQ(container.has<service>(), &container.get<service>());
+    EXPECT_EQ(static_cast<const HeterogeneousContainer&>(container).get<service>().name, "db");
+    EXPECT_EQ(built, 1);
+    seen = 0;
+    container.for_each([&](type_id_t, void*) { ++seen; });
+    EXPECT_EQ(seen, 2);
+    EXPECT_EQ(container.stats().objects, 2);
+
+    //↓ constructed entries are copied as objects, pending ones with their factory
+    HeterogeneousContainer other;
+    other.insert_lazy<std::string>([&] { ++built; return std::string("heco"); });
+    other.insert_lazy<double>([&] { ++built; return 1.5; });
+    other.get<std::string>();
+    HeterogeneousContainer copy = other.clone();
+    EXPECT_EQ(built, 2);
+    EXPECT_NE(&copy.get<std::string>(), &other.get<std::string>());
+    EXPECT_EQ(copy.get<double>(), 1.5);
+    EXPECT_EQ(built, 3);
+    EXPECT_FALSE(copy == other);
+    other.get<double>();
+    EXPECT_TRUE(copy == other);
+    EXPECT_EQ(copy.hash(), other.hash());
+}
+
+TEST(HeterogeneousContainer, insert_over_lazy)
+{
+    HeterogeneousContainer container;
+    int built = 0;
+    container.insert_lazy<service>([&] { ++built; return service{ "db" }; });
+    //↓ insert returns the lazy object, constructed as by get
+    EXPECT_EQ(container.insert(service{ "other" }).name, "db");
+    EXPECT_EQ(built, 1);
+    //↓ insert_or_assign replaces the entry by a stored object
+    EXPECT_EQ(container.insert_or_assign(service{ "cache" }).name, "cache");
+    EXPECT_TRUE(container.lazy.empty());
+    EXPECT_EQ(container.get<service>().name, "cache");
+    //↓ before its construction too, the factory is never called
+    container.insert_lazy<int>([&] { ++built; return 7; });
+    EXPECT_EQ(container.insert_or_assign(8), 8);
+    EXPECT_EQ(container.get<int>(), 8);
+    EXPECT_EQ(built, 1);
+    EXPECT_TRUE(container.lazy.empty());
+}
+
+TEST(HeterogeneousContainer, insert_lazy_once)
+{
+    HeterogeneousContainer container;
+    std::atomic<int> built{ 0 };
+    container.insert_lazy<service>([&] {
+        ++built;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return service{ "slow" };
+    });
+    std::vector<std::thread> threads;
+    std::vector<service*> seen(8);
+    for (std::size_t i = 0; i < seen.size(); ++i)
+        threads.emplace_back([&, i] { seen[i] = &container.get<service>(); });
+    for (auto& t : threads)
+        t.join();
+    EXPECT_EQ(built, 1);
+    EXPECT_TRUE(std::all_of(seen.begin(), seen.end(), [&](service* s) { return s == seen[0]; }));
+
+    //↓ a throwing factory constructs nothing, the next access calls it again
+    bool fail = true;
+    container.insert_lazy<int>([&] { if (fail) throw std::runtime_error("not yet"); return 7; });
+    EXPECT_THROW(container.get<int>(), std::runtime_error);
+    fail = false;
+    EXPECT_EQ(container.get<int>(), 7);
+}
+
+TEST(HeterogeneousContainer, warm)
+{
+    HeterogeneousContainer container;
+    std::atomic<int> built{ 0 };
+    container.insert_lazy<service>([&] { ++built; return service{ "a" }; });
+    container.insert_lazy<double>([&] { ++built; return 2.5; });
+    container.insert_lazy<float>([&] { ++built; return 1.f; });
+    container.insert(C{ 3 });
+    thread_pool pool(2);
+    std::future<void> warming = container.warm<service, double, C, long>(pool);
+    warming.get();
+    EXPECT_EQ(built, 2);
+    EXPECT_EQ(container.get<double>(), 2.5);
+    EXPECT_EQ(built, 2);
+    container.insert_lazy<char>([]() -> char { throw std::runtime_error("broken"); });
+    EXPECT_THROW((container.warm<char, float>().get()), std::runtime_error);
+}
+
+TEST(HeterogeneousContainer, erase_while_warming)
+{
+    HeterogeneousContainer container;
+    std::promise<void> started, release;
+    const std::shared_future<void> released = release.get_future().share();
+    std::atomic<int> built{ 0 };
+    container.insert_lazy<service>([&] { started.set_value(); released.wait(); ++built; return service{ "slow" }; });
+    container.insert_lazy<double>([&] { ++built; return 2.5; });
+    container.insert_lazy<float>([&] { ++built; return 1.f; });
+    thread_pool pool(1);
+    std::future<void> warming = container.warm<service, double, float>(pool);
+    started.get_future().wait();
+    //↓ entries leaving before their turn are not constructed by the task
+    EXPECT_EQ(container.erase<double>(), 1);
+    EXPECT_EQ(container.insert_or_assign(2.f), 2.f);
+    //↓ the entry being constructed is erased once it is
+    std::future<std::size_t> erasing = std::async(std::launch::async, [&] { return container.erase<service>(); });
+    release.set_value();
+    EXPECT_EQ(erasing.get(), 1);
+    warming.get();
+    EXPECT_EQ(built, 1);
+    EXPECT_FALSE(container.contains<service>());
+    EXPECT_FALSE(container.contains<double>());
+    EXPECT_EQ(container.get<float>(), 2.f);
+}
+
+struct constructing_observer : null_observer
+{
+    static inline std::size_t inserts = 0, constructs = 0, destructs = 0;
+    static void on_insert(type_id_t) { ++inserts; }
+    static void on_construct(type_id_t, const void*) { ++constructs; }
+    static void on_destruct(type_id_t, const void*) { ++destructs; }
+};
+
+TEST(HeterogeneousContainer, insert_lazy_observer)
+{
+    {
+        BasicHeterogeneousContainer<constructing_observer> container;
+        container.insert_lazy<int>([] { return 1; });
+        container.insert_lazy<double>([] { return 1.; });
+        EXPECT_EQ(constructing_observer::inserts, 2);
+        EXPECT_EQ(constructing_observer::constructs, 0);
+        container.get<int>();
+        EXPECT_EQ(constructing_observer::constructs, 1);
+    }
+    EXPECT_EQ(constructing_observer::destructs, 1);
+}
+
+TEST(HeterogeneousContainer, snapshot)
+{
+    HeterogeneousContainer container;
+    container.insert(42, std::string("v1"), std::vector<int>{ 1, 2 });
+    const int* before = &container.get<const int>();
+    const container_snapshot snap = container.snapshot();
+    EXPECT_EQ(snap.size(), 3);
+    EXPECT_TRUE((snap.contains<int, std::string>()));
+    //↓ objects are shared, not copied
+    EXPECT_EQ(snap.has<int>(), before);
+    EXPECT_EQ(snap.has<std::string>(), &std::as_const(container).get<std::string>());
+
+    //↓ writing a type copies that type only
+    container.get<std::string>() = "v2";
+    EXPECT_EQ(snap.get<std::string>(), "v1");
+    EXPECT_EQ(container.get<std::string>(), "v2");
+    EXPECT_EQ(snap.has<int>(), &container.get<const int>());
+    EXPECT_EQ(snap.has<std::vector<int>>(), container.has<const std::vector<int>>());
+    //↓ replaced and new objects are not seen by the snapshot
+    container.insert_or_assign(43);
+    container.insert(1.5);
+    EXPECT_EQ(snap.get<int>(), 42);
+    EXPECT_EQ(snap.has<double>(), nullptr);
+    EXPECT_THROW(snap.get<double>(), std::out_of_range);
+
+    //↓ copies share the objects, which outlive the container
+    container_snapshot copy = snap;
+    EXPECT_EQ(copy.has<std::vector<int>>(), snap.has<std::vector<int>>());
+    container = HeterogeneousContainer{};
+    EXPECT_EQ(copy.get<std::vector<int>>(), (std::vector<int>{ 1, 2 }));
+    int sum = 0;
+    copy.visit([&](const auto& x) { if constexpr (std::is_same_v<std::decay_t<decltype(x)>, int>) sum += x; else sum += int(x.size()); }, type_list<int, std::string>{});
+    EXPECT_EQ(sum, 42 + 2);
+    EXPECT_EQ(container_snapshot{}.size(), 0);
+}
+
+TEST(HeterogeneousContainer, snapshot_unshared)
+{
+    HeterogeneousContainer container;
+    container.insert(std::string("a"));
+    const void* p = container.has<std::string>();
+    {
+        const container_snapshot snap = container.snapshot();
+        container.insert_lazy<int>([] { return 7; });
+        EXPECT_FALSE(snap.contains<int>());
+    }
+    //↓ no snapshot left, written in place
+    container.get<std::string>() += "b";
+    EXPECT_EQ(container.has<std::string>(), p);
+
+    //↓ constructed lazy entries are shared too
+    container.get<int>();
+    const container_snapshot snap = container.snapshot();
+    container.get<int>() = 8;
+    EXPECT_EQ(snap.get<int>(), 7);
+    EXPECT_EQ(container.get<int>(), 8);
+
+    //↓ visiting for writing copies the shared objects
+    const container_snapshot again = container.snapshot();
+    container.for_each([](type_id_t tid, void* p) { if (tid == type_id<std::string>()) *static_cast<std::string*>(p) = "c"; });
+    EXPECT_EQ(again.get<std::string>(), "ab");
+    EXPECT_EQ(container.get<std::string>(), "c");
+
+    //↓ a shared object which cannot be copied cannot be written
+    container.insert(std::make_unique<int>(1));
+    const container_snapshot pinned = container.snapshot();
+    EXPECT_NO_THROW(container.get<const std::unique_ptr<int>>());
+    EXPECT_THROW(container.get<std::unique_ptr<int>>(), std::logic_error);
+}
+
+TEST(HeterogeneousContainer, snapshot_readers)
+{
+    HeterogeneousContainer container;
+    container.insert(std::vector<int>(1000, 0), std::string("config 0"));
+    std::atomic<bool> stop{ false };
+    std::atomic<int> inconsistent{ 0 };
+    std::vector<std::thread> readers;
+    container_snapshot current = container.snapshot();
+    std::mutex m;
+    for (int r = 0; r < 4; ++r)
+        readers.emplace_back([&] {
+            while (!stop) {
+                container_snapshot snap;
+                {
+                    const std::lock_guard<std::mutex> lock(m);
+                    snap = current;
+                }
+                const auto& v = snap.get<std::vector<int>>();
+                if (std::any_of(v.begin(), v.end(), [&](int x) { return x != v.front(); }))
+                    ++inconsistent;
+            }
+        });
+    for (int version = 1; version <= 50; ++version) {
+        for (int& x : container.get<std::vector<int>>())
+            x = version;
+        container_snapshot next = container.snapshot();
+        const std::lock_guard<std::mutex> lock(m);
+        current = std::move(next);
+    }
+    stop = true;
+    for (auto& t : readers)
+        t.join();
+    EXPECT_EQ(inconsistent, 0);
+    EXPECT_EQ(current.get<std::vector<int>>().front(), 50);
+}
+
+TEST(HeterogeneousContainer, extract_insert_node)
+{
+    HeterogeneousContainer a, b;
+    a.insert(std::string("request"), 42);
+    const void* p = a.has<std::string>();
+    auto node = a.extract<std::string>();
+    ASSERT_FALSE(node.empty());
+    EXPECT_FALSE(a.contains<std::string>());
+    EXPECT_TRUE(a.extract<double>().empty());
+
+    //↓ the object stays where it is
+    EXPECT_TRUE(b.insert(std::move(node)));
+    EXPECT_TRUE(node.empty());
+    EXPECT_EQ(b.has<std::string>(), p);
+    EXPECT_EQ(b.get<std::string>(), "request");
+    EXPECT_FALSE(b.insert(std::move(node)));
+
+    //↓ a type already contained leaves the node with the caller
+    a.insert(std::string("other"));
+    node = a.extract<std::string>();
+    EXPECT_FALSE(b.insert(std::move(node)));
+    ASSERT_FALSE(node.empty());
+    EXPECT_EQ(*static_cast<std::string*>(node.mapped().get()), "other");
+    EXPECT_TRUE(a.insert(std::move(node)));
+
+    //↓ nodes keep sharing their object with snapshots
+    const container_snapshot snap = b.snapshot();
+    a.insert(b.extract<std::string>());
+    EXPECT_EQ(snap.has<std::string>(), p);
+    a.get<std::string>() = "written";
+    EXPECT_EQ(snap.get<std::string>(), "request");
+}
+
+template<int I>
+struct live_observer : null_observer
+{
+    static inline int inserts = 0, live = 0;
+    static void on_insert(type_id_t) { ++inserts; }
+    static void on_construct(type_id_t, const void*) { ++live; }
+    static void on_destruct(type_id_t, const void*) { --live; }
+};
+
+TEST(HeterogeneousContainer, transfer_observer)
+{
+    {
+        BasicHeterogeneousContainer<live_observer<0>> a, c;
+        BasicHeterogeneousContainer<live_observer<1>> b;
+        a.insert(std::string("request"), 42);
+        a.insert_lazy<float>([] { return 1.f; });
+        //↓ the source sees the object leave, the destination sees it enter
+        EXPECT_TRUE(b.insert(a.extract<std::string>()));
+        EXPECT_EQ(live_observer<0>::live, 1);
+        EXPECT_EQ(live_observer<1>::inserts, 1);
+        EXPECT_EQ(live_observer<1>::live, 1);
+        //↓ dropping an extracted node reports nothing more
+        a.extract<int>();
+        EXPECT_EQ(live_observer<0>::live, 0);
+        a.insert(42);
+        a.get<float>();
+        EXPECT_EQ(live_observer<0>::live, 2);
+        c.merge(a);
+        EXPECT_EQ(live_observer<0>::inserts, 6);
+        EXPECT_EQ(live_observer<0>::live, 2);
+    }
+    EXPECT_EQ(live_observer<0>::live, 0);
+    EXPECT_EQ(live_observer<1>::live, 0);
+}
+
+TEST(HeterogeneousContainer, merge)
+{
+    HeterogeneousContainer a, b;
+    a.insert(1, std::string("a"));
+    b.insert(2, 2.5, C{ 3 });
+    b.insert_lazy<float>([] { return 1.f; });
+    const void* p = b.has<double>();
+    a.merge(b);
+    EXPECT_TRUE((a.contains<int, std::string, double, C, float>()));
+    EXPECT_EQ(a.get<int>(), 1);
+    EXPECT_EQ(a.has<double>(), p);
+    EXPECT_EQ(a.get<float>(), 1.f);
+    //↓ types both contain stay in the source
+    EXPECT_TRUE(b.contains<int>());
+    EXPECT_FALSE(b.contains<double>());
+    EXPECT_EQ(b.data.size(), 1);
+    EXPECT_TRUE(b.lazy.empty());
+
+    a.merge(HeterogeneousContainer{});
+    EXPECT_EQ(a.data.size(), 4);
+}
+
+TEST(HeterogeneousContainer, erase)
+{
+    HeterogeneousContainer container;
+    container.insert(1, 2.5, std::string("s"));
+    container.insert_lazy<float>([] { return 1.f; });
+    EXPECT_EQ((container.erase<int, float, A>()), 2);
+    EXPECT_FALSE(container.contains<int>());
+    EXPECT_FALSE(container.contains<float>());
+    EXPECT_TRUE((container.contains<double, std::string>()));
+    EXPECT_EQ(container.spare_nodes.size(), 1);
+
+    //↓ the node and the block of int are reused by the next object of the same size
+    const void* block = container.blocks->blocks[0].p;
+    auto& f = container.insert(3.f);
+    EXPECT_TRUE(container.spare_nodes.empty());
+    EXPECT_EQ(container.blocks->count, 0);
+    EXPECT_EQ(container.get<float>(), 3.f);
+    EXPECT_GE((const void*)&f, block);
+    EXPECT_LT((const void*)&f, (const std::byte*)block + container.stats().types.front().bytes + 64);
+
+    //↓ a snapshot keeps the erased object
+    const container_snapshot snap = container.snapshot();
+    EXPECT_EQ(container.erase<std::string>(), 1);
+    EXPECT_EQ(snap.get<std::string>(), "s");
+    EXPECT_GT(container.stats().spare_bytes, 0);
+}
+
+TEST(HeterogeneousContainer, steady_state_allocations)
+{
+    HeterogeneousContainer container;
+    const std::size_t start = allocations;
+    container.insert(0, std::string("short"));
+    EXPECT_GT(allocations - start, 0u);
+    //↓ a first cycle keeps the node and the block of int
+    container.erase<int>();
+    container.insert(0);
+    const void* block = &container.get<int>();
+    const void* text = &container.get<std::string>();
+
+    std::size_t before = allocations;
+    bool same_block = true;
+    for (int i = 0; i < 1000; ++i) {
+        container.erase<int>();
+        same_block &= &container.insert(i) == block;
+    }
+    EXPECT_EQ(allocations - before, 0u);
+    EXPECT_TRUE(same_block);
+    EXPECT_EQ(container.get<int>(), 999);
+
+    before = allocations;
+    for (int i = 0; i < 1000; ++i) {
+        same_block &= &container.insert_or_assign(i) == block;
+        same_block &= &container.insert_or_assign(std::string("short")) == text;
+    }
+    EXPECT_EQ(allocations - before, 0u);
+    EXPECT_TRUE(same_block);
+}
+
+TEST(HeterogeneousContainer, insert_or_assign_in_place)
+{
+    HeterogeneousContainer container;
+    const std::string& s = container.insert_or_assign(std::string("a"));
+    const std::string value(100, 'b');
+    EXPECT_EQ(&container.insert_or_assign(value), &s);
+    EXPECT_EQ(s, value);
+    EXPECT_EQ(&container.insert_or_assign<std::string>("ccc"), &s);
+    EXPECT_EQ(s, "ccc");
+
+    //↓ shared with a snapshot, the object is replaced
+    const container_snapshot snap = container.snapshot();
+    const std::string& t = container.insert_or_assign(std::string("d"));
+    EXPECT_NE(&t, &s);
+    EXPECT_EQ(snap.get<std::string>(), "ccc");
+    EXPECT_EQ(t, "d");
+
+    //↓ not assignable, the object is replaced
+    struct fixed { const int v; };
+    container.insert_or_assign(fixed{ 1 });
+    EXPECT_EQ(container.insert_or_assign(fixed{ 2 }).v, 2);
+}
+
+TEST(HeterogeneousContainer, erase_observer)
+{
+    counting_observer::destructs = 0;
+    BasicHeterogeneousContainer<counting_observer> container;
+    container.insert(1, 2.5);
+    container.erase<int>();
+    EXPECT_EQ(counting_observer::destructs, 1);
+    container.insert_lazy<float>([] { return 1.f; });
+    container.erase<float>();
+    EXPECT_EQ(counting_observer::destructs, 1);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
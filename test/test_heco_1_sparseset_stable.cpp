@@ -240,6 +240,89 @@ TEST(HeterogeneousContainer_SparseSet, move_container)
     EXPECT_EQ(b.get<int>(), 42);
 }
 
+TEST(HeterogeneousContainer_SparseSet, visit)
+{
+    HeterogeneousContainer_SparseSet1 container1;
+    HeterogeneousContainer_SparseSet2 container2;
+    container1.insert(char{ 'a' }, double{ 1.5 }, int{ 3 });
+    container2.insert(char{ 'a' }, double{ 1.5 }, int{ 3 });
+    std::vector<double> seen1, seen2;
+    container1.visit([&](auto& x) { seen1.push_back(x); }, type_list<int, double, char>{});
+    container2.visit([&](auto& x) { seen2.push_back(x); }, type_list<int, double, char>{});
+    //↓ both follow the dense array order
+    EXPECT_EQ(seen1, seen2);
+    std::sort(seen1.begin(), seen1.end());
+    EXPECT_EQ(seen1, (std::vector<double>{ 1.5, 3, 'a' }));
+    int n = 0;
+    static_cast<const HeterogeneousContainer_SparseSet2&>(container2).visit([&](const int&) { ++n; }, type_list<int>{});
+    EXPECT_EQ(n, 1);
+}
+
+TEST(HeterogeneousContainer_SparseSet, clone_equal_hash)
+{
+    using vec = std::vector<int>;
+    HeterogeneousContainer_SparseSet1 a1;
+    HeterogeneousContainer_SparseSet2 a2;
+    a1.insert(vec{ 5, 25 }, 42);
+    a2.insert(vec{ 5, 25 }, 42);
+    auto b1 = a1.clone();
+    auto b2 = a2.clone();
+    EXPECT_TRUE(a1 == b1);
+    EXPECT_TRUE(a2 == b2);
+    EXPECT_EQ(a1.hash(), b1.hash());
+    EXPECT_EQ(a2.hash(), b2.hash());
+    EXPECT_EQ(a1.hash(), a2.hash());
+    b1.get<vec>().push_back(1);
+    b2.get<int>() = 0;
+    EXPECT_TRUE(a1 != b1);
+    EXPECT_TRUE(a2 != b2);
+    EXPECT_EQ(a1.get<vec>().size(), 2);
+    EXPECT_EQ(a2.get<int>(), 42);
+}
+
+TEST(HeterogeneousContainer_SparseSet, stats)
+{
+    HeterogeneousContainer_SparseSet1 s1;
+    HeterogeneousContainer_SparseSet2 s2;
+    s1.insert(C{ 1 }, 42);
+    s2.insert(C{ 1 }, 42);
+    for (auto s : { s1.stats(), s2.stats() }) {
+        EXPECT_EQ(s.objects, 2);
+        EXPECT_EQ(s.object_bytes, sizeof(C) + sizeof(int));
+        EXPECT_EQ(s.sparse_used, 2);
+        EXPECT_EQ(s.sparse_size, std::max(type_id<C>(), type_id<int>()) + 1);
+        EXPECT_EQ(s.buckets, 0);
+        EXPECT_GT(s.index_bytes, 0);
+    }
+}
+
+struct counting_observer : null_observer
+{
+    static inline std::size_t inserts = 0, assigns = 0, misses = 0, destructs = 0;
+    static void on_insert(type_id_t) { ++inserts; }
+    static void on_assign(type_id_t, const void*) { ++assigns; }
+    static void on_get_miss(type_id_t) { ++misses; }
+    static void on_destruct(type_id_t, const void*) { ++destructs; }
+};
+
+TEST(HeterogeneousContainer_SparseSet, observer)
+{
+    {
+        BasicHeterogeneousContainer_SparseSet1<counting_observer> s1;
+        BasicHeterogeneousContainer_SparseSet2<counting_observer> s2;
+        s1.insert(C{ 1 }, 42);
+        s2.insert(C{ 1 });
+        s1.insert_or_assign(43);
+        s2.insert_or_assign(43);
+        EXPECT_EQ(s1.has<A>(), nullptr);
+        EXPECT_EQ(s2.has<A>(), nullptr);
+    }
+    EXPECT_EQ(counting_observer::inserts, 4);
+    EXPECT_EQ(counting_observer::assigns, 1);
+    EXPECT_EQ(counting_observer::misses, 2);
+    EXPECT_EQ(counting_observer::destructs, 4);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,256 @@
+﻿#include <gtest/gtest.h>
+
+#undef NDEBUG
+#define protected public
+#define private   public
+#include <heco_basic_container.h>
+#undef protected
+#undef private
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace heco;
+
+struct A
+{
+    int x;
+    char c;
+    ~A() {};
+};
+
+struct alignas(32) Wide { double v[4]; };
+
+struct Counted
+{
+    static inline int alive = 0;
+    int v;
+    Counted(int v = 0) : v(v) { ++alive; }
+    Counted(const Counted& other) : v(other.v) { ++alive; }
+    Counted(Counted&& other) noexcept : v(other.v) { ++alive; }
+    ~Counted() { --alive; }
+    bool operator==(const Counted& other) const { return v == other.v; }
+};
+
+template<typename Container>
+struct BasicContainer : ::testing::Test {};
+
+using configurations = ::testing::Types<
+    stable_map_container,
+    basic_container<storage::stable, index::sparse>,
+    basic_container<storage::stable, index::split_sparse>,
+    contiguous_map_container,
+    portable_container,
+    basic_container<storage::contiguous, index::flat_map, id::stable, alloc::resource>,
+    fixed_container<A, int, double, std::string, Wide, Counted, std::vector<int>>>;
+TYPED_TEST_SUITE(BasicContainer, configurations);
+
+TYPED_TEST(BasicContainer, insert_get)
+{
+    TypeParam container;
+    container.insert(A{ 1, 'a' });
+    container.template insert<std::string>("hello");
+    auto&& [i, d] = container.insert(2, 3.5);
+    EXPECT_EQ(i, 2);
+    EXPECT_EQ(d, 3.5);
+    EXPECT_EQ(container.size(), 4u);
+    EXPECT_EQ(container.template get<A>().c, 'a');
+    EXPECT_EQ(container.template get<std::string>(), "hello");
+    EXPECT_EQ(container.template get<int>(), 2);
+    EXPECT_TRUE((container.template contains<A, int, double>()));
+    EXPECT_FALSE((container.template contains<A, Wide>()));
+    EXPECT_EQ(container.template has<Wide>(), nullptr);
+
+    //an object already stored is kept by insert, replaced by insert_or_assign
+    EXPECT_EQ(container.insert(5), 2);
+    EXPECT_EQ(container.insert_or_assign(5), 5);
+    EXPECT_EQ(std::as_const(container).template get<int>(), 5);
+}
+
+TYPED_TEST(BasicContainer, objects_survive_growth)
+{
+    TypeParam container;
+    container.insert(std::string(100, 'x'));
+    container.template insert<std::vector<int>>(std::vector<int>{ 1, 2, 3 });
+    container.insert(Wide{ { 1., 2., 3., 4. } });
+    container.insert(Counted{ 7 });
+    container.insert(1.5);
+    EXPECT_EQ(container.template get<std::string>(), std::string(100, 'x'));
+    EXPECT_EQ(container.template get<std::vector<int>>(), (std::vector<int>{ 1, 2, 3 }));
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&container.template get<Wide>()) % alignof(Wide), 0u);
+    EXPECT_EQ(container.template get<Wide>().v[3], 4.);
+    EXPECT_EQ(container.template get<Counted>().v, 7);
+}
+
+TYPED_TEST(BasicContainer, erase_clear_destruction)
+{
+    Counted::alive = 0;
+    {
+        TypeParam container;
+        container.insert(Counted{ 1 }, 2);
+        EXPECT_EQ(Counted::alive, 1);
+        container.template erase<Counted, Wide>();
+        EXPECT_EQ(Counted::alive, 0);
+        EXPECT_FALSE(container.template contains<Counted>());
+        EXPECT_EQ(container.template get<int>(), 2);
+        container.insert(Counted{ 3 });
+        container.clear();
+        EXPECT_EQ(Counted::alive, 0);
+        EXPECT_TRUE(container.empty());
+        container.insert(Counted{ 4 });
+    }
+    EXPECT_EQ(Counted::alive, 0);
+}
+
+TYPED_TEST(BasicContainer, move_container)
+{
+    Counted::alive = 0;
+    {
+        TypeParam container;
+        container.insert(Counted{ 1 }, std::string("s"));
+        TypeParam other = std::move(container);
+        EXPECT_TRUE(container.empty());
+        EXPECT_EQ(other.template get<Counted>().v, 1);
+        TypeParam third;
+        third.insert(Counted{ 2 });
+        third = std::move(other);
+        EXPECT_EQ(Counted::alive, 1);
+        EXPECT_EQ(third.template get<std::string>(), "s");
+        container.insert(4);
+        EXPECT_EQ(container.template get<int>(), 4);
+    }
+    EXPECT_EQ(Counted::alive, 0);
+}
+
+TYPED_TEST(BasicContainer, visit_clone_equal_hash)
+{
+    TypeParam container;
+    container.insert(1, 2.5, std::string("s"));
+    int ints = 0;
+    double doubles = 0;
+    container.visit([&](auto& v) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(v)>, int>) ints += v;
+        else doubles += v;
+    }, type_list<int, double>{});
+    EXPECT_EQ(ints, 1);
+    EXPECT_EQ(doubles, 2.5);
+
+    TypeParam copy = container.clone();
+    EXPECT_TRUE(copy == container);
+    EXPECT_EQ(copy.hash(), container.hash());
+    copy.insert_or_assign(3);
+    EXPECT_TRUE(copy != container);
+
+    void* p = copy.emplace(*type_ops_of<A>());
+    EXPECT_EQ(p, copy.template has<A>());
+}
+
+TYPED_TEST(BasicContainer, stats)
+{
+    TypeParam container;
+    container.insert(1, 2.5, A{});
+    const container_stats s = container.stats();
+    EXPECT_EQ(s.objects, 3u);
+    EXPECT_EQ(s.object_bytes, sizeof(int) + sizeof(double) + sizeof(A));
+    EXPECT_EQ(s.types.size(), 3u);
+    EXPECT_GT(s.index_bytes, 0u);
+}
+
+TEST(BasicContainer, contiguous_layout)
+{
+    contiguous_map_container container;
+    auto&& [c, i] = container.insert('c', 1);
+    EXPECT_EQ(reinterpret_cast<char*>(&i) - &c, 4);
+    const container_stats s = container.stats();
+    EXPECT_EQ(s.padding_bytes, 3u);
+    container.erase<char>();
+    EXPECT_EQ(container.stats().dead_bytes, 1u);
+}
+
+TEST(BasicContainer, sparse_index)
+{
+    basic_container<storage::stable, index::sparse> container;
+    container.insert(1, 'c', 2.);
+    container.erase<int>();
+    EXPECT_EQ(container.get<char>(), 'c');
+    EXPECT_EQ(container.get<double>(), 2.);
+    const container_stats s = container.stats();
+    EXPECT_EQ(s.sparse_used, 2u);
+    EXPECT_GE(s.sparse_size, s.sparse_used);
+}
+
+TEST(BasicContainer, fixed_index)
+{
+    fixed_container<int, char> container;
+    container.insert(1, 'c');
+    EXPECT_THROW(container.insert(2.), std::logic_error);
+    EXPECT_FALSE(container.contains<double>());
+    EXPECT_EQ(container.size(), 2u);
+}
+
+TEST(BasicContainer, portable_keys)
+{
+    portable_container container;
+    container.insert(1);
+    EXPECT_NE(container.data.find(stable_type_id<int>()), nullptr);
+    EXPECT_EQ(container.data.find(type_id<int>()), nullptr);
+}
+
+TEST(BasicContainer, memory_resource)
+{
+    std::byte arena[1024];
+    std::pmr::monotonic_buffer_resource resource(arena, sizeof(arena), std::pmr::null_memory_resource());
+    basic_container<storage::stable, index::flat_map, id::dense, alloc::resource> container(alloc::resource{ &resource });
+    auto&& [i, d] = container.insert(1, 2.);
+    EXPECT_GE(reinterpret_cast<std::byte*>(&i), arena);
+    EXPECT_LT(reinterpret_cast<std::byte*>(&d), arena + sizeof(arena));
+}
+
+template<int I>
+struct fragile
+{
+    static inline int copies_left = 0, alive = 0;
+    std::string s;
+    explicit fragile(std::string s) : s(std::move(s)) { ++alive; }
+    fragile(const fragile& other) : s(other.s) {
+        if (copies_left-- == 0)
+            throw std::runtime_error("copy");
+        ++alive;
+    }
+    fragile(fragile&& other) : s(std::move(other.s)) { ++alive; }
+    fragile& operator=(const fragile&) = default;
+    ~fragile() { --alive; }
+};
+
+TEST(BasicContainer, growth_throwing_copy)
+{
+    {
+        contiguous_map_container container;
+        container.insert(fragile<0>{ "a" }, fragile<1>{ "b" });
+        //↓ the wider alignment of Wide grows the buffer, the copy of fragile<0> throws whatever the order of the objects
+        fragile<0>::copies_left = 0;
+        fragile<1>::copies_left = 1;
+        EXPECT_THROW(container.insert(Wide{}), std::runtime_error);
+        //↓ nothing moved nor destroyed
+        EXPECT_FALSE(container.contains<Wide>());
+        EXPECT_EQ(container.get<fragile<0>>().s, "a");
+        EXPECT_EQ(container.get<fragile<1>>().s, "b");
+        EXPECT_EQ(fragile<0>::alive, 1);
+        EXPECT_EQ(fragile<1>::alive, 1);
+
+        fragile<0>::copies_left = fragile<1>::copies_left = 1;
+        container.insert(Wide{});
+        EXPECT_EQ(container.get<fragile<0>>().s, "a");
+        EXPECT_EQ(container.get<fragile<1>>().s, "b");
+        EXPECT_EQ(fragile<0>::alive, 1);
+        EXPECT_EQ(fragile<1>::alive, 1);
+    }
+    EXPECT_EQ(fragile<0>::alive, 0);
+    EXPECT_EQ(fragile<1>::alive, 0);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -7,6 +7,13 @@
 #undef protected
 #undef private
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <list>
+#include <numeric>
+#include <string>
+
 using namespace heco;
 
 TEST(HeterogeneousContainer_n, insert_and_get)
@@ -19,6 +26,528 @@ TEST(HeterogeneousContainer_n, insert_and_get)
     EXPECT_EQ(c.vector<int>().back(), 5);
 }
 
+TEST(HeterogeneousContainer_n, visit)
+{
+    HeterogeneousContainer_n c;
+    c.insert(1.5, 2.5);
+    c.insert(std::vector<int>{1, 2, 3});
+    double sum = 0;
+    int n = 0;
+    c.visit([&](auto& x) { sum += x; ++n; }, type_list<int, double>{});
+    EXPECT_EQ(n, 5);
+    EXPECT_EQ(sum, 10);
+    n = 0;
+    static_cast<const HeterogeneousContainer_n&>(c).visit([&](const int&) { ++n; }, type_list<int, float>{});
+    EXPECT_EQ(n, 3);
+}
+
+TEST(HeterogeneousContainer_n, clone_equal_hash)
+{
+    HeterogeneousContainer_n a;
+    a.insert(1.5, 2.5);
+    a.insert(std::vector<int>{1, 2, 3});
+    HeterogeneousContainer_n b = a.clone();
+    EXPECT_TRUE(a == b);
+    EXPECT_EQ(a.hash(), b.hash());
+    b.vector<int>().push_back(4);
+    EXPECT_TRUE(a != b);
+    EXPECT_EQ(a.vector<int>().size(), 3);
+}
+
+TEST(HeterogeneousContainer_n, stats)
+{
+    HeterogeneousContainer_n container;
+    container.insert(1, 2, 3);
+    container.insert('a');
+    container.vector<int>().reserve(10);
+    auto s = container.stats();
+    EXPECT_EQ(s.container, "HeterogeneousContainer_n");
+    EXPECT_EQ(s.objects, 4);
+    EXPECT_EQ(s.object_bytes, 3 * sizeof(int) + sizeof(char));
+    EXPECT_EQ(s.spare_bytes, 7 * sizeof(int));
+    ASSERT_EQ(s.types.size(), 2);
+    for (auto& t : s.types) {
+        if (t.id == type_id<std::vector<int>>()) {
+            EXPECT_TRUE(t.size == sizeof(int) && t.alignment == alignof(int) && t.objects == 3);
+        }
+    }
+}
+
+struct counting_observer : null_observer
+{
+    static inline std::size_t inserts = 0, misses = 0, destructs = 0;
+    static void on_insert(type_id_t) { ++inserts; }
+    static void on_get_miss(type_id_t) { ++misses; }
+    static void on_destruct(type_id_t, const void*) { ++destructs; }
+};
+
+TEST(HeterogeneousContainer_n, observer)
+{
+    {
+        BasicHeterogeneousContainer_n<counting_observer> container;
+        container.insert(1, 2, 3);
+        container.insert('a');
+        EXPECT_FALSE(container.insert(4));
+        EXPECT_THROW(container.vector<double>(), std::out_of_range);
+    }
+    EXPECT_EQ(counting_observer::inserts, 2);
+    EXPECT_EQ(counting_observer::misses, 1);
+    EXPECT_EQ(counting_observer::destructs, 2);
+}
+
+TEST(HeterogeneousContainer_n, view)
+{
+    HeterogeneousContainer_n c;
+    c.insert(std::vector<int>{ 1, 2, 3, 4 });
+    c.insert(std::vector<double>{ .5, 1.5, 2.5 });
+    c.insert(std::vector<char>{ 'a', 'b', 'c', 'd', 'e' });
+
+    auto v = c.view<int, double, char>();
+    EXPECT_EQ(v.size(), 3u);
+    int n = 0;
+    for (auto [i, d, ch] : v) {
+        EXPECT_EQ(i, n + 1);
+        EXPECT_EQ(d, n + .5);
+        EXPECT_EQ(ch, 'a' + n);
+        i *= 10;
+        ++n;
+    }
+    EXPECT_EQ(n, 3);
+    EXPECT_EQ(c.vector<int>(), (std::vector<int>{ 10, 20, 30, 4 }));
+
+    //random access, e.g. to split the view between threads
+    static_assert(std::is_same_v<std::iterator_traits<decltype(v.begin())>::iterator_category, std::random_access_iterator_tag>);
+    EXPECT_EQ(v.end() - v.begin(), 3);
+    EXPECT_EQ(std::get<1>(v.begin()[2]), 2.5);
+    auto tail = v.subview(1, 3);
+    EXPECT_EQ(tail.size(), 2u);
+    EXPECT_EQ(std::get<0>(tail[0]), 20);
+
+    const auto& cc = c;
+    auto cv = cc.view<char, int>();
+    static_assert(std::is_same_v<decltype(cv[0]), std::tuple<const char&, const int&>>);
+    EXPECT_EQ(cv.size(), 4u);
+    EXPECT_THROW((c.view<int, float>()), std::out_of_range);
+}
+
+TEST(HeterogeneousContainer_n, parallel_for_each)
+{
+    thread_pool pool(4);
+    HeterogeneousContainer_n c;
+    c.insert(std::vector<int>(10000, 1));
+    std::atomic<long> sum = 0;
+    c.parallel_for_each<int>([&](int& x) { x *= 2; sum += x; }, { &pool });
+    EXPECT_EQ(sum, 20000);
+    EXPECT_EQ(std::count(c.vector<int>().begin(), c.vector<int>().end(), 2), 10000);
+    EXPECT_THROW(c.parallel_for_each<float>([](float&) {}, { &pool }), std::out_of_range);
+    EXPECT_THROW(c.parallel_for_each<int>([](int&) { throw std::runtime_error("task"); }, { &pool }), std::runtime_error);
+
+    //the calling thread takes part, runs nested batches inline, and a pool of one thread runs everything inline
+    thread_pool single(1);
+    std::atomic<int> n = 0;
+    c.parallel_for_each<int>([&](int&) { ++n; }, { &single });
+    EXPECT_EQ(n, 10000);
+    pool.run(4, [&](std::size_t) { pool.run(10, [&](std::size_t) { ++n; }); });
+    EXPECT_EQ(n, 10040);
+}
+
+TEST(HeterogeneousContainer_n, parallel_for_each_type)
+{
+    thread_pool pool(3);
+    HeterogeneousContainer_n c;
+    c.insert(std::vector<int>(5000, 1));
+    c.insert(std::vector<double>(3000, .5));
+    c.insert(std::vector<char>(100, 'c'));
+    std::atomic<int> ints = 0, doubles = 0;
+    c.parallel_for_each_type([&](auto& x) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(x)>, int>) ++ints;
+        else ++doubles;
+        x += 1;
+    }, type_list<int, double, float>{}, { &pool });
+    EXPECT_EQ(ints, 5000);
+    EXPECT_EQ(doubles, 3000);
+    EXPECT_EQ(c.vector<double>(2999), 1.5);
+    EXPECT_EQ(c.vector<char>(0), 'c');
+}
+
+TEST(HeterogeneousContainer_n, parallel_chunks)
+{
+    alignas(64) static int values[1000];
+    const parallel_options deterministic{ nullptr, 256, true };
+    const auto a = parallel_chunks(values + 1, 1000, sizeof(int), deterministic, 2);
+    const auto b = parallel_chunks(values, 1000, sizeof(int), deterministic, 8);
+    EXPECT_EQ(a, b);
+    ASSERT_EQ(a.size(), 16u);
+    EXPECT_EQ(a[1], (std::pair<std::size_t, std::size_t>(64, 128)));
+    EXPECT_EQ(a.back().second, 1000u);
+
+    //otherwise chunks after the first one start on a cache line
+    const auto c = parallel_chunks(values + 1, 999, sizeof(int), { nullptr, 256 }, 4);
+    EXPECT_EQ(c[0], (std::pair<std::size_t, std::size_t>(0, 15)));
+    for (std::size_t i = 1; i < c.size(); ++i) {
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(values + 1 + c[i].first) % 64, 0u);
+        EXPECT_EQ(c[i].first, c[i - 1].second);
+    }
+
+    //deterministic runs assign the same chunks to the same threads, so per chunk results are reproducible
+    thread_pool pool(4);
+    std::vector<std::thread::id> first(a.size()), second(a.size());
+    for (auto* owners : { &first, &second })
+        pool.run(a.size(), [&](std::size_t i) { (*owners)[i] = std::this_thread::get_id(); std::this_thread::yield(); }, false);
+    EXPECT_EQ(first, second);
+}
+
+TEST(HeterogeneousContainer_n, insert_appends)
+{
+    HeterogeneousContainer_n c;
+    EXPECT_TRUE(c.insert(1, 2));
+    EXPECT_FALSE(c.insert(3));
+    const std::vector<int> more{ 4, 5 }, again{ 6 };
+    EXPECT_FALSE(c.insert(more, again));
+    EXPECT_EQ(c.vector<int>(), (std::vector<int>{ 1, 2, 3, 4, 5, 6 }));
+
+    std::string s("a string long enough to be allocated on the heap");
+    EXPECT_TRUE(c.insert(s));
+    EXPECT_EQ(c.vector<std::string>().back(), s);
+}
+
+TEST(HeterogeneousContainer_n, insert_adopts_vector)
+{
+    HeterogeneousContainer_n c;
+    std::vector<std::string> strings{ "a", "b" };
+    const std::string* buffer = strings.data();
+    EXPECT_TRUE(c.insert(std::move(strings)));
+    EXPECT_EQ(c.vector<std::string>().data(), buffer);
+
+    std::vector<std::string> others{ std::string(64, 'c') };
+    const char* chars = others[0].data();
+    EXPECT_FALSE(c.insert(std::move(others)));
+    EXPECT_EQ(c.vector<std::string>().size(), 3u);
+    EXPECT_EQ(c.vector<std::string>(2).data(), chars);
+}
+
+TEST(HeterogeneousContainer_n, append)
+{
+    HeterogeneousContainer_n c;
+    const int raw[] = { 1, 2, 3 };
+    c.append<int>(raw);
+    c.append<int>(std::array<int, 2>{ 4, 5 });
+    std::list<int> list{ 6, 7 };
+    EXPECT_EQ(c.append<int>(list.begin(), list.end()), (std::vector<int>{ 1, 2, 3, 4, 5, 6, 7 }));
+
+    std::vector<std::string> strings{ std::string(64, 'a'), std::string(64, 'b') };
+    const char* chars = strings[1].data();
+    c.append<std::string>(std::move(strings));
+    std::list<std::string> more{ std::string(64, 'c') };
+    const char* more_chars = more.front().data();
+    c.append<std::string>(std::move(more));
+    EXPECT_EQ(c.vector<std::string>(1).data(), chars);
+    EXPECT_EQ(c.vector<std::string>(2).data(), more_chars);
+
+    std::vector<std::string> copied{ "d" };
+    c.append<std::string>(copied);
+    EXPECT_EQ(copied.size(), 1u);
+    EXPECT_EQ(c.vector<std::string>().back(), "d");
+}
+
+TEST(HeterogeneousContainer_n, emplace_back)
+{
+    struct P { int x, y; };
+    HeterogeneousContainer_n c;
+    EXPECT_EQ(c.emplace_back<std::string>(3, 'x'), "xxx");
+    P& p = c.emplace_back<P>(1, 2);
+    EXPECT_EQ(p.y, 2);
+    c.emplace_back<P>(3, 4);
+    EXPECT_EQ(c.vector<P>().size(), 2u);
+}
+
+TEST(HeterogeneousContainer_n, handles)
+{
+    HeterogeneousContainer_n c;
+    const handle<std::string> a = c.insert_handle<std::string>("a");
+    const handle<std::string> b = c.insert_handle<std::string>("b");
+    const handle<std::string> d = c.insert_handle<std::string>("d");
+    EXPECT_EQ(c.get(b), "b");
+
+    //erase swaps the last element in, other handles follow it
+    EXPECT_TRUE(c.erase(a));
+    EXPECT_EQ(c.vector<std::string>(), (std::vector<std::string>{ "d", "b" }));
+    EXPECT_EQ(c.get(d), "d");
+    EXPECT_EQ(c.get(b), "b");
+    EXPECT_FALSE(c.valid(a));
+    EXPECT_EQ(c.has(a), nullptr);
+    EXPECT_THROW(c.get(a), std::out_of_range);
+    EXPECT_FALSE(c.erase(a));
+
+    //a reused slot does not revive the stale handle
+    const handle<std::string> e = c.insert_handle<std::string>("e");
+    EXPECT_EQ(e.slot, a.slot);
+    EXPECT_NE(e, a);
+    EXPECT_FALSE(c.valid(a));
+    EXPECT_EQ(c.get(e), "e");
+
+    //handles survive reallocation and elements appended without handles
+    for (int i = 0; i < 100; ++i)
+        c.emplace_back<std::string>(std::to_string(i));
+    EXPECT_EQ(c.get(e), "e");
+    const handle<std::string> last = c.handle_of<std::string>(c.vector<std::string>().size() - 1);
+    EXPECT_TRUE(c.erase(b));
+    EXPECT_EQ(c.get(last), "99");
+    EXPECT_EQ(std::as_const(c).get(d), "d");
+
+    const HeterogeneousContainer_n copy = c.clone();
+    EXPECT_EQ(copy.get(e), "e");
+    EXPECT_FALSE(copy.valid(b));
+    EXPECT_FALSE(c.valid(handle<int>{ 0, 0 }));
+    EXPECT_GE(c.stats().index_bytes, c.handles.at(type_id<std::vector<std::string>>()).bytes() + sizeof(std::vector<std::string>));
+}
+
+struct Point3 { float x, y, z; bool operator==(const Point3& o) const { return x == o.x && y == o.y && z == o.z; } };
+template<> struct heco::soa_members<Point3> { static constexpr auto value = std::make_tuple(&Point3::x, &Point3::y, &Point3::z); };
+
+struct Named { std::string name; int id; };
+template<> struct heco::soa_members<Named> { static constexpr auto value = std::make_tuple(&Named::id, &Named::name); };
+
+TEST(HeterogeneousContainer_n, soa_columns)
+{
+    HeterogeneousContainer_n c;
+    EXPECT_TRUE(c.insert_soa(Point3{ 1, 2, 3 }, Point3{ 4, 5, 6 }));
+    EXPECT_FALSE(c.insert_soa(Point3{ 7, 8, 9 }));
+
+    auto xs = c.column<&Point3::x>();
+    static_assert(std::is_same_v<decltype(xs), column_span<float>>);
+    EXPECT_EQ(xs.size(), 3u);
+    EXPECT_EQ(xs[1], 4.f);
+    EXPECT_EQ(c.column<&Point3::z>().data() + 2, &c.column<&Point3::z>()[2]);
+    float max_x = 0;
+    for (float x : xs)
+        max_x = std::max(max_x, x);
+    EXPECT_EQ(max_x, 7.f);
+
+    //whole objects through proxies
+    soa_vector<Point3>& points = c.soa<Point3>();
+    const Point3 p = points[1];
+    EXPECT_EQ(p, (Point3{ 4, 5, 6 }));
+    points[0] = Point3{ 10, 11, 12 };
+    points[2].get<&Point3::y>() = 80;
+    EXPECT_EQ(c.column<&Point3::x>()[0], 10.f);
+    EXPECT_EQ(points.load(2), (Point3{ 7, 80, 9 }));
+
+    const auto& cc = c;
+    static_assert(std::is_same_v<decltype(cc.column<&Point3::y>()), column_span<const float>>);
+    EXPECT_EQ(Point3(cc.soa<Point3>()[0]), (Point3{ 10, 11, 12 }));
+    EXPECT_THROW(c.soa<Named>(), std::out_of_range);
+    EXPECT_TRUE(c.clone() == c);
+}
+
+TEST(HeterogeneousContainer_n, soa_non_trivial_members)
+{
+    HeterogeneousContainer_n c;
+    c.insert_soa(Named{ std::string(64, 'a'), 1 }, Named{ "b", 2 });
+    EXPECT_EQ(c.column<&Named::name>()[0], std::string(64, 'a'));
+    EXPECT_EQ(c.column<&Named::id>()[1], 2);
+    c.soa<Named>().pop_back();
+    EXPECT_EQ(c.soa<Named>().size(), 1u);
+    EXPECT_EQ(c.column<&Named::name>().size(), 1u);
+}
+
+template<typename T>
+void check_kernels(std::size_t n)
+{
+    std::vector<T> a(n), b(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        a[i] = T((i * 7919) % 101) - T(50 * std::is_signed_v<T>);
+        b[i] = T(i % 5);
+    }
+    const T sum = std::accumulate(a.begin(), a.end(), T(0));
+    const T dot = std::inner_product(a.begin(), a.end(), b.begin(), T(0));
+    EXPECT_EQ(simd::sum(a), sum) << n;
+    EXPECT_EQ(simd::dot(a, b), dot) << n;
+    if (n) {
+        EXPECT_EQ(simd::min(a), *std::min_element(a.begin(), a.end())) << n;
+        EXPECT_EQ(simd::max(a), *std::max_element(a.begin(), a.end())) << n;
+    }
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    //both dispatched variants, whatever the CPU running the test picks
+    EXPECT_EQ(simd::detail::sum_base(a.data(), n), sum) << n;
+    EXPECT_EQ(simd::detail::dot_base(a.data(), b.data(), n), dot) << n;
+    if (simd::detail::has_avx2()) {
+        EXPECT_EQ(simd::detail::sum_avx2(a.data(), n), sum) << n;
+        EXPECT_EQ(simd::detail::dot_avx2(a.data(), b.data(), n), dot) << n;
+        if (n) {
+            EXPECT_EQ(simd::detail::reduce_avx2<true>(a.data(), n), *std::min_element(a.begin(), a.end())) << n;
+        }
+    }
+#endif
+}
+
+TEST(HeterogeneousContainer_n, simd_kernels)
+{
+    //integral values in doubles and floats sum exactly whatever the order
+    for (std::size_t n : { 0, 1, 3, 7, 8, 15, 16, 17, 31, 33, 64, 100, 1001 }) {
+        check_kernels<int>(n);
+        check_kernels<double>(n);
+        check_kernels<float>(n);
+        check_kernels<std::uint8_t>(n);
+        check_kernels<std::int64_t>(n);
+    }
+    //unaligned starts
+    std::vector<double> v(40, 1.);
+    v[37] = -3;
+    EXPECT_EQ(simd::sum(v.data() + 1, 39), 35.);
+    EXPECT_EQ(simd::min(v.data() + 3, 37), -3.);
+    EXPECT_EQ(simd::dot(v.data() + 1, std::vector<int>(39, 2).data(), 39), 70.);
+}
+
+TEST(HeterogeneousContainer_n, simd_container)
+{
+    HeterogeneousContainer_n c;
+    c.insert(std::vector<double>{ 1.5, -2., 4., 0.5 });
+    c.insert(std::vector<int>{ 2, 2, 2 });
+    EXPECT_EQ(c.sum<double>(), 4.);
+    EXPECT_EQ(c.min<double>(), -2.);
+    EXPECT_EQ(c.max<double>(), 4.);
+    EXPECT_EQ((c.dot<double, int>()), 7.);
+    EXPECT_EQ(c.count_if<double>([](double x) { return x > 1; }), 2u);
+    c.transform<double>([](double x) { return x * 2; });
+    EXPECT_EQ(c.vector<double>(), (std::vector<double>{ 3., -4., 8., 1. }));
+    EXPECT_THROW(c.sum<float>(), std::out_of_range);
+    c.insert(std::vector<float>{});
+    EXPECT_EQ(c.sum<float>(), 0.f);
+    EXPECT_THROW(c.min<float>(), std::domain_error);
+    EXPECT_THROW(c.max<float>(), std::domain_error);
+
+    c.insert_soa(Point3{ 1, 2, 3 }, Point3{ 4, 5, 6 });
+    EXPECT_EQ(simd::max(c.column<&Point3::y>()), 5.f);
+    simd::transform(c.column<&Point3::z>(), [](float z) { return -z; });
+    EXPECT_EQ(simd::sum(c.column<&Point3::z>()), -9.f);
+}
+
+struct Shape { virtual ~Shape() = default; virtual double area() const = 0; };
+struct Square : Shape { double side; explicit Square(double s) : side(s) {} double area() const override { return side * side; } };
+struct Disc final : Shape { double r; explicit Disc(double r) : r(r) {} double area() const override { return 3 * r * r; } };
+struct Tag { int tag = 7; };
+struct TaggedSquare : Tag, Square { using Square::Square; };//< Square is not at offset 0
+template<> struct heco::bases_of<Square> { using type = heco::type_list<Shape>; };
+template<> struct heco::bases_of<Disc> { using type = heco::type_list<Shape>; };
+template<> struct heco::bases_of<TaggedSquare> { using type = heco::type_list<Square, Shape, Tag>; };
+
+TEST(HeterogeneousContainer_n, for_each_base)
+{
+    HeterogeneousContainer_n c;
+    c.insert(Square{ 1 }, Square{ 2 });
+    c.insert(Disc{ 1 });
+    c.insert(TaggedSquare{ 3 }, TaggedSquare{ 4 });
+    c.insert(5, 6);
+    double area = 0;
+    int n = 0;
+    c.for_each<Shape>([&](Shape& s) { area += s.area(); ++n; });
+    EXPECT_EQ(n, 5);
+    EXPECT_EQ(area, 1 + 4 + 3 + 9 + 16);
+    //↓ a recorded base which is not the first one, and the stored type itself
+    int tags = 0;
+    c.for_each<Tag>([&](const Tag& t) { tags += t.tag; });
+    EXPECT_EQ(tags, 14);
+    n = 0;
+    static_cast<const HeterogeneousContainer_n&>(c).for_each<Square>([&](const Square& s) { ++n; EXPECT_GE(s.side, 1); });
+    EXPECT_EQ(n, 4);
+    n = 0;
+    c.for_each<Shape>([&](Shape&) { ++n; }, type_list<>{});
+    EXPECT_EQ(n, 5);
+}
+
+TEST(HeterogeneousContainer_n, for_each_base_devirtualized)
+{
+    HeterogeneousContainer_n c;
+    c.insert(Square{ 1 });
+    c.insert(Disc{ 2 }, Disc{ 1 });
+    int as_disc = 0, as_shape = 0;
+    double area = 0;
+    auto f = [&](auto& s) {
+        if constexpr (std::is_same_v<std::remove_const_t<std::remove_reference_t<decltype(s)>>, Disc>) ++as_disc;
+        else ++as_shape;
+        area += s.area();
+    };
+    c.for_each<Shape>(f, type_list<Disc>{});
+    EXPECT_EQ(as_disc, 2);
+    EXPECT_EQ(as_shape, 1);
+    EXPECT_EQ(area, 1 + 12 + 3);
+    as_disc = as_shape = 0;
+    static_cast<const HeterogeneousContainer_n&>(c).for_each<Shape>(f, type_list<Disc, Square>{});
+    EXPECT_EQ(as_disc, 2);
+    EXPECT_EQ(as_shape, 1);
+    //↓ listed types which are not stored are skipped
+    as_disc = as_shape = 0;
+    HeterogeneousContainer_n squares;
+    squares.insert(Square{ 2 });
+    squares.for_each<Shape>(f, type_list<Disc>{});
+    EXPECT_EQ(as_disc, 0);
+    EXPECT_EQ(as_shape, 1);
+}
+
+struct Order { std::uint64_t id; std::string client; double amount; };
+
+TEST(HeterogeneousContainer_n, index)
+{
+    for (const index_kind kind : { index_kind::hash, index_kind::sorted }) {
+        HeterogeneousContainer_n c;
+        c.insert(Order{ 1, "a", 10 }, Order{ 2, "b", 20 });
+        c.index<Order>(&Order::id, kind);
+        EXPECT_TRUE(c.is_indexed<Order>());
+        EXPECT_FALSE(c.is_indexed<int>());
+        EXPECT_EQ(c.find<Order>(std::uint64_t(2))->client, "b");
+        EXPECT_EQ(c.find<Order>(std::uint64_t(3)), nullptr);
+
+        //appends are indexed, whatever the way
+        const handle<Order> h3 = c.insert_handle<Order>(Order{ 3, "c", 30 });
+        c.append<Order>(std::vector<Order>{ { 4, "d", 40 }, { 5, "e", 50 } });
+        c.emplace_back<Order>(Order{ 6, "f", 60 });
+        for (std::uint64_t id = 1; id <= 6; ++id)
+            ASSERT_NE(c.find<Order>(id), nullptr) << id;
+        EXPECT_EQ(c.find<Order>(std::uint64_t(5))->client, "e");
+
+        //erase moves the last element into the hole
+        EXPECT_TRUE(c.erase(h3));
+        EXPECT_EQ(c.find<Order>(std::uint64_t(3)), nullptr);
+        EXPECT_EQ(c.find<Order>(std::uint64_t(6)), &c.vector<Order>()[2]);
+
+        //a key changed through a handle moves in the index
+        const handle<Order> h1 = c.handle_of<Order>(0);
+        c.modify(h1, [](Order& o) { o.id = 10; });
+        EXPECT_EQ(c.find<Order>(std::uint64_t(1)), nullptr);
+        EXPECT_EQ(c.find<Order>(std::uint64_t(10)), &c.get(h1));
+        EXPECT_THROW(c.modify(h1, [](Order& o) { o.id = 11; throw std::runtime_error("abort"); }), std::runtime_error);
+        EXPECT_EQ(c.find<Order>(std::uint64_t(11)), &c.get(h1));
+
+        //other changes need a rebuild
+        c.vector<Order>()[1].id = 20;
+        c.reindex<Order>();
+        EXPECT_EQ(std::as_const(c).find<Order>(std::uint64_t(20))->client, "b");
+
+        const HeterogeneousContainer_n copy = c.clone();
+        EXPECT_EQ(copy.find<Order>(std::uint64_t(20))->client, "b");
+        EXPECT_GT(c.stats().index_bytes, 0u);
+        EXPECT_THROW(c.find<Order>(20), std::logic_error);
+        EXPECT_THROW(c.find<int>(20), std::out_of_range);
+    }
+}
+
+TEST(HeterogeneousContainer_n, index_projection)
+{
+    HeterogeneousContainer_n c;
+    c.insert(Order{ 1, "b", 10 }, Order{ 2, "a", 20 }, Order{ 3, "b", 30 });
+    //several elements of a key, the first appended one is found by a sorted index
+    c.index<Order>([](const Order& o) { return o.client; }, index_kind::sorted);
+    EXPECT_EQ(c.find<Order>(std::string("b"))->id, 1u);
+    EXPECT_EQ(c.find<Order>(std::string("a"))->id, 2u);
+    //replacing the index
+    c.index<Order>(&Order::amount);
+    EXPECT_EQ(c.find<Order>(30.)->id, 3u);
+    struct unordered { int x; bool operator==(const unordered& o) const { return x == o.x; } };
+    EXPECT_THROW(c.index<Order>([](const Order&) { return unordered{ 0 }; }, index_kind::sorted), std::logic_error);
+    EXPECT_THROW(c.index<Order>([](const Order&) { return unordered{ 0 }; }), std::logic_error);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,189 @@
+﻿#include <gtest/gtest.h>
+
+#undef NDEBUG
+#define protected public
+#define private   public
+#include <heco_1_map_array.h>
+#include <heco_1_map_stable.h>
+#include <heco_1_sparseset_stable.h>
+#include <heco_n_map_stable.h>
+#include <heco_serialization.h>
+#undef protected
+#undef private
+
+#include <sstream>
+
+using namespace heco;
+
+struct Point
+{
+    double x, y;
+    std::string label;
+    bool operator==(const Point& other) const { return x == other.x && y == other.y && label == other.label; }
+};
+
+namespace heco {
+    template<>
+    struct serializer<Point>
+    {
+        static void write(output& out, const Point& p) { out.write(p.x); out.write(p.y); out.write(p.label); }
+        static void read(input& in, Point& p) { in.read(p.x); in.read(p.y); in.read(p.label); }
+    };
+}
+
+serializer_registry make_registry()
+{
+    serializer_registry registry;
+    registry.add<int>("int")
+        .add<double>("double")
+        .add<std::string>("string")
+        .add<std::vector<int>>("vector<int>")
+        .add<std::vector<std::string>>("vector<string>")
+        .add<Point>("Point")
+        .add<std::vector<Point>>("vector<Point>");
+    return registry;
+}
+
+template<typename Container>
+Container round_trip(const Container& c, std::size_t buffer_size = 4096)
+{
+    const auto registry = make_registry();
+    std::stringstream ss;
+    writer(ss, registry, buffer_size).write(c);
+    Container copy;
+    reader(ss, registry).read(copy);
+    return copy;
+}
+
+TEST(Serialization, HeterogeneousArray)
+{
+    HeterogeneousArray c;
+    c.insert(42, 3.5, std::string(100, 'x'));
+    c.insert(std::vector<std::string>{ "a", "bc" });
+    auto copy = round_trip(c);
+    EXPECT_TRUE(c == copy);
+    EXPECT_EQ(copy.get<std::string>(), std::string(100, 'x'));
+}
+
+TEST(Serialization, HeterogeneousContainer)
+{
+    HeterogeneousContainer c;
+    c.insert(42, std::vector<int>(10000, 7), Point{ 1, 2, "p" });
+    auto copy = round_trip(c, 16);//< objects much larger than the buffer are split into chunks
+    EXPECT_TRUE(c == copy);
+    EXPECT_EQ(copy.get<Point>().label, "p");
+}
+
+TEST(Serialization, HeterogeneousContainer_SparseSet)
+{
+    HeterogeneousContainer_SparseSet1 c1;
+    HeterogeneousContainer_SparseSet2 c2;
+    c1.insert(42, std::string("heco"));
+    c2.insert(42, std::string("heco"));
+    EXPECT_TRUE(c1 == round_trip(c1));
+    EXPECT_TRUE(c2 == round_trip(c2));
+}
+
+TEST(Serialization, HeterogeneousContainer_n)
+{
+    HeterogeneousContainer_n c;
+    c.insert(1, 2, 3);
+    c.insert(Point{ 1, 2, "p" }, Point{ 3, 4, "q" });
+    auto copy = round_trip(c, 8);
+    EXPECT_TRUE(c == copy);
+    EXPECT_EQ(copy.vector<Point>(1).label, "q");
+}
+
+//Reading a type the destination already holds throws and leaves its object as it was
+template<typename Container>
+void read_stored_type()
+{
+    const auto registry = make_registry();
+    Container c, copy, expected;
+    c.insert(42);
+    copy.insert(1);
+    expected.insert(1);
+    std::stringstream ss;
+    writer(ss, registry).write(c);
+    EXPECT_THROW(reader(ss, registry).read(copy), std::runtime_error);
+    EXPECT_TRUE(copy == expected);
+}
+
+TEST(Serialization, stored_type)
+{
+    read_stored_type<HeterogeneousArray>();
+    read_stored_type<HeterogeneousContainer>();
+    read_stored_type<HeterogeneousContainer_SparseSet1>();
+    read_stored_type<HeterogeneousContainer_SparseSet2>();
+    read_stored_type<HeterogeneousContainer_n>();
+}
+
+TEST(Serialization, errors)
+{
+    const auto registry = make_registry();
+    {// unregistered type
+        HeterogeneousContainer c;
+        c.insert(1.f);
+        std::stringstream ss;
+        EXPECT_THROW(writer(ss, registry).write(c), std::logic_error);
+    }
+    {// truncated stream
+        HeterogeneousContainer c;
+        c.insert(std::string(64, 'x'));
+        std::stringstream ss;
+        writer(ss, registry).write(c);
+        std::stringstream truncated(ss.str().substr(0, 20));
+        HeterogeneousContainer copy;
+        EXPECT_THROW(reader(truncated, registry).read(copy), std::runtime_error);
+        EXPECT_FALSE(copy.contains<std::string>());//< the half read object is removed
+    }
+    {// corrupt lengths are refused before allocating them, whether the stream can seek or not
+        struct unseekable : std::stringbuf
+        {
+            using std::stringbuf::stringbuf;
+            pos_type seekoff(off_type, std::ios::seekdir, std::ios::openmode) override { return pos_type(-1); }
+            pos_type seekpos(pos_type, std::ios::openmode) override { return pos_type(-1); }
+        };
+        auto varint = [](std::uint64_t v) {
+            std::string bytes;
+            do {
+                bytes += char((v & 0x7f) | (v >> 7 ? 0x80 : 0));
+                v >>= 7;
+            } while (v);
+            return bytes;
+        };
+        const std::string magic(stream_magic, sizeof(stream_magic));
+        const std::string huge_length = varint(std::uint64_t(1) << 40);
+        const std::string huge_string = magic + varint(6) + "string" + varint(huge_length.size()) + huge_length;
+        const std::string huge_name = magic + huge_length + "int";
+        for (const std::string& stream : { huge_string, huge_name }) {
+            std::stringstream seekable(stream);
+            HeterogeneousContainer copy;
+            EXPECT_THROW(reader(seekable, registry).read(copy), std::runtime_error);
+            EXPECT_TRUE(copy.data.empty());
+            unseekable buffer(stream);
+            std::istream pipe(&buffer);
+            EXPECT_THROW(reader(pipe, registry).read(copy), std::runtime_error);
+            EXPECT_TRUE(copy.data.empty());
+        }
+    }
+    {// name unknown to the reader
+        HeterogeneousContainer c;
+        c.insert(1.f);
+        serializer_registry other;
+        other.add<float>("float");
+        std::stringstream ss;
+        writer(ss, other).write(c);
+        HeterogeneousContainer copy;
+        EXPECT_THROW(reader(ss, registry).read(copy), std::runtime_error);
+    }
+    serializer_registry twice;
+    twice.add<int>("int");
+    EXPECT_THROW(twice.add<int>("int2"), std::logic_error);
+    EXPECT_THROW(twice.add<float>("int"), std::logic_error);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}